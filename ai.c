@@ -0,0 +1,245 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ai.c: Autoplayer for the Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "te.h"
+#include "ai.h"
+
+/* Found by trial and error on the 8 x 16 board. In hundredths */
+const AiWeights Ai_DefaultWeights = {
+	 -51
+	,76
+	,-36
+	,-18
+};
+
+/* Neighbouring column pairs, one bit for the pair of a column and the one
+ * to its left */
+#define COLUMN_PAIRS			(ROW_COMPLETED >> 1)
+
+/* Number of occupied squares in a row */
+static uint8_t CountSquares(BoardRow Row)
+{
+	uint8_t Count = 0;
+
+	for (; Row; Row &= Row - 1)
+		Count++;
+
+	return Count;
+}
+
+/* All features come out of one pass from the top down. "Covered" has the
+ * columns that have had a locked square so far. A column is as high as the
+ * number of rows it is covered in, a hole is a free square in a covered
+ * column and two neighbouring columns differ in height by the number of
+ * rows only one of them is covered in */
+int32_t Ai_Evaluate(const BoardRow *Board, uint8_t Lines, const AiWeights *Weights)
+{
+	BoardRow Covered = ROW_EMPTY;
+	uint16_t Height = 0, Holes = 0, Bumpiness = 0;
+	uint8_t Row;
+
+	for (Row = 0; Row < BOARD_ROWS; Row++) {
+		Holes += CountSquares(Covered & ~Board[Row]);
+		Covered |= Board[Row];
+		Height += CountSquares(Covered);
+		Bumpiness += CountSquares((Covered ^ (Covered >> 1)) & COLUMN_PAIRS);
+	}
+
+	return (int32_t)Weights->Height * Height
+	     + (int32_t)Weights->Lines * Lines
+	     + (int32_t)Weights->Holes * Holes
+	     + (int32_t)Weights->Bumpiness * Bumpiness;
+}
+
+/* Sum of the heights of the columns and of the height differences of
+ * neighbouring ones, the features Ai_Evaluate gets from the rows */
+typedef struct {
+	int16_t Height;
+	int16_t Bumpiness;
+} AiProfile;
+
+static void Profile(const uint8_t *Heights, AiProfile *Profile)
+{
+	uint8_t Column;
+
+	Profile->Height = Heights[0];
+	Profile->Bumpiness = 0;
+
+	for (Column = 1; Column < BOARD_COLUMNS; Column++) {
+		Profile->Height += Heights[Column];
+		Profile->Bumpiness += (Heights[Column] > Heights[Column - 1]) ? Heights[Column] - Heights[Column - 1] : Heights[Column - 1] - Heights[Column];
+	}
+}
+
+/* Drop the tetromino, remove the rows it completes and rate the board */
+static int32_t RateCompleted(const TetrisGame *Game, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y, const AiWeights *Weights)
+{
+	BoardRow Playfield[PLAYFIELD_ROWS];
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Type = Game->Falling.Type, Lines, Row;
+
+	memcpy(Playfield, Game->Playfield, sizeof(Playfield));
+
+	Te_AddTetromino(Board, Type, Orientation, Pos_x, Pos_y);
+	Lines = Te_ClearCompletedRows(Board, Pos_y);
+
+	/* Squares above the board are lost and so is the game, most likely */
+	for (Row = 0; Row < PLAYFIELD_ROWS_HIDDEN; Row++)
+		if (Playfield[Row] != ROW_EMPTY)
+			return AI_LOST;
+
+	return Ai_Evaluate(Board, Lines, Weights);
+}
+
+/* Drop the tetromino from its current row and rate the outcome. Unless rows
+ * are completed the board is not touched: The heights and holes the engine
+ * keeps are updated for the columns of the tetromino and so are the
+ * differences to their neighbours. Rates the same as Ai_Evaluate */
+static int32_t Rate(const TetrisGame *Game, const AiProfile *Before, uint8_t Orientation, uint8_t Pos_x, const AiWeights *Weights)
+{
+	const BoardRow *Board = TE_BOARD(Game);
+	uint8_t Type = Game->Falling.Type, Heights[BOARD_COLUMNS], Pos_y, Column, End;
+	uint16_t Holes = Game->Holes;
+	AiProfile After = *Before;
+
+	Pos_y = Te_GhostRow(Board, Game->Heights, Type, Orientation, Pos_x, Game->Falling.Pos_y);
+
+	if (Te_CompletedRows(Board, Type, Orientation, Pos_x, Pos_y))
+		return RateCompleted(Game, Orientation, Pos_x, Pos_y, Weights);
+
+	memcpy(Heights, Game->Heights, sizeof(Heights));
+	if (Te_AccountTetromino(Heights, &Holes, Type, Orientation, Pos_x, Pos_y))
+		return AI_LOST;
+
+	End = (Pos_x + TEROMINO_WIDTH < BOARD_COLUMNS) ? Pos_x + TEROMINO_WIDTH : BOARD_COLUMNS;
+
+	for (Column = Pos_x; Column < End; Column++)
+		After.Height += Heights[Column] - Game->Heights[Column];
+
+	/* The pairs of a column and the one to its left */
+	if (End == BOARD_COLUMNS)
+		End--;
+
+	for (Column = Pos_x ? Pos_x - 1 : 0; Column < End; Column++)
+		After.Bumpiness += ((Heights[Column + 1] > Heights[Column]) ? Heights[Column + 1] - Heights[Column] : Heights[Column] - Heights[Column + 1])
+				 - ((Game->Heights[Column + 1] > Game->Heights[Column]) ? Game->Heights[Column + 1] - Game->Heights[Column] : Game->Heights[Column] - Game->Heights[Column + 1]);
+
+	return (int32_t)Weights->Height * After.Height
+	     + (int32_t)Weights->Holes * (int32_t)Holes
+	     + (int32_t)Weights->Bumpiness * After.Bumpiness;
+}
+
+int32_t Ai_Rate(const TetrisGame *Game, const AiMove *Move, const AiWeights *Weights)
+{
+	AiProfile Before;
+
+	Profile(Game->Heights, &Before);
+
+	return Rate(Game, &Before, Move->Orientation, Move->Pos_x, Weights);
+}
+
+/* The placements reached by rotating the tetromino where it is and then
+ * moving it sideways, as long as nothing is in the way */
+uint8_t Ai_Placements(const TetrisGame *Game, AiMove *Moves)
+{
+	const Tetromino *Falling = &Game->Falling;
+	const BoardRow *Board = TE_BOARD(Game);
+	uint8_t Rotations, Orientation, Pos_x, Count = 0;
+
+	for (Rotations = 0, Orientation = Falling->Orientation; Rotations < TETROMINO_ORIENTATIONS; Rotations++) {
+		if (Te_DetectCollision(Board, Falling->Type, Orientation, Falling->Pos_x, Falling->Pos_y))
+			break;
+
+		/* To the right, towards column 0 */
+		for (Pos_x = Falling->Pos_x + 1; Pos_x-- > 0; Count++) {
+			if (Te_DetectCollision(Board, Falling->Type, Orientation, Pos_x, Falling->Pos_y))
+				break;
+			Moves[Count].Orientation = Orientation;
+			Moves[Count].Pos_x = Pos_x;
+		}
+
+		/* And to the left */
+		for (Pos_x = Falling->Pos_x + 1; !Te_DetectCollision(Board, Falling->Type, Orientation, Pos_x, Falling->Pos_y); Pos_x++, Count++) {
+			Moves[Count].Orientation = Orientation;
+			Moves[Count].Pos_x = Pos_x;
+		}
+
+		Orientation = (Orientation + 1) % TETROMINO_ORIENTATIONS;
+	}
+
+	return Count;
+}
+
+/* The first of equally rated placements wins */
+uint8_t Ai_FindMove(const TetrisGame *Game, const AiWeights *Weights, AiMove *Move)
+{
+	AiMove Moves[AI_PLACEMENTS];
+	AiProfile Before;
+	uint8_t Count, Index;
+	int32_t Rating, Best = AI_LOST;
+
+	Count = Ai_Placements(Game, Moves);
+	Profile(Game->Heights, &Before);
+
+	for (Index = 0; Index < Count; Index++) {
+		Rating = Rate(Game, &Before, Moves[Index].Orientation, Moves[Index].Pos_x, Weights);
+		if (!Index || (Rating > Best)) {
+			Best = Rating;
+			*Move = Moves[Index];
+		}
+	}
+
+	return Count != 0;
+}
+
+/* Same order as the placement was found in: Rotate first, then move */
+uint8_t Ai_Apply(TetrisGame *Game, const AiMove *Move)
+{
+	Tetromino *Falling = &Game->Falling;
+
+	while (Falling->Orientation != Move->Orientation)
+		if (!Te_Rotate(Game))
+			return 0;
+
+	while (Falling->Pos_x < Move->Pos_x)
+		if (!Te_MoveLeft(Game))
+			return 0;
+
+	while (Falling->Pos_x > Move->Pos_x)
+		if (!Te_MoveRight(Game))
+			return 0;
+
+	Te_HardDrop(Game);
+
+	return 1;
+}
@@ -0,0 +1,83 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ai.h: Autoplayer for the Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef AI_H
+#define AI_H
+
+#include <stdint.h>
+
+#include "te.h"
+
+/* Weights of the features a board is rated by. A placement is rated by the
+ * sum of each feature times its weight, the highest rating wins */
+typedef struct {
+	/* Sum of the heights of all columns */
+	int16_t Height;
+	/* Rows completed by the placement */
+	int16_t Lines;
+	/* Free squares with a locked square somewhere above them */
+	int16_t Holes;
+	/* Sum of the height differences of neighbouring columns */
+	int16_t Bumpiness;
+} AiWeights;
+
+/* Where to put the falling tetromino */
+typedef struct {
+	uint8_t Orientation;
+	uint8_t Pos_x;
+} AiMove;
+
+/* Upper limit of the number of placements of a tetromino */
+#define AI_PLACEMENTS			(TETROMINO_ORIENTATIONS * BOARD_COLUMNS)
+
+/* Rating of a placement that leaves squares above the board */
+#define AI_LOST				INT32_MIN
+
+/* Weights that play a decent game */
+extern const AiWeights Ai_DefaultWeights;
+
+/* Rate a board after a placement that completed the given number of rows */
+extern int32_t Ai_Evaluate(const BoardRow *Board, uint8_t Lines, const AiWeights *Weights);
+
+/* Get the placements of the falling tetromino. Returns their number */
+extern uint8_t Ai_Placements(const TetrisGame *Game, AiMove *Moves);
+
+/* Rate a placement of the falling tetromino the way Ai_FindMove does */
+extern int32_t Ai_Rate(const TetrisGame *Game, const AiMove *Move, const AiWeights *Weights);
+
+/* Find the best placement of the falling tetromino. Zero if it can not be
+ * placed anywhere */
+extern uint8_t Ai_FindMove(const TetrisGame *Game, const AiWeights *Weights, AiMove *Move);
+
+/* Rotate and move the falling tetromino to the placement and drop it there.
+ * Non zero if the placement could be reached */
+extern uint8_t Ai_Apply(TetrisGame *Game, const AiMove *Move);
+
+#endif /* AI_H */
@@ -28,7 +28,6 @@
  *
 */
 
-#include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -36,47 +35,35 @@
 
 #include "os.h"
 #include "ap.h"
+#include "lm.h"
+#include "rp.h"
+#include "vs.h"
+#include "sp.h"
+#include "bt.h"
+#include "vw.h"
 #include "PCD8544.h"
 
-/* Keeps count of completed rows i.e. the score. Only displayed via UART. You need
- * to run a terminal program connected to the microcontroller to see the values */
-static uint8_t Score;
-
-/* The dynamic object in this game. It is the falling tetromino that can be manipulated */
-static ActiveTetromino Falling;
-
-/* The Tetris board. Modeled as 16 rows (bytes) times 8 columns (bits) */
-static uint8_t Board[BOARD_ROWS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-
-/* All possible tetromino types in all possible orientations. Encoded as bitmaps. */
-static const uint8_t Tetrominoes[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][NR_BYTES_BITMAP] = {
-         {{0x00, 0x47}, {0x03, 0x22}, {0x00,0x71}, {0x01, 0x13}}
-        ,{{0x00, 0x63}, {0x01, 0x32}, {0x00,0x63}, {0x01, 0x32}}
-        ,{{0x00, 0x17}, {0x02, 0x23}, {0x00,0x74}, {0x03, 0x11}}
-        ,{{0x00, 0x36}, {0x02, 0x31}, {0x00,0x36}, {0x02, 0x31}}
-        ,{{0x00, 0x0F}, {0x11, 0x11}, {0x00,0x0F}, {0x11, 0x11}}
-        ,{{0x00, 0x33}, {0x00, 0x33}, {0x00,0x33}, {0x00, 0x33}}
-        ,{{0x00, 0x27}, {0x02, 0x32}, {0x00,0x72}, {0x01, 0x31}}
-};
+/* The state of the game: The board modeled as 16 rows (bytes) times 8
+ * columns (bits), the falling tetromino, the score, ...
+ * The score is only displayed via UART. You need to run a terminal program
+ * connected to the microcontroller to see the values */
+static TetrisGame Game;
 
-/* Depending on the tetromino type and orientation the max. x position varies to avoid
- * tetromino sticking out of the board area or performing "rotations" where not sufficient
- * space is available */
-static const uint8_t Max_Pos_x[TETROMINO_TYPES][TETROMINO_ORIENTATIONS] = {
-          {5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{4, 7, 4, 7}
-         ,{6, 6, 6, 6}
-         ,{5, 6, 5, 6}
-};
+/* Falling speed, in rows per tick of 4 ms. Armed is what the timer was
+ * armed for: The gravity, the part of a row fallen before and the ticks */
+static TeGravity Gravity = GRAVITY_DEFAULT;
+static TeGravity Armed = GRAVITY_DEFAULT;
+static uint16_t Fraction;
+static uint8_t Ticks;
 
 /* Statically allocate space for the stack of each task */
 static uint8_t TaskStackIdle[TASK_STACK_SIZE_IDLE];
 static uint8_t TaskStackModel[TASK_STACK_SIZE_MODEL];
 static uint8_t TaskStackView[TASK_STACK_SIZE_VIEW];
 static uint8_t TaskStackCtrl[TASK_STACK_SIZE_CTRL];
+#ifdef OS_TIMER_SERVICE
+static uint8_t TaskStackTimer[TASK_STACK_SIZE_TIMER];
+#endif
 
 /* Scheduling table. Set up the task descriptors. */
 static TaskDescriptor Tasks[] = {
@@ -85,7 +72,11 @@ static TaskDescriptor Tasks[] = {
 		,TASK_STATE_READY
 		,EVENT_NONE
 		,EVENT_NONE
+#ifdef DEMO_BOT
+		,RESOURCE_CONTROLS | RESOURCE_BOARD | RESOURCE_UART
+#else
 		,RESOURCE_NONE
+#endif
 		,TASK_PRIORITY_IDLE
 	}
 	,{
@@ -101,7 +92,7 @@ static TaskDescriptor Tasks[] = {
 		,TASK_STATE_READY
 		,EVENT_NONE
 		,EVENT_NONE
-		,RESOURCE_BOARD | RESOURCE_LCD_SCREEN
+		,RESOURCE_BOARD | RESOURCE_CONTROLS | RESOURCE_LCD_SCREEN | RESOURCE_UART
 		,TASK_PRIORITY_VIEW
 	}
 	,{
@@ -112,6 +103,16 @@ static TaskDescriptor Tasks[] = {
 		,RESOURCE_CONTROLS
 		,TASK_PRIORITY_CTRL
 	}
+#ifdef OS_TIMER_SERVICE
+	,{
+		&TaskStackTimer[TASK_STACK_SIZE_TIMER - 1 - SIZE_SAVED_CONTEXT]
+		,TASK_STATE_READY
+		,EVENT_NONE
+		,EVENT_NONE
+		,RESOURCE_NONE
+		,TASK_PRIORITY_TIMER
+	}
+#endif
 };
 
 #define NR_TASKS (sizeof(Tasks)/sizeof(TaskDescriptor))
@@ -125,152 +126,84 @@ static TimerDescriptor Timers[] = {
         }
 };
 
-/* Initiate a new falling tetromino */
-static void NewTetromino(void)
-{
-	/* "randomly" select the new tetromino type */
-	Falling.Type = rand() / (RAND_MAX / TETROMINO_TYPES + 1);
-	/* Defaults for each new tetromino */
-	Falling.Orientation = UP;
-	Falling.Speed = SPEED_DEFAULT;
-	Falling.Pos_x = POSITION_X_CENTER;
-	Falling.Pos_y = POSITION_Y_TOP;
-}
-
-/* Detect if the tetromino collides with any element of the board,
- * i.e. other tetrominoes that previously fell or the boards' limits */
-static uint8_t DetectCollision(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-	/* README.md describes the representation of a tetromino */
-        uint8_t Line0 = 0, Line1 = 0, Line2 = 0, Line3 = 0;
-        uint8_t Detected = 0;
-
-	/* A tetromino is represented as a 4x4 bitmap that has the bits set that represent
-	 * the tetromino. Detecting a collision resumes to checking if there is any bit
-	 * superposition between the tetromino's line and the line of the board.
-	 * Take into account that a tetromino falls line by line starting at 0 so only check
-	 * the lines that are on the boad.
-	 */
-        Line0 = Board[Pos_y] & ((Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x);
-        if (Pos_y > 0)
-                Line1 = Board[Pos_y - 1] & ((Tetrominoes[Type][Orientation][1] >> 4) << Pos_x);
-        if (Pos_y > 1)
-                Line2 = Board[Pos_y - 2] & ((Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x);
-        if (Pos_y > 2)
-                Line3 = Board[Pos_y - 3] & ((Tetrominoes[Type][Orientation][0] >> 4) << Pos_x);
-        if (Line0 || Line1 || Line2 || Line3) {
-                Detected = 1;
-	}
-	else if ((Pos_x > Max_Pos_x[Type][Orientation]) || (Pos_y > (POSITION_Y_BOTTOM - 1))) {
-                Detected = 1;
-	}
-
-        return Detected;
-}
-
-/* Place/drop a tetromino on the board */
-static void AddTetromino(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-	/* Take into account that a tetromino falls line by line starting at 0 so only add
-	 * the lines that should go to the boad according to the current y position of the
-	 * tetromino
-	 */
-        Board[Pos_y] |= (Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x;
-        if (Pos_y > 0)
-                Board[Pos_y - 1] |= (Tetrominoes[Type][Orientation][1] >> 4) << Pos_x;
-        if (Pos_y > 1)
-                Board[Pos_y - 2] |= (Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x;
-        if (Pos_y > 2)
-                Board[Pos_y - 3] |= (Tetrominoes[Type][Orientation][0] >> 4) << Pos_x;
-}
-
-/* Remove a tetromino from the board */
-static void RemoveTetromino(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-	/* Take into account that a tetromino falls line by line starting at 0 so only
-	 * remove the lines on the boad that are already visible according to the current
-	 * y position of the tetromino
-	 */
-        Board[Pos_y] &= ~((Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x);
-        if (Pos_y > 0)
-                Board[Pos_y - 1] &= ~((Tetrominoes[Type][Orientation][1] >> 4) << Pos_x);
-        if (Pos_y > 1)
-                Board[Pos_y - 2] &= ~((Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x);
-        if (Pos_y > 2)
-                Board[Pos_y - 3] &= ~((Tetrominoes[Type][Orientation][0] >> 4) << Pos_x);
-}
-
-/* Check for and remove completed rows, increment the score for each completed row found */
-static void CheckCompletedRows(void)
-{
-        uint8_t Row, RemainingRows;
-
-        for (Row = 0; Row < BOARD_ROWS; Row++) {
-                if (Board[Row] == ROW_COMPLETED) {
-			/* Yay! */
-                        Score++;
-
-			/* Flash green LED for successful completion of a row */
-			Os_LEDGreenOn();
-
-			/* And report via UART */
-                        printf("Score: %d\n", Score);
-
-			/* Move the remaining rows towards the bottom */
-                        for (RemainingRows = Row; RemainingRows > 0; RemainingRows--) {
-                                Board[RemainingRows] = Board[RemainingRows - 1];
-                                if (Board[RemainingRows - 1] == ROW_EMPTY)
-                                        break;
-                        }
-                        Board[0] = ROW_EMPTY;
-                }
-        }
-}
+#define NR_TIMERS (sizeof(Timers)/sizeof(TimerDescriptor))
 
 /* This task is responsible for translating the Tetris board to a 2D image and sending it to
  * the LCD display. It is triggered by the DRAW event */
 static void TaskView(void)
 {
-	uint8_t Row, Col, Width, Height;
+	/* The board as it is to be displayed: The locked squares plus the falling tetromino */
+	BoardRow Frame[PLAYFIELD_ROWS];
+	BoardRow *FrameBoard = PLAYFIELD_BOARD(Frame);
+	/* The ghost of the falling tetromino, by itself */
+	BoardRow GhostFrame[PLAYFIELD_ROWS];
+	BoardRow *GhostBoard = PLAYFIELD_BOARD(GhostFrame);
 
 	for (;;) {
 		Os_WaitEvents(EVENT_DRAW);
 		Os_ClearEvents(EVENT_DRAW);
 
+		/* Do not modify the board or the falling tetromino while the frame is
+		 * constructed from them */
+		Os_GetResources(RESOURCE_BOARD | RESOURCE_CONTROLS);
+
+		/* The frame built now reflects all inputs the model has applied */
+		Lm_Forward(LM_STAGE_MODEL);
+
+		memcpy(Frame, Game.Playfield, sizeof(Frame));
+		Te_AddTetromino(FrameBoard, Game.Falling.Type, Game.Falling.Orientation, Game.Falling.Pos_x, Game.Falling.Pos_y);
+
+		memset(GhostFrame, 0, sizeof(GhostFrame));
+		Te_AddTetromino(GhostBoard, Game.Ghost.Type, Game.Ghost.Orientation, Game.Ghost.Pos_x, Game.Ghost.Pos_y);
+
+		Os_ReleaseResources(RESOURCE_CONTROLS | RESOURCE_BOARD);
+
 		/* Clear the screen */
 		LCDclear();
 
 		/* Draw a rectangle around the playing area */
 		LCDdrawrect(2, 2, LCD_WIDTH - 4 , LCD_HEIGHT - 7, COLOR_BLACK);
 
-		/* Do not modify the board while the display buffer is constructed from it */
-		Os_GetResources(RESOURCE_BOARD);
-
-		/* Scan the board and translate it to graphic objects to be displayed.
-		 * Both the board and the tetrominos are made up of "squares" that are
-		 * drawn as N x N squares on the display */
-		for (Row = 0; Row < BOARD_ROWS; Row++) {
-			for (Col = 0;  Col  < BOARD_COLUMNS; Col++) {
-				if (Board[Row] & (1 << Col)) {
-					for (Width = 0; Width < SQUARE_SIDE_LENGTH; Width++) {
-						for (Height = 0; Height < SQUARE_SIDE_LENGTH; Height++) {
-							LCDsetPixel(DISPLAY_OFFSET_X + (Row * SQUARE_SIDE_LENGTH) + Width
-								    ,DISPLAY_OFFSET_Y + (Col * SQUARE_SIDE_LENGTH) + Height
-								    ,COLOR_BLACK
-								    );
-						}
-					}
-				}
-			}
-		}
-
-		Os_ReleaseResources(RESOURCE_BOARD);
+		/* Scan the frame and translate it to graphic objects to be displayed.
+		 * The ghost squares not covered by the falling tetromino are drawn
+		 * with a checkered pattern */
+		Vw_Draw(FrameBoard, GhostBoard, pcd8544_buffer);
 
 		/* Send the display buffer to the LCD display */
 		LCDdisplay();
+
+		/* Input to display latency is known now */
+		Os_GetResources(RESOURCE_UART);
+		Lm_FrameDone();
+		Os_ReleaseResources(RESOURCE_UART);
 	}
 }
 
+#ifdef VERSUS
+/* Put the garbage rows received from the opponent on the board until
+ * there are no more or the game has ended. Returns the TE_ flags */
+static uint8_t AddGarbage(void)
+{
+	uint8_t Result = 0, Rows, Hole;
+
+	do {
+		/* The UART's receive interrupt queues them */
+		Os_EnterCritical();
+		Rows = Vs_TakeGarbage(&Hole);
+		Os_ExitCritical();
+
+		if (!Rows)
+			break;
+
+		Rp_Garbage(Rows, Hole);
+		Sp_Garbage(Rows, Hole);
+		Result |= Te_AddGarbage(&Game, Rows, Hole);
+	} while (!(Result & TE_GAME_OVER));
+
+	return Result;
+}
+#endif
+
 /* The task handles the "model" of the game. It manages the Tetris board,
  * checks for "game over" situtations, triggers updating the display,
  * keeps count of completed rows and initializes new falling tetrominoes
@@ -278,12 +211,20 @@ static void TaskView(void)
  */
 static void TaskModel(void)
 {
+	uint8_t Result;
+	uint8_t Rows;
+	uint8_t Event;
+	uint8_t Won;
+	uint16_t Seed;
+	Tetromino Locked;
+
 	for (;;) {
 
 		/* Changes happen either because of the timer that drives the
-		 * falling of the tetromino OR because of user interaction.
+		 * falling of the tetromino OR because of user interaction OR,
+		 * in versus mode, because of the opponent.
 		 * Wait for one of those events before doing anything */
-		Os_WaitEvents(EVENT_TIMER | EVENT_UPDATE);
+		Os_WaitEvents(EVENT_TIMER | EVENT_UPDATE | EVENT_LOCK | EVENT_LINK);
 
 		/* Put the LEDs out in case they were on after a game restart
 		 * of completed line */
@@ -294,54 +235,132 @@ static void TaskModel(void)
 		 * them */
 		Os_GetResources(RESOURCE_CONTROLS | RESOURCE_BOARD);
 
+		Result = 0;
+		Won = 0;
+
 		/* User controls triggered this execution round */
 		if (Os_GetEvents() & EVENT_UPDATE)
 			Os_ClearEvents(EVENT_UPDATE);
 
-		/* Remove the tetromino as it was before from the board */
-                if (Falling.Pos_y < (POSITION_Y_BOTTOM - 1))
-                        RemoveTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* Whatever the controller accepted is applied to the board now */
+		Lm_Forward(LM_STAGE_CTRL);
+
+		/* If the timer triggered this task execution round advance the
+		 * falling tetromino on the y position by the rows due since or
+		 * lock it on the board when it can not fall any further.
+		 * After a hard drop the tetromino already rests on the board
+		 * and gets locked right away */
+		Event = Os_GetEvents() & (EVENT_TIMER | EVENT_LOCK);
+		if (Event) {
+			Os_ClearEvents(EVENT_TIMER | EVENT_LOCK);
+
+			/* A tetromino only locks where it rests */
+			Locked = Game.Falling;
+
+			if (Event & EVENT_LOCK) {
+				Rp_Record(RP_STEP);
+				Result = Te_Step(&Game);
+			} else {
+				Rows = Te_RowsDue(&Fraction, Armed, Ticks);
+				if (Rows) {
+					Rp_Fall(Rows);
+					Result = Te_Fall(&Game, Rows);
+				}
+			}
 
-		/* If the timer triggered this task execution round update the
-		 * y position of the falling tetromino */
-		if (Os_GetEvents() & EVENT_TIMER) {
-	                Falling.Pos_y++;
-			Os_ClearEvents(EVENT_TIMER);
+			/* Each new tetromino defaults to "normal" falling speed
+			 * and starts at the top of its row */
+			if (Result & TE_LOCKED) {
+				Gravity = GRAVITY_DEFAULT;
+				Fraction = 0;
+				Sp_Lock(&Locked, Game.Score);
+			}
 		}
 
-		/* Check for a collision with the new Y position */
-                if (DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y)) {
+#ifdef VERSUS
+		/* The garbage rows the opponent sent come in between two
+		 * tetrominoes */
+		if ((Result & (TE_LOCKED | TE_GAME_OVER)) == TE_LOCKED)
+			Result |= AddGarbage();
+
+		/* The opponent's game has ended */
+		if (Os_GetEvents() & EVENT_LINK) {
+			Os_ClearEvents(EVENT_LINK);
+			Os_EnterCritical();
+			Won = Vs_TakeWon();
+			Os_ExitCritical();
+		}
+#endif
 
-			/* Put the previously removed tetromino back to be able to
-			 * check for completed rows */
-                        AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y - 1);
+		/* Flash green LED for successful completion of a row */
+		if (Result & TE_CLEARED)
+			Os_LEDGreenOn();
 
-			/* See if a row was completed and the score needs to
-			 * be updated and the green LED lit */
-                        CheckCompletedRows();
+		/* If there is no room for the new tetromino the game has
+		 * ended. So has a game won against the opponent */
+		if (Won || (Result & TE_GAME_OVER)) {
+			if (Won) {
+				Os_LEDGreenOn();
+				printf("You win!\nStarting new game...\n");
+			} else {
+				Os_LEDRedOn();
+				printf("Game Over!\nStarting new game...\n");
+			}
 
-                        /* Initialize a new tetromino */
-			NewTetromino();
+			/* How long the game lasted is random enough to seed
+			 * the new one with */
+			Seed = Os_GetTime();
+			Rp_NewGame(Seed, Game.Score);
+			Te_NewGame(&Game, Seed);
+			Sp_Over();
+			printf("Seed: %u\n", Game.Bag.Seed);
+		}
 
-                        /* If a collision on the board at line 0 happens with the newly
-			 * dropping tetromino, the game has ended */
-                        if (DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y)) {
-				Os_LEDRedOn();
-                                printf("Game Over!\nStarting new game...\n");
-                                memset(Board, 0x00, sizeof(Board));
-                                Score = 0;
-                        }
-                }
+		/* Wherever the controller moved the tetromino to */
+		Sp_Falling(&Game.Falling);
 
-		/* Add the updated tetromino to the board */
-		AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* The controller changes the gravity with the resource held */
+		Armed = Gravity;
+		Ticks = Te_TicksToRow(Fraction, Armed);
 
 		Os_ReleaseResources(RESOURCE_BOARD | RESOURCE_CONTROLS);
 
-		/* Schedule timer event to happen according to the selected
-		 * falling speed in order to update the position of the falling
-		 * tetromino */
-		Os_SetTimer(TIMER_ID_GAME, Falling.Speed);
+		/* Report completed rows via UART, once per locked tetromino */
+		if (Result & TE_CLEARED)
+			printf("Score: %u\n", Game.Score);
+
+#ifdef VERSUS
+		/* Tell the opponent about the cleared rows, which are worth
+		 * garbage rows with a gap somewhere, and about the end of the
+		 * game. The frames go out between the lines of text */
+		Os_GetResources(RESOURCE_UART);
+		if (Result & TE_CLEARED)
+			Vs_Cleared(Game.Score, Result & TE_CLEARED, Os_GetTime() % BOARD_COLUMNS);
+		if ((Result & TE_GAME_OVER) && !Won)
+			Vs_Lost();
+		Os_ReleaseResources(RESOURCE_UART);
+#endif
+
+#ifdef SPECTATE
+		/* Pass the changes on to the viewer, and the whole board now
+		 * and then */
+		Os_GetResources(RESOURCE_UART);
+		Sp_Send(&Game, Os_GetTime());
+		Os_ReleaseResources(RESOURCE_UART);
+#endif
+
+#ifdef REPLAY_RECORD
+		/* Send what the engine was asked to do this round, in a line of
+		 * its own */
+		Os_GetResources(RESOURCE_UART);
+		Rp_Send();
+		Os_ReleaseResources(RESOURCE_UART);
+#endif
+
+		/* Schedule timer event to happen when the next row is due at
+		 * the selected falling speed in order to update the position
+		 * of the falling tetromino */
+		Os_SetTimer(TIMER_ID_GAME, Ticks);
 
 		/* Trigger the view tasks to draw the updated board to the LCD
 		 * display */
@@ -356,6 +375,7 @@ static void TaskCtrl(void)
 {
 	uint8_t Event = 0;
 	uint8_t Updated = 0;
+	uint8_t Dropped = 0;
 
 	for (;;) {
 
@@ -368,70 +388,65 @@ static void TaskCtrl(void)
 
 		Event = Os_GetEvents();
 
-		/* Block tasks that compete for the "control" resource */
-		Os_GetResources(RESOURCE_CONTROLS);
+		/* Take over the time stamp of the inputs about to be handled */
+		Lm_Forward(LM_STAGE_INPUT);
 
-		/* Temporarily remove current active tetromino from the board to avoid detecting false
-		 * collisions with itself */
-                RemoveTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* Block tasks that compete for the "control" resource. The model
+		 * holds it as well while it changes the board, so the board can
+		 * be checked against without further ado */
+		Os_GetResources(RESOURCE_CONTROLS);
 
 		Updated = 0;
+		Dropped = 0;
 
-		/* Event from the potentiometer to move the falling tetromino left */
+		/* Event from the potentiometer to move the falling tetromino left.
+		 * The engine validates the motion request. No collision must occur
+		 * by the requested motion. This includes the tetromino sticking out
+		 * of the board */
 		if (Event & EVENT_LEFT) {
-			/* Validate the motion request. X must be within allowed bounds
-			 * for tetromino type and orientation */
-			if (Falling.Pos_x < Max_Pos_x[Falling.Type][Falling.Orientation]) {
-				/* And no collision must occur by the requested motion */
-				if (!DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x + 1, Falling.Pos_y)) {
-					Falling.Pos_x++;
-					Updated = 1;
-				}
-			}
+			Rp_Record(RP_LEFT);
+			if (Te_MoveLeft(&Game))
+				Updated = 1;
 			Os_ClearEvents(EVENT_LEFT);
 		}
 
 		/* Event from the potentiometer to move the falling tetromino right */
 		if (Event & EVENT_RIGHT) {
-			if (Falling.Pos_x > 0) {
-				if (!DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x - 1, Falling.Pos_y)) {
-					Falling.Pos_x--;
-					Updated = 1;
-				}
-			}
+			Rp_Record(RP_RIGHT);
+			if (Te_MoveRight(&Game))
+				Updated = 1;
 			Os_ClearEvents(EVENT_RIGHT);
 		}
 
 		/* Event from the 'Rotate' button to change the orientation of the falling tetromino */
 		if (Event & EVENT_ROTATE) {
-			uint8_t Orientation = Falling.Orientation;
-			Orientation++;
-
-			/* Orientation is cycled between the 4 allowed values */
-			Orientation %= TETROMINO_ORIENTATIONS;
-
-			if (!DetectCollision(Falling.Type, Orientation, Falling.Pos_x, Falling.Pos_y)) {
-				Falling.Orientation = Orientation;
+			Rp_Record(RP_ROTATE);
+			if (Te_Rotate(&Game))
 				Updated = 1;
-			}
 			Os_ClearEvents(EVENT_ROTATE);
 		}
 
 		/* Event from the 'Drop' button to change the falling speed of te tetromino */
 		if (Event & EVENT_DROP) {
 			/* Each new tetromino defaults to "normal" falling speed */
-			if (Falling.Speed == SPEED_DEFAULT) {
+			if (Gravity < GRAVITY_FAST) {
 				/* With the first push set the "fast" falling speed. */
-				Falling.Speed = SPEED_FAST;
-			} else if (Falling.Speed == SPEED_FAST) {
-				/* With the second push just drop the tetromino */
-				Falling.Speed = SPEED_ULTIMATE;
+				Gravity = GRAVITY_FAST;
+			} else {
+				/* With the second push just drop the tetromino. Instead of
+				 * having it fall row by row, each row being a model round and
+				 * a frame, put it right where it lands */
+				Rp_Record(RP_DROP);
+				Te_HardDrop(&Game);
+				Dropped = 1;
 			}
 			Os_ClearEvents(EVENT_DROP);
 		}
 
-		/* Put back the remporarily removed tetromino */
-                AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* Have the model lock a dropped tetromino. Signalled while still holding
+		 * the resource so the model can not advance a new tetromino in between */
+		if (Dropped)
+			Os_SetEvent(TASK_ID_MODEL, EVENT_LOCK);
 
 		Os_ReleaseResources(RESOURCE_CONTROLS);
 
@@ -439,14 +454,19 @@ static void TaskCtrl(void)
 		 * update the board and subsequently the dispay */
 		if (Updated)
 			Os_SetEvent(TASK_ID_MODEL, EVENT_UPDATE);
+		else if (!Dropped)
+			Lm_Discard(LM_STAGE_CTRL);
 	}
 }
 
 /* This task runs when no other task is active.
- * It could be used for example to measure how much CPU time resources are left on the system */
+ * With the demo bot it plans and plays the placement of each new tetromino,
+ * the time left over is slept away */
 static void TaskIdle(void)
 {
 	for (;;) {
+		Bt_Play(&Game);
+
 		/* Turn off the processor core, the rest remains active */
 		set_sleep_mode(SLEEP_MODE_IDLE);
 		sleep_mode();
@@ -463,6 +483,9 @@ static void InitializeTaskStacks(void)
         memset(TaskStackModel, 0, sizeof(TaskStackModel));
         memset(TaskStackView, 0, sizeof(TaskStackView));
         memset(TaskStackCtrl, 0, sizeof(TaskStackCtrl));
+#ifdef OS_TIMER_SERVICE
+        memset(TaskStackTimer, 0, sizeof(TaskStackTimer));
+#endif
 
 	/* Set the address of the idle task's function.
 	 * This will be the execution entry point for this task as soon as it runs for the
@@ -481,6 +504,12 @@ static void InitializeTaskStacks(void)
 	/* Set the address of the controller task's function */
 	TaskStackCtrl[TASK_STACK_SIZE_CTRL - 1] = (uint8_t)((uint16_t)TaskCtrl);
 	TaskStackCtrl[TASK_STACK_SIZE_CTRL - 2] = (uint8_t)((uint16_t)TaskCtrl >> 8);
+
+#ifdef OS_TIMER_SERVICE
+	/* Set the address of the OS provided timer service task's function */
+	TaskStackTimer[TASK_STACK_SIZE_TIMER - 1] = (uint8_t)((uint16_t)Os_TaskTimerService);
+	TaskStackTimer[TASK_STACK_SIZE_TIMER - 2] = (uint8_t)((uint16_t)Os_TaskTimerService >> 8);
+#endif
 }
 
 /* Helper function for directing the stdout file descriptor to the UART
@@ -503,8 +532,6 @@ int main(void)
 	/* Useful to detect involuntary restarts */
 	printf ("SYSTEM STARTUP\n");
 
-        Score = 0;
-
 	/* Disable all interrupts */
         Os_DisableAllInterrupts();
 
@@ -518,17 +545,15 @@ int main(void)
 	/* Turn on the LCD's backlight LEDs */
 	Uc_LCDBacklightOn();
 
-	/* Initialize the Tetris board */
-        memset(Board, 0, sizeof(Board));
-
-	/* Initialize a new tetromino to be dropped */
-	NewTetromino();
+	/* Initialize the Tetris board and a new tetromino to be dropped */
+	Rp_NewGame(TETROMINO_SEED, 0);
+	Te_NewGame(&Game, TETROMINO_SEED);
 
 	/* Initialize the stacks of the tasks */
 	InitializeTaskStacks();
 
         /* Start the operating system */
-        Os_StartOS(Tasks, NR_TASKS, Timers);
+        Os_StartOS(Tasks, NR_TASKS, Timers, NR_TIMERS, TASK_ID_TIMER);
 
 	/* This should never be reached */
 	Os_ShutdownOS();
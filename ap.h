@@ -33,6 +33,8 @@
 
 #include <stdint.h>
 
+#include "te.h"
+
 /*******************************************
  * LCD hardware related configuration items
  *******************************************/
@@ -46,6 +48,10 @@
 #define LCD_WIDTH			84
 #define LCD_HEIGHT			48
 
+/* Rows of 8 pixels, each column of such a row being one byte of the
+ * display buffer */
+#define LCD_PAGES			(LCD_HEIGHT / 8)
+
 /* Left and right offsets to have the action happen in the middle of
  * the display */
 #define DISPLAY_OFFSET_X		2
@@ -55,72 +61,33 @@
  * Tetris application related configuration items
  *************************************************/
 
-/* Tetris game board. I selected 8 x 16 instead of the more common 10 x 20.
- * Rationale: Be able to easily represent the board as a matrix of bits
- * that nicely fits on byte boundaries. README.md has the details
- */
-#define BOARD_COLUMNS			8
-#define BOARD_ROWS			16
-
-/* There are seven types of tetrominones. See README.md for details */
-#define TETROMINO_TYPES			7
-
-/* Orientations of a tetromino. The four cardinal directions */
-#define TETROMINO_ORIENTATIONS		4
-
 /* Normal falling speed: One second between advancements on the y coordinate */
 #define SPEED_DEFAULT			250
 
 /* Accelerated falling speed. After one press on the "drop" button. */
 #define SPEED_FAST			50
 
-/* Drop the tetromino with the next timer tick */
-#define SPEED_ULTIMATE			1
-
-/* The width of the square in which a tetromino fits */
-#define TEROMINO_WIDTH			4
+/* The same as gravity, in rows per tick. Override GRAVITY_DEFAULT via
+ * FEATURES for other levels, TE_GRAVITY(20, 1) for "20G" */
+#ifndef GRAVITY_DEFAULT
+#define GRAVITY_DEFAULT			TE_GRAVITY(1, SPEED_DEFAULT)
+#endif
+#define GRAVITY_FAST			TE_GRAVITY(1, SPEED_FAST)
 
-/* Board X center */
-#define POSITION_X_CENTER		((BOARD_COLUMNS - TEROMINO_WIDTH) / 2)
+/* The squares of the board's columns must fit on the display */
+#if DISPLAY_OFFSET_Y + BOARD_COLUMNS * (LCD_WIDTH / BOARD_ROWS) > LCD_HEIGHT
+#error "The board does not fit on the display"
+#endif
 
-/* Board Y positions min/max */
-#define POSITION_Y_TOP			0
-#define POSITION_Y_BOTTOM		BOARD_ROWS
+/* Seed for the tetromino types of the first game after reset. The
+ * following games are seeded from the time the previous one ended */
+#ifndef TETROMINO_SEED
+#define TETROMINO_SEED			0xACE1
+#endif
 
 /* Number of pixels that make up the side length of a square */
 #define SQUARE_SIDE_LENGTH		(LCD_WIDTH / BOARD_ROWS)
 
-/* Number of bytes needed for the bit map representing a tetromino.
- * See README.md for details */
-#define NR_BYTES_BITMAP			2
-
-/* A completed row - all squares (bits) are occupied */
-#define ROW_COMPLETED			0xFF
-/* And none are occupied in an empty row */
-#define ROW_EMPTY			0x00
-
-/* Possible tetromino orientations in space */
-enum {
-         UP
-        ,RIGHT
-        ,DOWN
-        ,LEFT
-};
-
-/* Describes the active (falling) tetromino */
-typedef struct {
-	/* Type of the falling tetromino (there are 7 types) */
-        volatile uint8_t Type;
-	/* Current orientation of the falling tetromino */
-        volatile uint8_t Orientation;
-	/* Falling speed. More precisely the time between
-	 * an advancement on the y-position, in units of 4 ms */
-        volatile uint8_t Speed;
-	/* Location on the baord of the falling tetromino */
-        volatile uint8_t Pos_x;
-        volatile uint8_t Pos_y;
-} ActiveTetromino;
-
 /***********************************************
  * Operating system related configuration items
  **********************************************/
@@ -131,6 +98,7 @@ typedef struct {
 #define TASK_ID_MODEL           	1
 #define TASK_ID_VIEW            	2
 #define TASK_ID_CTRL            	3
+#define TASK_ID_TIMER            	4
 
 /* Size of the stack for each of the used tasks.
  * Tricky to get the value right. Try using canaries at the end of the stack
@@ -141,16 +109,40 @@ typedef struct {
  * looking new code to a task try increasing this value and see if the problem
  * goes away.
  */
+#ifdef DEMO_BOT
+/* The bot searches in the idle task */
+#define TASK_STACK_SIZE_IDLE            (TASK_STACK_SIZE_MIN + 256)
+#else
 #define TASK_STACK_SIZE_IDLE            (TASK_STACK_SIZE_MIN + 32)
-#define TASK_STACK_SIZE_VIEW		(TASK_STACK_SIZE_MIN + 64)
-#define TASK_STACK_SIZE_MODEL		(TASK_STACK_SIZE_MIN + 128)
+#endif
+#define TASK_STACK_SIZE_VIEW		(TASK_STACK_SIZE_MIN + 88 + 2 * PLAYFIELD_ROWS * sizeof(BoardRow))
+#ifdef VERSUS
+/* Frames to the opponent are put together on the stack */
+#define TASK_STACK_SIZE_VERSUS		24
+#else
+#define TASK_STACK_SIZE_VERSUS		0
+#endif
+#ifdef SPECTATE
+/* A frame of the stream and the message it is made of */
+#define TASK_STACK_SIZE_SPECTATE	56
+#else
+#define TASK_STACK_SIZE_SPECTATE	0
+#endif
+#ifdef REPLAY_RECORD
+/* The records are copied out of the buffer for sending */
+#define TASK_STACK_SIZE_MODEL		(TASK_STACK_SIZE_MIN + 128 + 48 + TASK_STACK_SIZE_VERSUS + TASK_STACK_SIZE_SPECTATE)
+#else
+#define TASK_STACK_SIZE_MODEL		(TASK_STACK_SIZE_MIN + 128 + TASK_STACK_SIZE_VERSUS + TASK_STACK_SIZE_SPECTATE)
+#endif
 #define TASK_STACK_SIZE_CTRL		(TASK_STACK_SIZE_MIN + 128)
+#define TASK_STACK_SIZE_TIMER		(TASK_STACK_SIZE_MIN + 32)
 
 /* Priorities of the used tasks. Must be unique */
 #define TASK_PRIORITY_IDLE              0
 #define TASK_PRIORITY_MODEL             3
 #define TASK_PRIORITY_VIEW              2
 #define TASK_PRIORITY_CTRL              1
+#define TASK_PRIORITY_TIMER             4
 
 /* Identifiers of the used timer */
 #define TIMER_ID_GAME                   0
@@ -172,6 +164,10 @@ typedef struct {
 #define EVENT_RIGHT                     0x10
 #define EVENT_ROTATE                    0x20
 #define EVENT_DROP                      0x40
+#define EVENT_LOCK                      0x80
+
+/* Events of different tasks may share bits */
+#define EVENT_LINK                      0x04
 
 #endif /* AP_H */
 
@@ -0,0 +1,66 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * bench.c: Cycle benchmark of the Tetris engine kernel. Uses the AVR simulator.
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "kb.h"
+
+/* Helper function for directing the stdout file descriptor to the UART.
+ * The port is redirected by the AVR simulator */
+static int SendChar(char c, FILE *stream)
+{
+	(void)stream;
+
+	while (bit_is_clear(UCSR0A, UDRE0))
+		;
+	UDR0 = c;
+
+	return 0;
+}
+
+int main(void)
+{
+	FILE UartDebug = FDEV_SETUP_STREAM(SendChar, NULL, _FDEV_SETUP_WRITE);
+
+	stdout = &UartDebug;
+
+	/* Timer1: Normal mode, no prescaler. Its overflow is the only
+	 * interrupt, it widens the count of cycles for the long calls */
+	TCCR1A = 0x00;
+	TCCR1B = 0x01;
+	TIMSK1 = _BV(TOIE1);
+	sei();
+
+	Kb_Run();
+
+	return 0;
+}
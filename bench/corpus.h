@@ -0,0 +1,67 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * corpus.h: The boards the benchmarks run against
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdint.h>
+
+/* Rows of each board. They go into the bottom rows of the board */
+#define CORPUS_ROWS			16
+
+/* The boards: Empty, partially filled so that collisions occur for some
+ * positions and not for others, and stacked up almost to the top with holes.
+ * None of the rows is completed */
+#define CORPUS_EMPTY			0
+#define CORPUS_PARTIAL			1
+#define CORPUS_TALL			2
+#define CORPORA				3
+
+static const char *const CorpusNames[CORPORA] = {
+	 "empty"
+	,"partial"
+	,"tall"
+};
+
+static const uint8_t Corpora[CORPORA][CORPUS_ROWS] = {
+	{
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	}
+	,{
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x10, 0x18, 0x38, 0x3C, 0x7D, 0x7D, 0xEF, 0xF7
+	}
+	,{
+		0x00, 0x00, 0x08, 0x18, 0x1C, 0x3C, 0x3E, 0x7E,
+		0x7B, 0xBE, 0xFB, 0xDF, 0xF7, 0xEF, 0x7F, 0xFE
+	}
+};
+
+#endif /* CORPUS_H */
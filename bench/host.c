@@ -0,0 +1,451 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * host.c: Benchmark of the Tetris engine on the build machine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "te.h"
+#include "ai.h"
+#include "ws.h"
+#include "ev.h"
+#include "tt.h"
+#include "ps.h"
+#include "mg.h"
+#include "corpus.h"
+
+/* Each kernel is run over all positions this many times */
+#define ROUNDS				2000
+
+/* Number of game steps played */
+#define STEPS				2000000UL
+
+/* Most boards rated in one batch: Every tetromino put everywhere */
+#define CANDIDATES			(TETROMINO_TYPES * TETROMINO_ORIENTATIONS * POSITIONS_X)
+
+/* Tetrominoes the parallel search looks ahead and places per run */
+#define LOOKAHEAD_DEPTH			3
+#define LOOKAHEAD_MOVES			40
+
+/* Most workers the parallel search is run with */
+#define WORKERS_MAX			8
+
+/* Games stepped in lockstep and the steps each of them takes */
+#define LOCKSTEP_GAMES			1024
+#define LOCKSTEP_STEPS			2000
+
+/* Size of the transposition table. Small enough for the replacement
+ * policies to make a difference */
+#define TABLE_BYTES			(256UL * 1024)
+
+static BoardRow Playfield[PLAYFIELD_ROWS];
+
+/* Keeps the compiler from optimizing the calls away */
+static volatile BoardRow Sink;
+
+static double Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return Ts.tv_sec * 1e9 + Ts.tv_nsec;
+}
+
+static void Report(const char *Name, double Start, unsigned long Calls)
+{
+	printf("%-20s %8.2f ns/op (%lu calls)\n", Name, (Now() - Start) / Calls, Calls);
+}
+
+/* Play with random inputs. Lots of locking, clearing and game overs */
+static void Play(void)
+{
+	TetrisGame Game;
+	unsigned long Step;
+	double Start;
+
+	srand(1);
+	Te_NewGame(&Game, 1);
+
+	Start = Now();
+	for (Step = 0; Step < STEPS; Step++) {
+		switch (rand() % 8) {
+		case 0:
+			Te_MoveLeft(&Game);
+			break;
+		case 1:
+			Te_MoveRight(&Game);
+			break;
+		case 2:
+			Te_Rotate(&Game);
+			break;
+		case 3:
+			Te_HardDrop(&Game);
+			break;
+		default:
+			break;
+		}
+		if (Te_Step(&Game) & TE_GAME_OVER)
+			Te_NewGame(&Game, (uint16_t)Step);
+	}
+	Report("Game step", Start, STEPS);
+}
+
+/* Step many games with random inputs, one at a time with Te_Step and all
+ * together with Mg_Step. Non zero if the games do not come out the same */
+static int Lockstep(void)
+{
+	static TetrisGame Games[LOCKSTEP_GAMES];
+	static uint8_t Actions[LOCKSTEP_STEPS][LOCKSTEP_GAMES];
+	static uint8_t Results[LOCKSTEP_GAMES], Expected[LOCKSTEP_GAMES];
+	static uint32_t Boards[LOCKSTEP_GAMES * BOARD_ROWS];
+	static uint8_t Falling[LOCKSTEP_GAMES * 4];
+	static uint16_t Scores[LOCKSTEP_GAMES];
+	MgGames *Lockstep;
+	TetrisGame *Game;
+	unsigned long Step, Index;
+	unsigned Differ = 0;
+	uint8_t Row;
+	double Start, Single;
+
+	Lockstep = Mg_Create(LOCKSTEP_GAMES, NULL);
+	if (!Lockstep) {
+		fprintf(stderr, "could not create the games\n");
+		return 1;
+	}
+
+	srand(1);
+	for (Step = 0; Step < LOCKSTEP_STEPS; Step++)
+		for (Index = 0; Index < LOCKSTEP_GAMES; Index++)
+			Actions[Step][Index] = rand() % 8 > MG_DROP ? MG_NONE : rand() % 8;
+
+	for (Index = 0; Index < LOCKSTEP_GAMES; Index++)
+		Te_NewGame(&Games[Index], (uint16_t)Index);
+
+	/* Games are started anew after the step that ended them */
+	Start = Now();
+	for (Step = 0; Step < LOCKSTEP_STEPS; Step++)
+		for (Index = 0; Index < LOCKSTEP_GAMES; Index++) {
+			Game = &Games[Index];
+			switch (Actions[Step][Index]) {
+			case MG_LEFT:
+				Te_MoveLeft(Game);
+				break;
+			case MG_RIGHT:
+				Te_MoveRight(Game);
+				break;
+			case MG_ROTATE:
+				Te_Rotate(Game);
+				break;
+			case MG_DROP:
+				Te_HardDrop(Game);
+				break;
+			default:
+				break;
+			}
+			if (Te_Step(Game) & TE_GAME_OVER)
+				Te_NewGame(Game, (uint16_t)(Step + Index));
+		}
+	Single = Now() - Start;
+	Report("Te_Step per game", Start, LOCKSTEP_STEPS * LOCKSTEP_GAMES);
+
+	for (Index = 0; Index < LOCKSTEP_GAMES; Index++)
+		Te_NewGame(&Games[Index], (uint16_t)Index);
+
+	/* Again, each step checked against the engine */
+	for (Step = 0; Step < LOCKSTEP_STEPS; Step++) {
+		for (Index = 0; Index < LOCKSTEP_GAMES; Index++) {
+			Game = &Games[Index];
+			switch (Actions[Step][Index]) {
+			case MG_LEFT:
+				Expected[Index] = Te_MoveLeft(Game) ? MG_MOVED : 0;
+				break;
+			case MG_RIGHT:
+				Expected[Index] = Te_MoveRight(Game) ? MG_MOVED : 0;
+				break;
+			case MG_ROTATE:
+				Expected[Index] = Te_Rotate(Game) ? MG_MOVED : 0;
+				break;
+			case MG_DROP:
+				Te_HardDrop(Game);
+				Expected[Index] = MG_MOVED;
+				break;
+			default:
+				Expected[Index] = 0;
+				break;
+			}
+			Expected[Index] |= Te_Step(Game);
+		}
+
+		Mg_Step(Lockstep, Actions[Step], Results);
+		Mg_Observe(Lockstep, Boards, Falling, Scores);
+
+		for (Index = 0; Index < LOCKSTEP_GAMES; Index++) {
+			Game = &Games[Index];
+			Differ |= (Results[Index] != Expected[Index])
+				| (Falling[Index * 4] != Game->Falling.Type)
+				| (Falling[Index * 4 + 1] != Game->Falling.Orientation)
+				| (Falling[Index * 4 + 2] != Game->Falling.Pos_x)
+				| (Falling[Index * 4 + 3] != Game->Falling.Pos_y)
+				| (Scores[Index] != Game->Score);
+			for (Row = 0; Row < BOARD_ROWS; Row++)
+				Differ |= Boards[Index * BOARD_ROWS + Row] != TE_BOARD(Game)[Row];
+
+			if (Results[Index] & MG_GAME_OVER) {
+				Te_NewGame(Game, (uint16_t)(Step + Index));
+				Mg_NewGame(Lockstep, Index, (uint16_t)(Step + Index));
+			}
+		}
+	}
+
+	for (Index = 0; Index < LOCKSTEP_GAMES; Index++)
+		Mg_NewGame(Lockstep, Index, (uint16_t)Index);
+
+	Start = Now();
+	for (Step = 0; Step < LOCKSTEP_STEPS; Step++) {
+		Mg_Step(Lockstep, Actions[Step], Results);
+		for (Index = 0; Index < LOCKSTEP_GAMES; Index++)
+			if (Results[Index] & MG_GAME_OVER)
+				Mg_NewGame(Lockstep, Index, (uint16_t)(Step + Index));
+	}
+	printf("%-20s %8.2f ns/op (%.2fx)\n", "Mg_Step per game", (Now() - Start) / (LOCKSTEP_STEPS * LOCKSTEP_GAMES), Single / (Now() - Start));
+
+	Mg_Destroy(Lockstep);
+
+	if (Differ)
+		fprintf(stderr, "the games stepped in lockstep differ from the engine\n");
+
+	return Differ;
+}
+
+/* Let the autoplayer play. One search per tetromino */
+static void Autoplay(void)
+{
+	TetrisGame Game;
+	AiMove Move;
+	unsigned long Calls;
+	double Start;
+
+	Te_NewGame(&Game, 1);
+
+	Start = Now();
+	for (Calls = 0; Calls < STEPS / 20; Calls++) {
+		if (Ai_FindMove(&Game, &Ai_DefaultWeights, &Move))
+			Ai_Apply(&Game, &Move);
+		if (Te_Step(&Game) & TE_GAME_OVER)
+			Te_NewGame(&Game, (uint16_t)Calls);
+	}
+	Report("Autoplayer move", Start, Calls);
+}
+
+/* Rate the boards the corpus turns into when a tetromino is dropped on it,
+ * one at a time and in a batch. Non zero if the ratings differ */
+static int Evaluate(void)
+{
+	static BoardRow Boards[CANDIDATES][BOARD_ROWS];
+	static uint8_t Lines[CANDIDATES];
+	static int32_t Scalar[CANDIDATES], Batch[CANDIDATES];
+	BoardRow Candidate[PLAYFIELD_ROWS];
+	uint8_t Type, Orientation, Pos_x, Pos_y;
+	unsigned Count = 0, Round;
+	char Name[32];
+	double Start;
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++)
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++)
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++) {
+				if (Te_DetectCollision(PLAYFIELD_BOARD(Playfield), Type, Orientation, Pos_x, POSITION_Y_TOP))
+					continue;
+				memcpy(Candidate, Playfield, sizeof(Candidate));
+				Pos_y = Te_LandingRow(PLAYFIELD_BOARD(Candidate), Type, Orientation, Pos_x, POSITION_Y_TOP);
+				Te_AddTetromino(PLAYFIELD_BOARD(Candidate), Type, Orientation, Pos_x, Pos_y);
+				Lines[Count] = Te_ClearCompletedRows(PLAYFIELD_BOARD(Candidate), Pos_y);
+				memcpy(Boards[Count++], PLAYFIELD_BOARD(Candidate), sizeof(Boards[0]));
+			}
+
+	Start = Now();
+	for (Round = 0; Round < ROUNDS; Round++)
+		Ev_EvaluateBatchScalar(Boards[0], Lines, Count, &Ai_DefaultWeights, Scalar);
+	Report("Ai_Evaluate", Start, (unsigned long)ROUNDS * Count);
+
+	Start = Now();
+	for (Round = 0; Round < ROUNDS; Round++)
+		Ev_EvaluateBatch(Boards[0], Lines, Count, &Ai_DefaultWeights, Batch);
+	sprintf(Name, "Batch (%s)", Ev_Kernel);
+	Report(Name, Start, (unsigned long)ROUNDS * Count);
+
+	if (memcmp(Scalar, Batch, Count * sizeof(int32_t))) {
+		fprintf(stderr, "the batch ratings differ from Ai_Evaluate\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Let the parallel search play LOOKAHEAD_MOVES tetrominoes of the same
+ * game. Either record the moves or compare with the recorded ones. Non zero
+ * if they differ */
+static int Search(const char *Name, unsigned Workers, TtTable *Table, AiMove *Moves, int Record)
+{
+	TetrisGame Game;
+	AiMove Move;
+	WsPool *Pool;
+	unsigned Calls;
+	int Differ = 0;
+	double Start;
+
+	Pool = Ws_Create(Workers);
+	if (!Pool) {
+		fprintf(stderr, "could not create %u workers\n", Workers);
+		return 1;
+	}
+
+	Te_NewGame(&Game, 1);
+
+	Start = Now();
+	for (Calls = 0; Calls < LOOKAHEAD_MOVES; Calls++) {
+		if (!Ps_FindMove(Pool, Table, &Game, LOOKAHEAD_DEPTH, &Ai_DefaultWeights, &Move))
+			break;
+		if (Record)
+			Moves[Calls] = Move;
+		else if ((Move.Orientation != Moves[Calls].Orientation) || (Move.Pos_x != Moves[Calls].Pos_x))
+			Differ = 1;
+		Ai_Apply(&Game, &Move);
+		if (Te_Step(&Game) & TE_GAME_OVER)
+			break;
+	}
+	Report(Name, Start, Calls);
+	printf("%-20s %8lu steals\n", "", Ws_Steals(Pool));
+
+	Ws_Destroy(Pool);
+
+	return Differ;
+}
+
+/* Play the same game with 1, 2, 4, ... workers, then with the most workers
+ * and a transposition table of each replacement policy. All runs have to
+ * place the tetrominoes like the first one did. Non zero if one did not */
+static int Lookahead(void)
+{
+	static const char *Policies[] = { "always", "depth", "aged" };
+	AiMove Moves[LOOKAHEAD_MOVES];
+	TtTable *Table;
+	TtStats Stats;
+	unsigned Workers;
+	uint8_t Policy;
+	int Differ = 0;
+	char Name[32];
+
+	for (Workers = 1; Workers <= WORKERS_MAX; Workers *= 2) {
+		sprintf(Name, "Lookahead %u, %u thr", LOOKAHEAD_DEPTH, Workers);
+		Differ |= Search(Name, Workers, NULL, Moves, Workers == 1);
+	}
+
+	for (Policy = TT_REPLACE_ALWAYS; Policy <= TT_REPLACE_AGED; Policy++) {
+		Table = Tt_Create(TABLE_BYTES, Policy);
+		if (!Table) {
+			fprintf(stderr, "could not create the transposition table\n");
+			return 1;
+		}
+
+		sprintf(Name, "  table, %s", Policies[Policy]);
+		Differ |= Search(Name, WORKERS_MAX, Table, Moves, 0);
+
+		Tt_Stats(Table, &Stats);
+		printf("%-20s %7.1f%% hits (%lu probes, %lu evictions)\n", ""
+			, Stats.Probes ? 100.0 * Stats.Hits / Stats.Probes : 0.0, Stats.Probes, Stats.Evictions);
+
+		Tt_Destroy(Table);
+	}
+
+	if (Differ)
+		fprintf(stderr, "the parallel search is not deterministic\n");
+
+	return Differ;
+}
+
+int main(void)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Heights[BOARD_COLUMNS];
+	uint8_t Type, Orientation, Pos_x, Pos_y, Row;
+	unsigned long Calls, Round;
+	double Start;
+
+	Te_ClearPlayfield(Playfield);
+	for (Row = 0; Row < CORPUS_ROWS; Row++)
+		Board[BOARD_ROWS - CORPUS_ROWS + Row] = Corpora[CORPUS_PARTIAL][Row];
+	Te_ColumnHeights(Board, Heights);
+
+	/* Every type, orientation and position on the board */
+	Calls = 0;
+	Start = Now();
+	for (Round = 0; Round < ROUNDS; Round++)
+		for (Type = 0; Type < TETROMINO_TYPES; Type++)
+			for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++)
+				for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++)
+					for (Pos_y = POSITION_Y_TOP; Pos_y <= POSITION_Y_BOTTOM; Pos_y++, Calls++)
+						Sink = Te_DetectCollision(Board, Type, Orientation, Pos_x, Pos_y);
+	Report("Te_DetectCollision", Start, Calls);
+
+	/* Dropped from the top wherever the tetromino fits */
+	Calls = 0;
+	Start = Now();
+	for (Round = 0; Round < ROUNDS; Round++)
+		for (Type = 0; Type < TETROMINO_TYPES; Type++)
+			for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++)
+				for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++, Calls++)
+					if (!Te_DetectCollision(Board, Type, Orientation, Pos_x, POSITION_Y_TOP))
+						Sink = Te_LandingRow(Board, Type, Orientation, Pos_x, POSITION_Y_TOP);
+	Report("Te_LandingRow", Start, Calls);
+
+	Calls = 0;
+	Start = Now();
+	for (Round = 0; Round < ROUNDS; Round++)
+		for (Type = 0; Type < TETROMINO_TYPES; Type++)
+			for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++)
+				for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++, Calls++)
+					if (!Te_DetectCollision(Board, Type, Orientation, Pos_x, POSITION_Y_TOP))
+						Sink = Te_GhostRow(Board, Heights, Type, Orientation, Pos_x, POSITION_Y_TOP);
+	Report("Te_GhostRow", Start, Calls);
+
+	if (Evaluate())
+		return 1;
+
+	Play();
+	if (Lockstep())
+		return 1;
+	Autoplay();
+
+	return Lookahead();
+}
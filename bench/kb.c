@@ -0,0 +1,525 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * kb.c: Benchmarks of the kernels of the game
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef __AVR__
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVR__
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#else
+#include <time.h>
+#endif
+
+#include "te.h"
+#include "vw.h"
+#include "rb.h"
+#include "kb.h"
+#include "corpus.h"
+
+/* Tetrominoes brought in per pass of Te_NewTetromino */
+#define SPAWNS				64
+
+/* Falling speed of the linked games, a row per second */
+#define ROLLBACK_GRAVITY		TE_GRAVITY(1, 250)
+
+/* Row the falling tetromino is drawn at */
+#define DRAW_ROW			(POSITION_Y_TOP + TETROMINO_HEIGHT)
+
+/* Calls counted in the current measurement */
+static unsigned long Calls;
+
+#ifdef __AVR__
+
+/* Timer1 runs without prescaler so it counts CPU cycles. Each call is
+ * measured by itself, once for each position of the pass. Calls that take
+ * longer than the 16 bit timer are counted on in its overflows */
+#define START()		(TCNT1 = 0, TIFR1 = _BV(TOV1), Wraps = 0)
+#define STOP()		Stop()
+
+#define MEASURE(Call)	do { START(); Call; Record(STOP()); } while (0)
+
+/* The same after bringing the board back, which is not measured */
+#define MEASURE_AFTER(Setup, Call)	do { Setup; MEASURE(Call); } while (0)
+
+/* Overflows of the timer since the start of the measurement */
+static volatile uint16_t Wraps;
+
+/* The only interrupt during the measurements, once every 65536 cycles */
+ISR(TIMER1_OVF_vect)
+{
+	Wraps++;
+}
+
+/* The timer is read first. An overflow that came after it does not count,
+ * one that came before but was not taken yet does */
+static uint32_t Stop(void)
+{
+	uint16_t Count = TCNT1;
+	uint32_t Cycles;
+
+	cli();
+	Cycles = Wraps;
+	if ((TIFR1 & _BV(TOV1)) && (Count < 0x8000))
+		Cycles++;
+	sei();
+
+	return (Cycles << 16) | Count;
+}
+
+/* Cycles spent by just starting and stopping the measurement */
+static uint32_t Overhead;
+
+/* Statistics of the cycles the calls took */
+static uint32_t Min;
+static uint32_t Max;
+static uint32_t Sum;
+
+static void Record(uint32_t Count)
+{
+	Count -= Overhead;
+
+	if (Count < Min)
+		Min = Count;
+	if (Count > Max)
+		Max = Count;
+	Sum += Count;
+	Calls++;
+}
+
+#else
+
+/* Each kernel goes through its passes for about this many nanoseconds */
+#define HOST_TIME			100e6
+
+/* A call is too short for the clock. It is repeated this many times in a
+ * row and timed as a whole, less the time of the loop without it */
+#define REPEATS				16
+
+/* Empty loops timed to find the time of the loop alone */
+#define CALIBRATIONS			10000
+
+/* Keeps the compiler from merging or moving the calls of a loop */
+#define BARRIER()	__asm__ __volatile__("" : : : "memory")
+
+#define MEASURE(Call)							\
+	do {								\
+		uint8_t Repeat;						\
+		double Start = Now();					\
+									\
+		for (Repeat = 0; Repeat < REPEATS; Repeat++) {		\
+			Call;						\
+			BARRIER();					\
+		}							\
+		Record(Now() - Start, Overhead);			\
+	} while (0)
+
+/* The board is brought back before each call. The loop that does only that
+ * is timed as well and taken off */
+#define MEASURE_AFTER(Setup, Call)					\
+	do {								\
+		uint8_t Repeat;						\
+		double Start = Now(), With;				\
+									\
+		for (Repeat = 0; Repeat < REPEATS; Repeat++) {		\
+			Setup;						\
+			Call;						\
+			BARRIER();					\
+		}							\
+		With = Now() - Start;					\
+		Start = Now();						\
+		for (Repeat = 0; Repeat < REPEATS; Repeat++) {		\
+			Setup;						\
+			BARRIER();					\
+		}							\
+		Record(With, Now() - Start);				\
+	} while (0)
+
+/* Nanoseconds of a loop without a call */
+static double Overhead;
+
+/* Statistics of the nanoseconds per call */
+static double Min;
+static double Max;
+static double Sum;
+
+static double Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return Ts.tv_sec * 1e9 + Ts.tv_nsec;
+}
+
+/* The loop takes longer at times than it was calibrated to. Such calls
+ * count as taking no time rather than less than none */
+static void Record(double Elapsed, double Loop)
+{
+	double Call = (Elapsed - Loop) / REPEATS;
+
+	if (Call < 0)
+		Call = 0;
+
+	if (Call < Min)
+		Min = Call;
+	if (Call > Max)
+		Max = Call;
+	Sum += Call;
+	Calls++;
+}
+
+static void Calibrate(void)
+{
+	unsigned Calibration;
+	uint8_t Repeat;
+	double Start;
+
+	Overhead = 0;
+	for (Calibration = 0; Calibration < CALIBRATIONS; Calibration++) {
+		Start = Now();
+		for (Repeat = 0; Repeat < REPEATS; Repeat++)
+			BARRIER();
+		Overhead += Now() - Start;
+	}
+	Overhead /= CALIBRATIONS;
+}
+
+#endif /* __AVR__ */
+
+/* A pass of a kernel over a board of the corpus */
+typedef void (*KbPass)(uint8_t Corpus, uint8_t Parameter);
+
+typedef struct {
+	const char *Name;
+	KbPass Pass;
+	uint8_t Parameter;
+} KbKernel;
+
+/* The board the kernels work on and an unchanged copy of it */
+static BoardRow Playfield[PLAYFIELD_ROWS];
+static BoardRow Pristine[PLAYFIELD_ROWS];
+
+/* Game for bringing in tetrominoes */
+static TetrisGame Game;
+
+/* The frame, the ghost and the display buffer they are drawn to */
+static BoardRow Frame[PLAYFIELD_ROWS];
+static BoardRow GhostFrame[PLAYFIELD_ROWS];
+static uint8_t Buffer[VW_BUFFER_SIZE];
+
+/* Snapshot of the game on a board of the corpus and the linked games
+ * played again from it */
+static TePacked Packed;
+static RbSession Session;
+
+/* Keeps the compiler from optimizing the calls away */
+static volatile BoardRow Sink;
+
+static void Load(BoardRow *Rows, uint8_t Corpus)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Rows);
+	uint8_t Row;
+
+	Te_ClearPlayfield(Rows);
+	for (Row = 0; Row < CORPUS_ROWS; Row++)
+		Board[BOARD_ROWS - CORPUS_ROWS + Row] = Corpora[Corpus][Row];
+}
+
+/* Every type, orientation and position on the board */
+static void Collision(uint8_t Corpus, uint8_t Parameter)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Type, Orientation, Pos_x, Pos_y;
+
+	(void)Parameter;
+	Load(Playfield, Corpus);
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++)
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++)
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++)
+				for (Pos_y = POSITION_Y_TOP; Pos_y <= POSITION_Y_BOTTOM; Pos_y++)
+					MEASURE(Sink = Te_DetectCollision(Board, Type, Orientation, Pos_x, Pos_y));
+}
+
+/* Every type, orientation and position where the tetromino fits. Removing
+ * a tetromino that was not added does not change the board */
+static void Add(uint8_t Corpus, uint8_t Parameter)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Type, Orientation, Pos_x, Pos_y;
+
+	(void)Parameter;
+	Load(Playfield, Corpus);
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++) {
+				for (Pos_y = POSITION_Y_TOP; Pos_y <= POSITION_Y_BOTTOM; Pos_y++) {
+					if (Te_DetectCollision(Board, Type, Orientation, Pos_x, Pos_y))
+						continue;
+
+					MEASURE(Te_AddTetromino(Board, Type, Orientation, Pos_x, Pos_y));
+					Te_RemoveTetromino(Board, Type, Orientation, Pos_x, Pos_y);
+				}
+			}
+		}
+	}
+}
+
+/* The same positions as for adding. They are looked up on the unchanged
+ * board, tetrominoes not removed again must not get in the way */
+static void Remove(uint8_t Corpus, uint8_t Parameter)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Type, Orientation, Pos_x, Pos_y;
+
+	(void)Parameter;
+	Load(Playfield, Corpus);
+	Load(Pristine, Corpus);
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++) {
+				for (Pos_y = POSITION_Y_TOP; Pos_y <= POSITION_Y_BOTTOM; Pos_y++) {
+					if (Te_DetectCollision(PLAYFIELD_BOARD(Pristine), Type, Orientation, Pos_x, Pos_y))
+						continue;
+
+					Te_AddTetromino(Board, Type, Orientation, Pos_x, Pos_y);
+					MEASURE(Te_RemoveTetromino(Board, Type, Orientation, Pos_x, Pos_y));
+				}
+			}
+		}
+	}
+}
+
+/* A tetromino locked at each y position on the board completed the given
+ * number of rows, from its bottom row up */
+static void Clear(uint8_t Corpus, uint8_t Completed)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Pos_y, Row;
+
+	for (Pos_y = TETROMINO_HEIGHT - 1; Pos_y < BOARD_ROWS; Pos_y++) {
+		Load(Pristine, Corpus);
+		for (Row = 0; Row < Completed; Row++)
+			PLAYFIELD_BOARD(Pristine)[Pos_y - Row] = ROW_COMPLETED;
+
+		MEASURE_AFTER(memcpy(Playfield, Pristine, sizeof(Playfield))
+			      ,Sink = Te_ClearCompletedRows(Board, Pos_y));
+	}
+}
+
+/* The same tetrominoes from the bag each pass */
+static void Spawn(uint8_t Corpus, uint8_t Parameter)
+{
+	uint8_t Count;
+
+	(void)Parameter;
+	Load(Game.Playfield, Corpus);
+	Te_ColumnHeights(TE_BOARD(&Game), Game.Heights);
+	Te_SeedBag(&Game.Bag, TETROMINO_SEED);
+
+	for (Count = 0; Count < SPAWNS; Count++)
+		MEASURE(Sink = Te_NewTetromino(&Game));
+}
+
+/* A frame as the view task draws it for each type, orientation and x
+ * position of the falling tetromino, with its ghost where it lands */
+static void Draw(uint8_t Corpus, uint8_t Parameter)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(Playfield);
+	uint8_t Type, Orientation, Pos_x;
+
+	(void)Parameter;
+	Load(Playfield, Corpus);
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++) {
+				if (Te_DetectCollision(Board, Type, Orientation, Pos_x, DRAW_ROW))
+					continue;
+
+				memcpy(Frame, Playfield, sizeof(Frame));
+				Te_AddTetromino(PLAYFIELD_BOARD(Frame), Type, Orientation, Pos_x, DRAW_ROW);
+				memset(GhostFrame, 0, sizeof(GhostFrame));
+				Te_AddTetromino(PLAYFIELD_BOARD(GhostFrame), Type, Orientation, Pos_x
+						, Te_LandingRow(Board, Type, Orientation, Pos_x, DRAW_ROW));
+				memset(Buffer, 0, sizeof(Buffer));
+
+				MEASURE(Vw_Draw(PLAYFIELD_BOARD(Frame), PLAYFIELD_BOARD(GhostFrame), Buffer));
+			}
+		}
+	}
+}
+
+/* The game with the board of the corpus, as a snapshot */
+static void LoadPacked(uint8_t Corpus)
+{
+	Te_NewGame(&Game, TETROMINO_SEED);
+	Load(Game.Playfield, Corpus);
+	Te_Pack(&Game, &Packed);
+}
+
+static void Pack(uint8_t Corpus, uint8_t Parameter)
+{
+	uint8_t Count;
+
+	(void)Parameter;
+	LoadPacked(Corpus);
+
+	for (Count = 0; Count < SPAWNS; Count++)
+		MEASURE(Te_Pack(&Game, &Packed));
+}
+
+static void Unpack(uint8_t Corpus, uint8_t Parameter)
+{
+	uint8_t Count;
+
+	(void)Parameter;
+	LoadPacked(Corpus);
+
+	for (Count = 0; Count < SPAWNS; Count++)
+		MEASURE(Te_Unpack(&Game, &Packed));
+}
+
+/* Both games start on the board and are played for a window of frames
+ * without the opponent's inputs: Moves in each frame and a drop in the
+ * last. Then the given number of frames is played again, as if the
+ * opponent's inputs had come in late */
+static void Rollback(uint8_t Corpus, uint8_t Frames)
+{
+	uint8_t Count, Player, Played;
+
+	LoadPacked(Corpus);
+	Rb_Start(&Session, 0, TETROMINO_SEED, ROLLBACK_GRAVITY);
+	for (Player = 0; Player < RB_PLAYERS; Player++)
+		Te_Unpack(&Session.Games[Player], &Packed);
+
+	for (Played = 0; Played < RB_WINDOW; Played++)
+		Rb_Advance(&Session, (Played == RB_WINDOW - 1) ? RB_DROP : (Played & 1) ? RB_LEFT : RB_ROTATE);
+
+	for (Count = 0; Count < SPAWNS; Count++)
+		MEASURE(Rb_Rollback(&Session, Session.Frame - Frames));
+}
+
+static const KbKernel Kernels[] = {
+	 {"Te_DetectCollision", Collision, 0}
+	,{"Te_AddTetromino", Add, 0}
+	,{"Te_RemoveTetromino", Remove, 0}
+	,{"Te_ClearCompletedRows/0", Clear, 0}
+	,{"Te_ClearCompletedRows/1", Clear, 1}
+	,{"Te_ClearCompletedRows/2", Clear, 2}
+	,{"Te_ClearCompletedRows/3", Clear, 3}
+	,{"Te_ClearCompletedRows/4", Clear, 4}
+	,{"Te_NewTetromino", Spawn, 0}
+	,{"Vw_Draw", Draw, 0}
+	,{"Te_Pack", Pack, 0}
+	,{"Te_Unpack", Unpack, 0}
+	,{"Rb_Rollback/1", Rollback, 1}
+	,{"Rb_Rollback/4", Rollback, 4}
+	,{"Rb_Rollback/8", Rollback, RB_WINDOW}
+};
+
+#define KERNELS (sizeof(Kernels)/sizeof(KbKernel))
+
+/* One line per kernel and board, the fields separated as in the sources */
+static void Measure(const KbKernel *Kernel, uint8_t Corpus, uint8_t First)
+{
+#ifdef __AVR__
+	Min = 0xFFFFFFFFUL;
+	Max = 0;
+	Sum = 0;
+	Calls = 0;
+	Kernel->Pass(Corpus, Kernel->Parameter);
+
+	printf("\t%c{\"kernel\": \"%s\", \"corpus\": \"%s\", \"ops\": %lu, \"per_op\": %lu, \"min\": %lu, \"max\": %lu}\n"
+	       ,First ? ' ' : ','
+	       ,Kernel->Name
+	       ,CorpusNames[Corpus]
+	       ,Calls
+	       ,Calls ? Sum / Calls : 0
+	       ,Calls ? Min : 0
+	       ,Max
+	       );
+#else
+	unsigned long Passes, Pass;
+	double Start;
+
+	/* Also warms up the caches */
+	Start = Now();
+	Kernel->Pass(Corpus, Kernel->Parameter);
+	Passes = HOST_TIME / (Now() - Start) + 1;
+
+	Min = 1e300;
+	Max = 0;
+	Sum = 0;
+	Calls = 0;
+	for (Pass = 0; Pass < Passes; Pass++)
+		Kernel->Pass(Corpus, Kernel->Parameter);
+
+	printf("\t%c{\"kernel\": \"%s\", \"corpus\": \"%s\", \"ops\": %lu, \"per_op\": %.2f, \"min\": %.2f, \"max\": %.2f}\n"
+	       ,First ? ' ' : ','
+	       ,Kernel->Name
+	       ,CorpusNames[Corpus]
+	       ,Calls
+	       ,Calls ? Sum / Calls : 0.0
+	       ,Calls ? Min : 0.0
+	       ,Max
+	       );
+#endif
+}
+
+void Kb_Run(void)
+{
+	uint8_t Kernel, Corpus;
+
+#ifdef __AVR__
+	START();
+	Overhead = STOP();
+
+	printf("{\"target\": \"avr\", \"unit\": \"cycles\", \"results\": [\n");
+#else
+	Calibrate();
+
+	printf("{\"target\": \"host\", \"unit\": \"ns\", \"results\": [\n");
+#endif
+
+	for (Kernel = 0; Kernel < KERNELS; Kernel++)
+		for (Corpus = 0; Corpus < CORPORA; Corpus++)
+			Measure(&Kernels[Kernel], Corpus, !Kernel && !Corpus);
+
+	printf("]}\n");
+}
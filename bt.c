@@ -0,0 +1,221 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * bt.c: Demo bot that plays the game on the device in idle time
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bt.h"
+
+#ifdef DEMO_BOT
+
+#include <avr/sleep.h>
+
+#include "os.h"
+#include "ap.h"
+#include "ai.h"
+
+/* The game as it was when the tetromino came in and as it is after a
+ * placement of it. Kept off the small stack of the idle task */
+static TetrisGame Snapshot;
+static TetrisGame Child;
+
+/* The best placements found by the first stage, the best first */
+static AiMove Beam[BT_BEAM];
+static int32_t BeamRatings[BT_BEAM];
+static uint8_t BeamSize;
+
+/* Bag of the tetromino that was played last */
+static TetrominoBag Played;
+
+/* Tetrominoes placed since the last report and how many of them had to
+ * go with a plan that was not finished */
+static uint8_t Placed;
+static uint8_t Fallbacks;
+
+/* Non zero if a different tetromino came in than the snapshot has */
+static uint8_t Replaced(const TetrisGame *Game)
+{
+	return memcmp(&Game->Bag, &Snapshot.Bag, sizeof(TetrominoBag)) != 0;
+}
+
+/* Non zero once the tetromino has advanced or is gone: The plan has to be
+ * played now. Read without the resources, a torn read only ends the
+ * search early */
+static uint8_t Deadline(const TetrisGame *Game)
+{
+	return (Game->Falling.Pos_y != Snapshot.Falling.Pos_y) || Replaced(Game);
+}
+
+/* Keep the best placements of the first stage in order. The first of
+ * equally rated ones stays ahead, as with Ai_FindMove */
+static void Insert(const AiMove *Move, int32_t Rating)
+{
+	uint8_t Index = (BeamSize < BT_BEAM) ? BeamSize++ : BT_BEAM;
+
+	for (; (Index > 0) && (Rating > BeamRatings[Index - 1]); Index--) {
+		if (Index < BT_BEAM) {
+			Beam[Index] = Beam[Index - 1];
+			BeamRatings[Index] = BeamRatings[Index - 1];
+		}
+	}
+
+	if (Index < BT_BEAM) {
+		Beam[Index] = *Move;
+		BeamRatings[Index] = Rating;
+	}
+}
+
+/* Anytime search on the snapshot. The first stage rates each placement by
+ * itself, which is what Ai_FindMove would play. The second stage goes
+ * through the best of them, best first, and rates each by the best
+ * placement of the next tetromino from the bag on the board it leaves.
+ * After each rating the search gives up if the deadline has come and goes
+ * with the best placement of those the second stage got through, or the
+ * one of the first stage. Non zero if the search was finished */
+static uint8_t Plan(const TetrisGame *Game, AiMove *Move)
+{
+	AiMove Moves[AI_PLACEMENTS];
+	uint8_t Count, Index, Candidate, Result;
+	int32_t Rating, Lines, Best = AI_LOST, Next;
+
+	Move->Orientation = Snapshot.Falling.Orientation;
+	Move->Pos_x = Snapshot.Falling.Pos_x;
+
+	BeamSize = 0;
+	Count = Ai_Placements(&Snapshot, Moves);
+
+	for (Index = 0; Index < Count; Index++) {
+		Insert(&Moves[Index], Ai_Rate(&Snapshot, &Moves[Index], &Ai_DefaultWeights));
+		*Move = Beam[0];
+		if (Deadline(Game))
+			return 0;
+	}
+
+	for (Candidate = 0; Candidate < BeamSize; Candidate++) {
+		/* Lost as the first stage sees it. Squares locked above the board
+		 * would make the board the next tetromino sees look lower */
+		if (BeamRatings[Candidate] == AI_LOST)
+			continue;
+
+		Child = Snapshot;
+		if (!Ai_Apply(&Child, &Beam[Candidate]))
+			continue;
+
+		Result = Te_Step(&Child);
+		if (Result & (TE_GAME_OVER | TE_OVERFLOW))
+			continue;
+
+		/* The rows the first placement completes count as well */
+		Lines = (int32_t)Ai_DefaultWeights.Lines * (Result & TE_CLEARED);
+		Next = AI_LOST;
+		Count = Ai_Placements(&Child, Moves);
+
+		for (Index = 0; Index < Count; Index++) {
+			Rating = Ai_Rate(&Child, &Moves[Index], &Ai_DefaultWeights);
+			if ((Rating != AI_LOST) && (Rating + Lines > Next))
+				Next = Rating + Lines;
+			if (Deadline(Game))
+				return 0;
+		}
+
+		if (Next > Best) {
+			Best = Next;
+			*Move = Beam[Candidate];
+		}
+	}
+
+	return 1;
+}
+
+/* Let the tasks that the event wakes up run. The scheduler is forced to run
+ * with the next interrupt */
+static void Sleep(void)
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
+
+/* Push the buttons like a player would: Rotate, move sideways, then "drop"
+ * twice for the hard drop. Each event is decided from the tetromino as the
+ * controller task left it, so an event that was not handled yet is just
+ * sent again. A tetromino that does not get there, because it has fallen
+ * since the snapshot, is dropped where it is */
+static void Send(const TetrisGame *Game, const AiMove *Move)
+{
+	uint8_t Events, Event;
+
+	for (Events = 0; (Events < 2 * (TETROMINO_ORIENTATIONS + BOARD_COLUMNS)) && !Replaced(Game); Events++) {
+		if (Events >= TETROMINO_ORIENTATIONS + BOARD_COLUMNS)
+			Event = EVENT_DROP;
+		else if (Game->Falling.Orientation != Move->Orientation)
+			Event = EVENT_ROTATE;
+		else if (Game->Falling.Pos_x < Move->Pos_x)
+			Event = EVENT_LEFT;
+		else if (Game->Falling.Pos_x > Move->Pos_x)
+			Event = EVENT_RIGHT;
+		else
+			Event = EVENT_DROP;
+
+		Os_SetEvent(TASK_ID_CTRL, Event);
+		Sleep();
+	}
+}
+
+void Bt_Play(const TetrisGame *Game)
+{
+	AiMove Move;
+
+	if (!memcmp(&Game->Bag, &Played, sizeof(TetrominoBag)))
+		return;
+
+	Os_GetResources(RESOURCE_BOARD | RESOURCE_CONTROLS);
+	Snapshot = *Game;
+	Os_ReleaseResources(RESOURCE_CONTROLS | RESOURCE_BOARD);
+
+	Played = Snapshot.Bag;
+
+	if (!Plan(Game, &Move))
+		Fallbacks++;
+
+	Send(Game, &Move);
+
+	if (++Placed < BT_REPORT_INTERVAL)
+		return;
+
+	Os_GetResources(RESOURCE_UART);
+	printf("Bot: %u of %u plans finished\n", Placed - Fallbacks, Placed);
+	Os_ReleaseResources(RESOURCE_UART);
+
+	Placed = 0;
+	Fallbacks = 0;
+}
+
+#endif /* DEMO_BOT */
@@ -33,14 +33,27 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <sysexits.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <time.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
 
+#include "lm.h"
+#include "te.h"
+#include "rp.h"
+#include "vs.h"
+#include "rb.h"
+#include "sp.h"
+#include "ai.h"
+#include "ws.h"
+#include "tt.h"
+#include "ps.h"
+
 #define COLOR_BLACK			0
 #define COLOR_WHITE			1
 
@@ -53,120 +66,75 @@
 #define DISPLAY_OFFSET_X		2
 #define DISPLAY_OFFSET_Y		2
 
-/* Tetris game board. I selected 8 x 16 instead of the more common 10 x 20.
- * Rationale: Be able to easily represent the board as a matrix of bits
- * that nicely fits onto byte boundaries
- * README.md has the details
- */
-#define BOARD_COLUMNS			8
-#define BOARD_ROWS			16
-
-/* There are seven types of tetrominones. See README.md for details */
-#define TETROMINO_TYPES			7
-
-/* Orientations of a tetromino. The four cardinal directions */
-#define TETROMINO_ORIENTATIONS		4
-
 /* Normal falling speed: One second between advancements on the y coordinate */
 #define SPEED_DEFAULT			250
 
 /* Accelerated falling speed. After one press on the "drop" button. */
 #define SPEED_FAST			50
 
-/* Drop the tetromino with the next timer tick */
-#define SPEED_ULTIMATE			1
+/* The same as gravity, in rows per tick */
+#ifndef GRAVITY_DEFAULT
+#define GRAVITY_DEFAULT			TE_GRAVITY(1, SPEED_DEFAULT)
+#endif
+#define GRAVITY_FAST			TE_GRAVITY(1, SPEED_FAST)
+
+/* Time between the inputs of the autoplayer in microseconds */
+#define AUTOPLAYER_PERIOD		50000
 
-/* The width of the square in which a tetromino fits */
-#define TEROMINO_WIDTH			4
+/* Deepest lookahead of the autoplayer, in tetrominoes */
+#define AUTOPLAYER_DEPTH_MAX		4
 
-/* Board X center */
-#define POSITION_X_CENTER		((BOARD_COLUMNS - TEROMINO_WIDTH) / 2)
+/* Size of the autoplayer's transposition table in bytes */
+#define AUTOPLAYER_TABLE		(16UL * 1024 * 1024)
 
-/* Board Y positions min max */
-#define POSITION_Y_TOP			0
-#define POSITION_Y_BOTTOM		BOARD_ROWS
+/* Time between the greetings to the opponent in netplay, in microseconds */
+#define NETPLAY_HELLO_PERIOD		100000
 
 /* Number of pixels that make up the side length of a square */
 #define SQUARE_SIDE_LENGTH		(LCD_WIDTH / BOARD_ROWS)
 
-/* Number of bytes needed for the bit map representing a tetromino.
- * See README.md for details */
-#define NR_BYTES_BITMAP			2
-
-/* A completed row - all squares (bits) are occupied */
-#define ROW_COMPLETED			0xFF
-/* And none are occupied in an empty row */
-#define ROW_EMPTY			0x00
-
-/* Possible tetromino orientations in space */
-enum {
-         UP
-        ,RIGHT
-        ,DOWN
-        ,LEFT
-};
-
-/* Describes the active (falling) tetromino */
-typedef struct {
-	/* Type of the falling tetromino (there are 7 types) */
-        volatile uint8_t Type;
-	/* Current orientation of the falling tetromino */
-        volatile uint8_t Orientation;
-	/* Falling speed. More precisely the time between
-	 * an advancement on the y-position, in units of 4 ms */
-        volatile uint8_t Speed;
-	/* Location on the baord of the falling tetromino */
-        volatile uint8_t Pos_x;
-        volatile uint8_t Pos_y;
-} ActiveTetromino;
-
-/* The dynamic object in this game. It is the falling tetromino that can be manipulated */
-static ActiveTetromino Falling;
-
-/* Keeps count of completed rows i.e. score. Only displayed via UART. You need
- * to run a terminal program connected to the microcontroller to see the values */
-static uint8_t Score;
-
-/* The Tetris board. Modeled as 16 rows (bytes) times 8 columns (bits) */
-static uint8_t Board[BOARD_ROWS] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-
-/* All possible tetromino types in all possible orientations. Encoded as bitmaps. */
-static const uint8_t Tetrominoes[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][NR_BYTES_BITMAP] = {
-         {{0x00, 0x47}, {0x03, 0x22}, {0x00,0x71}, {0x01, 0x13}}
-        ,{{0x00, 0x63}, {0x01, 0x32}, {0x00,0x63}, {0x01, 0x32}}
-        ,{{0x00, 0x17}, {0x02, 0x23}, {0x00,0x74}, {0x03, 0x11}}
-        ,{{0x00, 0x36}, {0x02, 0x31}, {0x00,0x36}, {0x02, 0x31}}
-        ,{{0x00, 0x0F}, {0x11, 0x11}, {0x00,0x0F}, {0x11, 0x11}}
-        ,{{0x00, 0x33}, {0x00, 0x33}, {0x00,0x33}, {0x00, 0x33}}
-        ,{{0x00, 0x27}, {0x02, 0x32}, {0x00,0x72}, {0x01, 0x31}}
-};
-
-/* Depending on the tetromino type and orientation the max. x position varies to avoid
- * a tetromino sticking out of the board area or performing "rotations" where not sufficient
- * space is available */
-static const uint8_t Max_Pos_x[TETROMINO_TYPES][TETROMINO_ORIENTATIONS] = {
-          {5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{5, 6, 5, 6}
-         ,{4, 7, 4, 7}
-         ,{6, 6, 6, 6}
-         ,{5, 6, 5, 6}
-};
+/* The state of the game, run by the same engine as on the device */
+static TetrisGame Game;
+
+/* Number of tetrominoes the autoplayer looks ahead and the workers that
+ * search them when that is more than just the falling one */
+static uint8_t AutoplayerDepth = 1;
+static WsPool *AutoplayerPool;
+static TtTable *AutoplayerTable;
+
+/* Falling speed, in rows per tick of 4 ms */
+static TeGravity Gravity = GRAVITY_DEFAULT;
+
+/* Netplay: Both games are played here as well as on the other end, with
+ * rollback. The inputs are collected for the next frame, Game is the local
+ * one of the session. The opponent's random number for the start and the
+ * greetings received */
+static uint8_t Netplay;
+static RbSession Session;
+static uint8_t NetInputs;
+static uint16_t NetNonce;
+static uint8_t NetGreetings;
 
 /* X11 stuff */
 Display *Dpy;
 GC Pen;
 XGCValues Values;
 XEvent Ev;
+Window Win;
 
-/* Mutexes and condition variable needed to control access to resources
- * and signal the view task to run */
+/* Mutexes and condition variables needed to control access to resources,
+ * signal the view task to run and wake the model for a dropped tetromino */
 pthread_mutex_t MutexBoard;
 pthread_mutex_t MutexControl;
 pthread_mutex_t MutexDraw;
+pthread_mutex_t MutexModel;
 
 pthread_cond_t CondDraw;
+pthread_cond_t CondModel;
+
+/* A dropped tetromino waits to be locked by the model, the EVENT_LOCK of
+ * the device. Set with MutexControl and MutexModel both held */
+static uint8_t LockDue;
 
 /* Draw a pixel */
 static void LCDsetPixel(uint8_t x, uint8_t y, uint8_t color)
@@ -206,116 +174,22 @@ static void LCDdisplay(void)
 	XFlush(Dpy);
 }
 
-/* Initiate a new falling tetromino */
-static void NewTetromino(void)
-{
-	/* "randomly" select the new tetromino type */
-	Falling.Type = (uint8_t) (rand() / (RAND_MAX / TETROMINO_TYPES + 1));
-	/* Defaults for each new tetromino */
-	Falling.Orientation = UP;
-	Falling.Speed = SPEED_DEFAULT;
-	Falling.Pos_x = POSITION_X_CENTER;
-	Falling.Pos_y = POSITION_Y_TOP;
-}
-
-/* Detect if the tetromino collides with any element of the board,
- * i.e. other tetrominoes that previously fell or the boards' limits */
-static uint8_t DetectCollision(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-        uint8_t Line0 = 0, Line1 = 0, Line2 = 0, Line3 = 0;
-        uint8_t Detected = 0;
-
-	/* A tetromino is represented as a 4x4 bitmap that has the bits set that make up
-	 * the tetromino. Detecting a collision resumes to checking if there is any bit
-	 * superposition between the tetromino's line and the line of the board.
-	 * Take into account that a tetromino falls line by line starting at 0 so only check
-	 * the lines that are already on the boad.
-	 */
-        Line0 = Board[Pos_y] & ((Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x);
-        if (Pos_y > 0)
-                Line1 = Board[Pos_y - 1] & ((Tetrominoes[Type][Orientation][1] >> 4) << Pos_x);
-        if (Pos_y > 1)
-                Line2 = Board[Pos_y - 2] & ((Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x);
-        if (Pos_y > 2)
-                Line3 = Board[Pos_y - 3] & ((Tetrominoes[Type][Orientation][0] >> 4) << Pos_x);
-        if (Line0 || Line1 || Line2 || Line3) {
-                Detected = 1;
-	}
-	else if ((Pos_x > Max_Pos_x[Type][Orientation]) || (Pos_y > (POSITION_Y_BOTTOM - 1))) {
-                Detected = 1;
-	}
-
-        return Detected;
-}
-
-/* Place a tetromino on the board */
-static void AddTetromino(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-	/* Take into account that a tetromino falls line by line starting at 0 so only add
-	 * the lines that should go the boad according to the current y position of the
-	 * tetromino
-	 */
-        Board[Pos_y] |= (Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x;
-        if (Pos_y > 0)
-                Board[Pos_y - 1] |= (Tetrominoes[Type][Orientation][1] >> 4) << Pos_x;
-        if (Pos_y > 1)
-                Board[Pos_y - 2] |= (Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x;
-        if (Pos_y > 2)
-                Board[Pos_y - 3] |= (Tetrominoes[Type][Orientation][0] >> 4) << Pos_x;
-}
-
-/* Remove a tetromino from the board */
-static void RemoveTetromino(uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
-{
-	/* Take into account that a tetromino falls line by line starting at 0 so only
-	 * remove the lines on the boad that are already visible according to the current
-	 * y position of the tetromino
-	 */
-        Board[Pos_y] &= ~((Tetrominoes[Type][Orientation][1] & 0x0F) << Pos_x);
-        if (Pos_y > 0)
-                Board[Pos_y - 1] &= ~((Tetrominoes[Type][Orientation][1] >> 4) << Pos_x);
-        if (Pos_y > 1)
-                Board[Pos_y - 2] &= ~((Tetrominoes[Type][Orientation][0] & 0x0F) << Pos_x);
-        if (Pos_y > 2)
-                Board[Pos_y - 3] &= ~((Tetrominoes[Type][Orientation][0] >> 4) << Pos_x);
-}
-
-/* Check for and remove completed rows, increment the score for each completed row found */
-static void CheckCompletedRows(void)
-{
-        uint8_t Row, RemainingRows;
-
-        for (Row = 0; Row < BOARD_ROWS; Row++) {
-                if (Board[Row] == ROW_COMPLETED) {
-
-			/* Yay! */
-                        Score++;
-
-			/* And report via UART */
-                        printf("Score: %d\n", Score);
-
-			/* Move the remaining rows towards the bottom */
-                        for (RemainingRows = Row; RemainingRows > 0; RemainingRows--) {
-                                Board[RemainingRows] = Board[RemainingRows - 1];
-                                if (Board[RemainingRows - 1] == ROW_EMPTY)
-                                        break;
-                        }
-                        Board[0] = ROW_EMPTY;
-                }
-        }
-}
-
 static int X11EventLoop (void)
 {
+	uint8_t Updated;
+
 	for(;;) {
 		XNextEvent(Dpy, &Ev);
 
-		/* Block tasks that compete for the "control" resource */
-		pthread_mutex_lock (&MutexControl);
+		/* Key and mouse wheel events are the physical inputs */
+		if ((Ev.type == KeyRelease) || (Ev.type == ButtonPress))
+			Lm_Stamp();
+
+		Updated = 0;
 
-		/* Temporarily remove current active tetromino from the board to avoid detecting false
-		 * collisions with itself */
-                RemoveTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* Block tasks that compete for the "control" resource. The board
+		 * only holds the locked squares, so it is checked against as is */
+		pthread_mutex_lock (&MutexControl);
 
 		switch(Ev.type) {
 		case Expose:
@@ -327,31 +201,54 @@ static int X11EventLoop (void)
 		case KeyRelease:
 
 			switch (XkbKeycodeToKeysym(Dpy, Ev.xkey.keycode, 0, Ev.xkey.state & ShiftMask ? 1 : 0)) {
-			case XK_Up: {
-					    uint8_t Orientation = Falling.Orientation;
-					    Orientation++;
-
-					    /* Orientation is cycled between the 4 allowed values */
-					    Orientation %= TETROMINO_ORIENTATIONS;
-
-					    if (!DetectCollision(Falling.Type, Orientation, Falling.Pos_x, Falling.Pos_y)) {
-						    Falling.Orientation = Orientation;
-					    }
-				    }
+			case XK_Up:
+				if (Netplay) {
+					NetInputs |= RB_ROTATE;
+					Updated = 1;
+					break;
+				}
+				/* Nothing moves a dropped tetromino until it is locked */
+				if (LockDue)
+					break;
+				Rp_Record(RP_ROTATE);
+				if (Te_Rotate(&Game))
+					Updated = 1;
 				break;
 
 			case XK_Down:
+				/* Netplay knows no fast falling, the tetromino drops
+				 * right away */
+				if (Netplay) {
+					NetInputs |= RB_DROP;
+					Updated = 1;
+					break;
+				}
+				if (LockDue)
+					break;
 				/* Each new tetromino defaults to "normal" falling speed */
-				if (Falling.Speed == SPEED_DEFAULT) {
+				if (Gravity < GRAVITY_FAST) {
 					/* With the first push set the "fast" falling speed. */
-					Falling.Speed = SPEED_FAST;
-				} else if (Falling.Speed == SPEED_FAST) {
-					/* With the second push just drop the tetromino */
-					Falling.Speed = SPEED_ULTIMATE;
+					Gravity = GRAVITY_FAST;
+				} else {
+					/* With the second push just drop the tetromino. Put it
+					 * right where it lands and have the model lock it right
+					 * away. Signalled while still holding the controls so
+					 * nothing moves it in between */
+					Rp_Record(RP_DROP);
+					Te_HardDrop(&Game);
+					pthread_mutex_lock (&MutexModel);
+					LockDue = 1;
+					pthread_cond_signal (&CondModel);
+					pthread_mutex_unlock (&MutexModel);
+					Updated = 1;
 				}
 				break;
 
 			case XK_q:
+				if (Netplay)
+					printf("Rollbacks: %u, frames played again: %lu, frames waited: %lu\n"
+					       ,Session.Rollbacks, (unsigned long)Session.Resimulated, (unsigned long)Session.Stalls);
+				Rp_Send();
 				XCloseDisplay(Dpy);
 				exit(0);
 			}
@@ -360,30 +257,41 @@ static int X11EventLoop (void)
 		case ButtonPress:
 			switch (Ev.xbutton.button) {
 			case Button4:
-				/* Validate the motion request. X must be within allowed bounds
-				 * for tetromino type and orientation */
-				if (Falling.Pos_x < Max_Pos_x[Falling.Type][Falling.Orientation]) {
-					/* And no collision must occur by the requested motion */
-					if (!DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x + 1, Falling.Pos_y)) {
-						Falling.Pos_x++;
-					}
+				if (Netplay) {
+					NetInputs |= RB_LEFT;
+					Updated = 1;
+					break;
 				}
+				if (LockDue)
+					break;
+				/* The engine validates the motion request */
+				Rp_Record(RP_LEFT);
+				if (Te_MoveLeft(&Game))
+					Updated = 1;
 				break;
 
 			case Button5:
-				if (Falling.Pos_x > 0) {
-					if (!DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x - 1, Falling.Pos_y)) {
-						Falling.Pos_x--;
-					}
+				if (Netplay) {
+					NetInputs |= RB_RIGHT;
+					Updated = 1;
+					break;
 				}
+				if (LockDue)
+					break;
+				Rp_Record(RP_RIGHT);
+				if (Te_MoveRight(&Game))
+					Updated = 1;
 				break;
 			}
 		}
 
-		pthread_mutex_unlock (&MutexControl);
+		/* This loop plays the role of the controller task */
+		if (Updated)
+			Lm_Forward(LM_STAGE_INPUT);
+		else
+			Lm_Discard(LM_STAGE_INPUT);
 
-		/* Put back the temporarily removed tetromino */
-                AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		pthread_mutex_unlock (&MutexControl);
 	}
 }
 
@@ -391,6 +299,12 @@ static int X11EventLoop (void)
  * the LCD display. It is triggered by the DRAW event */
 static void *TaskView(void *arg)
 {
+	/* The board as it is to be displayed: The locked squares plus the falling tetromino */
+	BoardRow Frame[PLAYFIELD_ROWS];
+	BoardRow *FrameBoard = PLAYFIELD_BOARD(Frame);
+	/* The ghost of the falling tetromino, i.e. where it would land */
+	BoardRow GhostFrame[PLAYFIELD_ROWS];
+	BoardRow *GhostBoard = PLAYFIELD_BOARD(GhostFrame);
 	uint8_t Row, Col, Width, Height;
 
 	(void)arg;
@@ -402,23 +316,40 @@ static void *TaskView(void *arg)
                 pthread_cond_wait (&CondDraw, &MutexDraw);
                 pthread_mutex_unlock (&MutexDraw);
 
+		/* Do not modify the board or the falling tetromino while the frame
+		 * is constructed from them */
+		pthread_mutex_lock (&MutexControl);
+		pthread_mutex_lock (&MutexBoard);
+
+		/* The frame built now reflects all inputs the model has applied */
+		Lm_Forward(LM_STAGE_MODEL);
+
+		memcpy(Frame, Game.Playfield, sizeof(Frame));
+		Te_AddTetromino(FrameBoard, Game.Falling.Type, Game.Falling.Orientation, Game.Falling.Pos_x, Game.Falling.Pos_y);
+
+		memset(GhostFrame, 0, sizeof(GhostFrame));
+		Te_AddTetromino(GhostBoard, Game.Ghost.Type, Game.Ghost.Orientation, Game.Ghost.Pos_x, Game.Ghost.Pos_y);
+
+		pthread_mutex_unlock (&MutexBoard);
+		pthread_mutex_unlock (&MutexControl);
+
 		/* Clear the screen */
 		LCDclear();
 
 		/* Draw a rectangle around the "playing area" */
 		LCDdrawrect(2, 2, LCD_WIDTH - 4 , LCD_HEIGHT - 7, COLOR_BLACK);
 
-		/* Do not modify the board while the display buffer is constructed from it */
-		pthread_mutex_lock (&MutexBoard);
-
-		/* Scan the board and translate it to graphic objects to be displayed.
+		/* Scan the frame and translate it to graphic objects to be displayed.
 		 * Both the board and the tetrominos are made up of "squares" that are
-		 * drawn as N x N squares on the display */
+		 * drawn as N x N squares on the display. Ghost squares are drawn
+		 * with a checkered pattern */
 		for (Row = 0; Row < BOARD_ROWS; Row++) {
 			for (Col = 0;  Col  < BOARD_COLUMNS; Col++) {
-				if (Board[Row] & (1 << Col)) {
+				if ((FrameBoard[Row] | GhostBoard[Row]) & ((BoardRow)1 << Col)) {
 					for (Width = 0; Width < SQUARE_SIDE_LENGTH; Width++) {
 						for (Height = 0; Height < SQUARE_SIDE_LENGTH; Height++) {
+							if (!(FrameBoard[Row] & ((BoardRow)1 << Col)) && ((Width + Height) & 1))
+								continue;
 							LCDsetPixel(DISPLAY_OFFSET_X + (Row * SQUARE_SIDE_LENGTH) + Width
 								    ,DISPLAY_OFFSET_Y + (Col * SQUARE_SIDE_LENGTH) + Height
 								    ,COLOR_BLACK
@@ -429,10 +360,11 @@ static void *TaskView(void *arg)
 			}
 		}
 
-		pthread_mutex_unlock (&MutexBoard);
-
 		/* Send the display buffer to the LCD display */
 		LCDdisplay();
+
+		/* Input to display latency is known now */
+		Lm_FrameDone();
 	}
 
 	return NULL;
@@ -440,6 +372,22 @@ static void *TaskView(void *arg)
 
 static void *TaskModel(void *arg)
 {
+	uint8_t Result;
+	uint8_t Rows;
+	uint8_t Ticks = 0;
+	uint8_t Elapsed = 0;
+	uint8_t Dropped;
+	uint8_t Hole;
+	uint8_t Won;
+	uint16_t Seed;
+	uint16_t Fraction = 0;
+	uint16_t Clock = 0;
+	TeGravity Armed = GRAVITY_DEFAULT;
+	Tetromino Locked;
+	struct timespec Start;
+	struct timespec Deadline;
+	long Waited;
+
 	(void)arg;
 
 	/* sync w/ main */
@@ -451,51 +399,335 @@ static void *TaskModel(void *arg)
 		pthread_mutex_lock (&MutexControl);
 		pthread_mutex_lock (&MutexBoard);
 
-		/* Remove the tetromino as it was before from the board */
-                if (Falling.Pos_y < (POSITION_Y_BOTTOM - 1))
-                        RemoveTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
-
-		/* Update the y position of the falling tetromino */
-                Falling.Pos_y++;
+		/* Whatever the event loop accepted is applied to the board now */
+		Lm_Forward(LM_STAGE_CTRL);
+
+		/* Advance the falling tetromino on the y position by the rows
+		 * due since the last round or lock it on the board when it can
+		 * not fall any further. After a hard drop the tetromino already
+		 * rests on the board and gets locked right away */
+		pthread_mutex_lock (&MutexModel);
+		Dropped = LockDue;
+		LockDue = 0;
+		pthread_mutex_unlock (&MutexModel);
+
+		Result = 0;
+		Clock += Elapsed;
+		Locked = Game.Falling;
+		if (Dropped) {
+			Rp_Record(RP_STEP);
+			Result = Te_Step(&Game);
+		} else {
+			Rows = Te_RowsDue(&Fraction, Armed, Ticks);
+			if (Rows) {
+				Rp_Fall(Rows);
+				Result = Te_Fall(&Game, Rows);
+			}
+		}
 
-		/* Check for a collition with the new Y position */
-                if (DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y)) {
+		/* Each new tetromino defaults to "normal" falling speed and
+		 * starts at the top of its row */
+		if (Result & TE_LOCKED) {
+			Gravity = GRAVITY_DEFAULT;
+			Fraction = 0;
+			Sp_Lock(&Locked, Game.Score);
+		}
 
-			/* Put the previously remove tetromino back to be able to
-			 * check for completed rows */
-                        AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y - 1);
+		/* The garbage rows the opponent sent come in between two
+		 * tetrominoes. The link task queues them with the board held */
+		while ((Result & (TE_LOCKED | TE_GAME_OVER)) == TE_LOCKED) {
+			Rows = Vs_TakeGarbage(&Hole);
+			if (!Rows)
+				break;
+			Rp_Garbage(Rows, Hole);
+			Sp_Garbage(Rows, Hole);
+			Result |= Te_AddGarbage(&Game, Rows, Hole);
+		}
+		Won = Vs_TakeWon();
 
-			/* See if a row was completed and the score needs to
-			 * be updated and the green LED lit */
-                        CheckCompletedRows();
+		/* See if a row was completed and the score needs to be updated.
+		 * The opponent gets garbage rows for it */
+		if (Result & TE_CLEARED) {
+			printf("Score: %u\n", Game.Score);
+			Vs_Cleared(Game.Score, Result & TE_CLEARED, rand() % BOARD_COLUMNS);
+		}
 
-                        /* Initialize a new tetromino */
-			NewTetromino();
+		/* If there is no room for the new tetromino the game has ended.
+		 * So has a game won against the opponent */
+		if (Won || (Result & TE_GAME_OVER)) {
+			if (Won) {
+				printf("You win! Opponent's score: %u\nStarting new game...\n", Vs_OpponentScore());
+			} else {
+				printf("Game Over!\nStarting new game...\n");
+				Vs_Lost();
+			}
+			Seed = (uint16_t)rand();
+			Rp_NewGame(Seed, Game.Score);
+			Te_NewGame(&Game, Seed);
+			Sp_Over();
+		}
 
-                        /* If a collision on board line 0 happens with the newly
-			 * initialized tetromino, the game has ended */
-                        if (DetectCollision(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y)) {
-                                printf("Game Over!\nStarting new game...\n");
-                                memset(Board, 0x00, sizeof(Board));
-                                Score = 0;
-                        }
-                }
+		/* Wherever the event loop moved the tetromino to */
+		Sp_Falling(&Game.Falling);
 
-		/* Add the updated tetromino to the board */
-		AddTetromino(Falling.Type, Falling.Orientation, Falling.Pos_x, Falling.Pos_y);
+		/* Sleep until the next row is due at the selected speed */
+		Armed = Gravity;
+		Ticks = Te_TicksToRow(Fraction, Armed);
 
 		/* Release resources */
 		pthread_mutex_unlock (&MutexBoard);
 		pthread_mutex_unlock (&MutexControl);
 
+		/* Get the records of this round into the file */
+		Rp_Send();
+
+		/* The changes of this round go to the viewer, the whole board
+		 * now and then */
+		Sp_Send(&Game, Clock);
+
 		/* Trigger the view tasks to draw the updated board to the LCD
 		 * display */
                 pthread_mutex_lock (&MutexDraw);
                 pthread_cond_broadcast (&CondDraw);
                 pthread_mutex_unlock (&MutexDraw);
 
-		/* Time between advancing the falling tetromino */
-		usleep(Falling.Speed * 4000);
+		/* Time between advancing the falling tetromino, cut short by a
+		 * dropped tetromino. A tick is 4 ms */
+		clock_gettime(CLOCK_REALTIME, &Start);
+		Deadline = Start;
+		Deadline.tv_nsec += Ticks * 4000000L;
+		Deadline.tv_sec += Deadline.tv_nsec / 1000000000L;
+		Deadline.tv_nsec %= 1000000000L;
+
+		Elapsed = Ticks;
+		pthread_mutex_lock (&MutexModel);
+		while (!LockDue) {
+			if (pthread_cond_timedwait(&CondModel, &MutexModel, &Deadline) == ETIMEDOUT)
+				break;
+		}
+		if (LockDue) {
+			clock_gettime(CLOCK_REALTIME, &Deadline);
+			Waited = (Deadline.tv_sec - Start.tv_sec) * 1000L
+			       + (Deadline.tv_nsec - Start.tv_nsec) / 1000000L;
+			if (Waited / 4 < Ticks)
+				Elapsed = (uint8_t)(Waited / 4);
+		}
+		pthread_mutex_unlock (&MutexModel);
+	}
+
+	return NULL;
+}
+
+/* Netplay: The model plays a frame of both games every RB_FRAME_TICKS,
+ * with the inputs collected meanwhile, and sends the local inputs to the
+ * other end. The frames to play again when the opponent's inputs turn out
+ * different from the prediction are played at the start of the next */
+static void *TaskNetplay(void *arg)
+{
+	VsMessage Hello, Message;
+	uint16_t Wins[RB_PLAYERS];
+	uint16_t Score = 0;
+	uint8_t Greetings, Greet, Side;
+
+	(void)arg;
+
+	/* Greet the other end until it greets back. Later greetings are
+	 * answered in case ours got lost */
+	Hello.Kind = VS_HELLO;
+	Hello.Nonce = (uint16_t)rand();
+
+	do {
+		Vs_Send(&Hello);
+		usleep(NETPLAY_HELLO_PERIOD);
+
+		/* Both ends drew the same number, both draw again */
+		pthread_mutex_lock (&MutexBoard);
+		if (NetGreetings && (NetNonce == Hello.Nonce)) {
+			NetGreetings = 0;
+			Hello.Nonce = (uint16_t)rand();
+		}
+		Greetings = NetGreetings;
+		pthread_mutex_unlock (&MutexBoard);
+	} while (!Greetings);
+	Vs_Send(&Hello);
+
+	pthread_mutex_lock (&MutexControl);
+	pthread_mutex_lock (&MutexBoard);
+	Side = (Hello.Nonce > NetNonce) ? 0 : 1;
+	Rb_Start(&Session, Side, Hello.Nonce ^ NetNonce, GRAVITY_DEFAULT);
+	Game = Session.Games[Side];
+	pthread_mutex_unlock (&MutexBoard);
+	pthread_mutex_unlock (&MutexControl);
+
+	printf("Linked, playing side %u\n", Side);
+	memset(Wins, 0, sizeof(Wins));
+
+	for (;;) {
+		pthread_mutex_lock (&MutexControl);
+		pthread_mutex_lock (&MutexBoard);
+
+		Lm_Forward(LM_STAGE_CTRL);
+
+		/* Inputs wait while the opponent is too far behind */
+		if (Rb_Advance(&Session, NetInputs))
+			NetInputs = 0;
+		Game = Session.Games[Side];
+
+		Rb_Inputs(&Session, &Message);
+
+		/* Greetings after the start mean ours got lost */
+		Greet = (NetGreetings != Greetings);
+		Greetings = NetGreetings;
+
+		if (Game.Score != Score) {
+			Score = Game.Score;
+			printf("Score: %u\n", Score);
+		}
+		if (Session.Players[Side].Wins != Wins[Side])
+			printf("You win!\nStarting new game...\n");
+		if (Session.Players[!Side].Wins != Wins[!Side])
+			printf("Game Over!\nStarting new game...\n");
+		Wins[0] = Session.Players[0].Wins;
+		Wins[1] = Session.Players[1].Wins;
+
+		pthread_mutex_unlock (&MutexBoard);
+		pthread_mutex_unlock (&MutexControl);
+
+		/* Sent every frame, also while waiting, so the other end
+		 * catches up on what got lost */
+		if (Greet)
+			Vs_Send(&Hello);
+		Vs_Send(&Message);
+
+                pthread_mutex_lock (&MutexDraw);
+                pthread_cond_broadcast (&CondDraw);
+                pthread_mutex_unlock (&MutexDraw);
+
+		usleep(RB_FRAME_TICKS * 4000);
+	}
+
+	return NULL;
+}
+
+/* Netplay: The opponent's inputs go to the session with the board held */
+static void *TaskNetLink(void *arg)
+{
+	VsReceiver Receiver;
+	VsMessage Message;
+	int Byte;
+
+	(void)arg;
+
+	memset(&Receiver, 0, sizeof(Receiver));
+
+	while ((Byte = Vs_Wait()) >= 0) {
+		switch (Vs_Decode(&Receiver, (uint8_t)Byte, &Message)) {
+		case VS_HELLO:
+			pthread_mutex_lock (&MutexBoard);
+			if (!NetGreetings)
+				NetNonce = Message.Nonce;
+			NetGreetings++;
+			pthread_mutex_unlock (&MutexBoard);
+			break;
+		case VS_INPUTS:
+			pthread_mutex_lock (&MutexBoard);
+			Rb_Remote(&Session, &Message);
+			pthread_mutex_unlock (&MutexBoard);
+			break;
+		default:
+			break;
+		}
+	}
+
+	printf ("Link to the opponent lost\n");
+
+	return NULL;
+}
+
+/* Versus mode: Take in what the opponent sends, with the board held as
+ * the device's UART interrupt holds off the tasks. The model picks it up
+ * with its next round */
+static void *TaskLink(void *arg)
+{
+	int Byte;
+
+	(void)arg;
+
+	while ((Byte = Vs_Wait()) >= 0) {
+		pthread_mutex_lock (&MutexBoard);
+		Vs_Receive((uint8_t)Byte);
+		pthread_mutex_unlock (&MutexBoard);
+	}
+
+	printf ("Link to the opponent lost\n");
+
+	return NULL;
+}
+
+/* Send an input to the emulator's window as if it came from the user */
+static void SendInput(Display *AutoDpy, int Type, unsigned int Code)
+{
+	XEvent Input;
+
+	memset(&Input, 0, sizeof(Input));
+	Input.type = Type;
+	Input.xany.window = Win;
+
+	if (Type == KeyRelease) {
+		Input.xkey.keycode = XKeysymToKeycode(AutoDpy, Code);
+		Input.xkey.same_screen = True;
+		XSendEvent(AutoDpy, Win, False, KeyReleaseMask, &Input);
+	} else {
+		Input.xbutton.button = Code;
+		Input.xbutton.same_screen = True;
+		XSendEvent(AutoDpy, Win, False, ButtonPressMask, &Input);
+	}
+
+	XFlush(AutoDpy);
+}
+
+/* The autoplayer pushes the same keys and turns the same mouse wheel as
+ * the user, over its own connection to the X server. Each period it looks
+ * for the best placement of the falling tetromino anew and makes one step
+ * towards it: Rotate, move and finally drop the tetromino. With lookahead
+ * the search is spread over all processors */
+static void *TaskAutoplayer(void *arg)
+{
+	Display *AutoDpy;
+	TetrisGame Snapshot;
+	AiMove Move;
+
+	(void)arg;
+
+	AutoDpy = XOpenDisplay(NULL);
+	if (!AutoDpy) {
+		fprintf(stderr, "unable to connect to display\n");
+		return NULL;
+	}
+
+	for (;;) {
+		usleep(AUTOPLAYER_PERIOD);
+
+		pthread_mutex_lock (&MutexControl);
+		pthread_mutex_lock (&MutexBoard);
+		Snapshot = Game;
+		pthread_mutex_unlock (&MutexBoard);
+		pthread_mutex_unlock (&MutexControl);
+
+		if (AutoplayerPool) {
+			if (!Ps_FindMove(AutoplayerPool, AutoplayerTable, &Snapshot, AutoplayerDepth, &Ai_DefaultWeights, &Move))
+				continue;
+		} else if (!Ai_FindMove(&Snapshot, &Ai_DefaultWeights, &Move))
+			continue;
+
+		if (Move.Orientation != Snapshot.Falling.Orientation)
+			SendInput(AutoDpy, KeyRelease, XK_Up);
+		else if (Move.Pos_x > Snapshot.Falling.Pos_x)
+			SendInput(AutoDpy, ButtonPress, Button4);
+		else if (Move.Pos_x < Snapshot.Falling.Pos_x)
+			SendInput(AutoDpy, ButtonPress, Button5);
+		else
+			SendInput(AutoDpy, KeyRelease, XK_Down);
 	}
 
 	return NULL;
@@ -506,33 +738,86 @@ int main(int argc, char ** argv)
 	int ScreenNum;
 	unsigned long Background, Border;
 	struct timeval Tv;
-	Window Win;
+	uint16_t Seed;
+	int Arg, Autoplayer = 0, Versus = 0, Recording = 0, Spectated = 0;
 
         pthread_t thTaskView;
         pthread_t thTaskModel;
+        pthread_t thTaskAutoplayer;
+        pthread_t thTaskLink;
         pthread_attr_t attrTaskView;
         pthread_attr_t attrTaskModel;
-
-	(void)argc;
-	(void)argv;
+        pthread_attr_t attrTaskAutoplayer;
+        pthread_attr_t attrTaskLink;
 
 	printf ("Keyboard 'q' quits the emulator\n");
 	printf ("Keyboard 'Up' rotates the teromino\n");
 	printf ("Keyboard 'Down' drops the teromino\n");
 	printf ("Mouse wheel 'Up' moves the teromino to the left\n");
 	printf ("Mouse wheel 'Down' moves the teromino to the right\n");
+	printf ("Command line option '-a' lets the autoplayer play\n");
+	printf ("Command line option '-a 2' lets it look one tetromino ahead\n");
+	printf ("Command line option '-r FILE' records a replay into FILE\n");
+	printf ("Command line option '-s FILE' streams the game into FILE for tools/spectate\n");
+	printf ("Command line option '-v TTY' plays against the emulator on the other end of TTY\n");
+	printf ("Command line option '-n TTY' does the same with both games kept in step by rollback\n");
+
+	for (Arg = 1; Arg < argc; Arg++) {
+		if (!strcmp(argv[Arg], "-a")) {
+			Autoplayer = 1;
+			if ((Arg + 1 < argc) && isdigit((unsigned char)argv[Arg + 1][0])) {
+				AutoplayerDepth = atoi(argv[++Arg]);
+				if ((AutoplayerDepth < 1) || (AutoplayerDepth > AUTOPLAYER_DEPTH_MAX)) {
+					fprintf(stderr, "lookahead must be 1 to %d\n", AUTOPLAYER_DEPTH_MAX);
+					exit (EX_USAGE);
+				}
+			}
+		} else if (!strcmp(argv[Arg], "-r") && (Arg + 1 < argc)) {
+			if (!Rp_Open(argv[++Arg])) {
+				fprintf(stderr, "could not create %s: %s\n", argv[Arg], strerror (errno));
+				exit (EX_CANTCREAT);
+			}
+			Recording = 1;
+		} else if (!strcmp(argv[Arg], "-s") && (Arg + 1 < argc)) {
+			if (!Sp_Open(argv[++Arg])) {
+				fprintf(stderr, "could not open %s: %s\n", argv[Arg], strerror (errno));
+				exit (EX_CANTCREAT);
+			}
+			Spectated = 1;
+		} else if (!strcmp(argv[Arg], "-v") && (Arg + 1 < argc)) {
+			if (!Vs_Open(argv[++Arg])) {
+				fprintf(stderr, "could not open %s: %s\n", argv[Arg], strerror (errno));
+				exit (EX_NOINPUT);
+			}
+			Versus = 1;
+		} else if (!strcmp(argv[Arg], "-n") && (Arg + 1 < argc)) {
+			if (!Vs_Open(argv[++Arg])) {
+				fprintf(stderr, "could not open %s: %s\n", argv[Arg], strerror (errno));
+				exit (EX_NOINPUT);
+			}
+			Netplay = 1;
+		} else {
+			fprintf(stderr, "usage: %s [-a [depth]] [-r file] [-s file] [-v tty | -n tty]\n", argv[0]);
+			exit (EX_USAGE);
+		}
+	}
+
+	/* Netplay replays both games the same on both ends. Of the local one
+	 * there is no replay and no stream, its course is not known until it
+	 * is confirmed */
+	if (Netplay && (Versus || Recording || Spectated)) {
+		fprintf(stderr, "-n does not go with -v, -r or -s\n");
+		exit (EX_USAGE);
+	}
 
 	/* Seed the RNG */
 	gettimeofday(&Tv, NULL);
 	srand(Tv.tv_usec);
 
-	Score = 0;
-
-	/* Initialize the board */
-        memset(Board, 0, sizeof(Board));
-
-	/* Initialize a new tetromino to be dropped */
-	NewTetromino();
+	/* Initialize the board and a new tetromino to be dropped */
+	Seed = (uint16_t)rand();
+	Rp_NewGame(Seed, 0);
+	Te_NewGame(&Game, Seed);
 
 	/* First connect to the display server */
 	Dpy = XOpenDisplay(NULL);
@@ -569,9 +854,11 @@ int main(int argc, char ** argv)
         pthread_mutex_init(&MutexBoard, NULL);
 	pthread_mutex_init(&MutexControl, NULL);
 	pthread_mutex_init(&MutexDraw, NULL);
+	pthread_mutex_init(&MutexModel, NULL);
 
 	/* Initialize condition variable */
         pthread_cond_init (&CondDraw, NULL);
+	pthread_cond_init (&CondModel, NULL);
 
 	/* Create the view "task" */
 	pthread_attr_init (&attrTaskView);
@@ -582,11 +869,38 @@ int main(int argc, char ** argv)
 
 	/* Create the model "task" */
 	pthread_attr_init (&attrTaskModel);
-        if (pthread_create (&thTaskModel, &attrTaskModel, TaskModel, NULL)) {
+        if (pthread_create (&thTaskModel, &attrTaskModel, Netplay ? TaskNetplay : TaskModel, NULL)) {
 		printf ("could not create thread TaskView: %s", strerror (errno));
 		exit (EX_OSERR);
 	}
 
+	/* Create the autoplayer "task" if requested */
+	if (Autoplayer) {
+		if (AutoplayerDepth > 1) {
+			AutoplayerPool = Ws_Create(sysconf(_SC_NPROCESSORS_ONLN));
+			AutoplayerTable = Tt_Create(AUTOPLAYER_TABLE, TT_REPLACE_AGED);
+			if (!AutoplayerPool || !AutoplayerTable) {
+				printf ("could not create the autoplayer's workers: %s", strerror (errno));
+				exit (EX_OSERR);
+			}
+		}
+
+		pthread_attr_init (&attrTaskAutoplayer);
+		if (pthread_create (&thTaskAutoplayer, &attrTaskAutoplayer, TaskAutoplayer, NULL)) {
+			printf ("could not create thread TaskAutoplayer: %s", strerror (errno));
+			exit (EX_OSERR);
+		}
+	}
+
+	/* Create the link "task" in versus mode and netplay */
+	if (Versus || Netplay) {
+		pthread_attr_init (&attrTaskLink);
+		if (pthread_create (&thTaskLink, &attrTaskLink, Netplay ? TaskNetLink : TaskLink, NULL)) {
+			printf ("could not create thread TaskLink: %s", strerror (errno));
+			exit (EX_OSERR);
+		}
+	}
+
 	/* Handle X11 events. Does not return */
 	X11EventLoop();
 
@@ -43,6 +43,10 @@ Lesser General Public License for more details.
 #define PCD8544_SETBIAS 0x10
 #define PCD8544_SETVOP 0x80
 
+/* the memory buffer for the LCD. Byte x + p * LCDWIDTH holds the
+ * pixels 8p to 8p + 7 of column x, the lowest one in bit 0 */
+extern uint8_t pcd8544_buffer[LCDWIDTH * LCDHEIGHT / 8];
+
 void LCDInit(uint8_t contrast);
 void LCDcommand(uint8_t c);
 void LCDdata(uint8_t c);
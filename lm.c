@@ -0,0 +1,185 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * lm.c: Input to display latency measurement
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lm.h"
+
+#ifdef LATENCY_HARNESS
+
+#ifdef __AVR__
+
+/* On the device the time base is the timer driving the application timers */
+#include "os.h"
+
+#define Lm_Now()		Os_GetTime()
+
+/* Stamps are taken from ISRs, so keep them away while the stages are updated */
+#define Lm_Lock()		Os_EnterCritical()
+#define Lm_Unlock()		Os_ExitCritical()
+
+#else
+
+/* Emulator: The X11 event loop and the "tasks" are threads */
+#include <time.h>
+#include <pthread.h>
+
+static pthread_mutex_t MutexStages = PTHREAD_MUTEX_INITIALIZER;
+
+#define Lm_Lock()		pthread_mutex_lock(&MutexStages)
+#define Lm_Unlock()		pthread_mutex_unlock(&MutexStages)
+
+/* Monotonic time in units of LM_TIME_UNIT microseconds. Wraps like the
+ * device's time base does */
+static uint16_t Lm_Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return (uint16_t)((Ts.tv_sec * 1000000UL + Ts.tv_nsec / 1000) / LM_TIME_UNIT);
+}
+
+#endif /* __AVR__ */
+
+/* Time stamp held by each stage */
+static uint16_t Stamps[LM_STAGES];
+
+/* Bit N is set if stage N holds a time stamp */
+static volatile uint8_t StagesValid = 0;
+
+/* Collected latencies */
+static uint16_t Histogram[LM_BUCKETS];
+static uint16_t Samples = 0;
+static uint16_t Min = 0xFFFF;
+static uint16_t Max = 0;
+
+/* Time stamp a physical input. Only the first input after the previous one has
+ * been passed on is stamped. Inputs that follow are reflected by the same frame,
+ * which makes the recorded value the worst case latency */
+void Lm_Stamp(void)
+{
+	uint16_t Now = Lm_Now();
+
+	Lm_Lock();
+
+	if (!(StagesValid & (1 << LM_STAGE_INPUT))) {
+		Stamps[LM_STAGE_INPUT] = Now;
+		StagesValid |= 1 << LM_STAGE_INPUT;
+	}
+
+	Lm_Unlock();
+}
+
+/* Hand the time stamp on. If the next stage still holds an older stamp
+ * keep that one, the newer input will be reflected by the same frame */
+void Lm_Forward(uint8_t Stage)
+{
+	Lm_Lock();
+
+	if (StagesValid & (1 << Stage)) {
+		if (!(StagesValid & (1 << (Stage + 1)))) {
+			Stamps[Stage + 1] = Stamps[Stage];
+			StagesValid |= 1 << (Stage + 1);
+		}
+		StagesValid &= ~(1 << Stage);
+	}
+
+	Lm_Unlock();
+}
+
+/* Drop the time stamp of an input that did not change anything */
+void Lm_Discard(uint8_t Stage)
+{
+	Lm_Lock();
+
+	StagesValid &= ~(1 << Stage);
+
+	Lm_Unlock();
+}
+
+/* Send the histogram over the UART (stdout in the emulator) */
+static void Lm_Report(void)
+{
+	uint8_t Bucket;
+
+	printf("Latency: n=%u min=%luus max=%luus\n"
+	       ,Samples
+	       ,(unsigned long)Min * LM_TIME_UNIT
+	       ,(unsigned long)Max * LM_TIME_UNIT
+	       );
+
+	for (Bucket = 0; Bucket < LM_BUCKETS; Bucket++) {
+		if (Histogram[Bucket])
+			printf("  <%8luus: %u\n", (1UL << Bucket) * LM_TIME_UNIT, Histogram[Bucket]);
+	}
+}
+
+/* Record the latency of the input reflected by the frame that was just sent
+ * to the display */
+void Lm_FrameDone(void)
+{
+	uint16_t Now = Lm_Now();
+	uint16_t Latency;
+	uint8_t Bucket = 0;
+
+	Lm_Lock();
+
+	if (!(StagesValid & (1 << LM_STAGE_VIEW))) {
+		/* Frame was caused by the falling tetromino, not by an input */
+		Lm_Unlock();
+		return;
+	}
+
+	StagesValid &= ~(1 << LM_STAGE_VIEW);
+
+	/* Unsigned arithmetic takes care of a wrapped time base */
+	Latency = Now - Stamps[LM_STAGE_VIEW];
+
+	Lm_Unlock();
+
+	/* Bucket index is the position of the most significant bit set */
+	while (Latency >> Bucket)
+		Bucket++;
+
+	if (Histogram[Bucket] < 0xFFFF)
+		Histogram[Bucket]++;
+
+	if (Latency < Min)
+		Min = Latency;
+	if (Latency > Max)
+		Max = Latency;
+
+	Samples++;
+	if ((Samples % LM_REPORT_INTERVAL) == 0)
+		Lm_Report();
+}
+
+#endif /* LATENCY_HARNESS */
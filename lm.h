@@ -0,0 +1,82 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * lm.h: Input to display latency measurement
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef LM_H
+#define LM_H
+
+#include <stdint.h>
+
+/* Resolution of a latency time stamp in microseconds */
+#define LM_TIME_UNIT			64
+
+/* Number of histogram buckets. Bucket 0 counts latencies below one time unit,
+ * bucket N counts latencies of 2^(N-1) up to 2^N - 1 time units */
+#define LM_BUCKETS			17
+
+/* The histogram is reported via UART each time this many samples were taken */
+#define LM_REPORT_INTERVAL		32
+
+/* Stages a physical input passes on its way to the display. Each stage
+ * holds the time stamp of the oldest input it has not passed on yet */
+enum {
+	 LM_STAGE_INPUT		/* Detected by an ISR */
+	,LM_STAGE_CTRL		/* Accepted by the controller task */
+	,LM_STAGE_MODEL		/* Applied to the game state by the model task */
+	,LM_STAGE_VIEW		/* Part of the frame being drawn by the view task */
+	,LM_STAGES
+};
+
+#ifdef LATENCY_HARNESS
+
+/* Time stamp a physical input (ADC change, button edge) */
+extern void Lm_Stamp(void);
+
+/* Hand the time stamp held by a stage on to the next stage */
+extern void Lm_Forward(uint8_t Stage);
+
+/* Forget the time stamp held by a stage. The input it belongs to
+ * did not cause any visible change */
+extern void Lm_Discard(uint8_t Stage);
+
+/* The frame drawn by the view task has reached the display. Record
+ * the latency of the input it reflects in the histogram */
+extern void Lm_FrameDone(void);
+
+#else
+
+/* The instrumentation compiles to nothing if the harness is not wanted */
+#define Lm_Stamp()		((void)0)
+#define Lm_Forward(Stage)	((void)(Stage))
+#define Lm_Discard(Stage)	((void)(Stage))
+#define Lm_FrameDone()		((void)0)
+
+#endif /* LATENCY_HARNESS */
+
+#endif /* LM_H */
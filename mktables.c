@@ -0,0 +1,181 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * mktables.c: Generates the lookup tables of the Tetris engine (runs on the host)
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "te.h"
+
+/* Number of bytes needed for the bit map representing a tetromino.
+ * See README.md for details */
+#define NR_BYTES_BITMAP			2
+
+/* All possible tetromino types in all possible orientations. Encoded as bitmaps. */
+static const uint8_t Tetrominoes[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][NR_BYTES_BITMAP] = {
+         {{0x00, 0x47}, {0x03, 0x22}, {0x00,0x71}, {0x01, 0x13}}
+        ,{{0x00, 0x63}, {0x01, 0x32}, {0x00,0x63}, {0x01, 0x32}}
+        ,{{0x00, 0x17}, {0x02, 0x23}, {0x00,0x74}, {0x03, 0x11}}
+        ,{{0x00, 0x36}, {0x02, 0x31}, {0x00,0x36}, {0x02, 0x31}}
+        ,{{0x00, 0x0F}, {0x11, 0x11}, {0x00,0x0F}, {0x11, 0x11}}
+        ,{{0x00, 0x33}, {0x00, 0x33}, {0x00,0x33}, {0x00, 0x33}}
+        ,{{0x00, 0x27}, {0x02, 0x32}, {0x00,0x72}, {0x01, 0x31}}
+};
+
+/* Hex digits of a board row */
+#define ROW_DIGITS			(BOARD_ROW_BITS / 4)
+
+/* Get a row of a tetromino's bitmap. Row 0 is the bottom row */
+static unsigned int BitmapRow(uint8_t Type, uint8_t Orientation, uint8_t Row)
+{
+	uint8_t Byte = Tetrominoes[Type][Orientation][1 - Row / 2];
+
+	return (Row % 2) ? (Byte >> 4) : (Byte & 0x0F);
+}
+
+/* Number of columns the tetromino occupies */
+static uint8_t BitmapWidth(uint8_t Type, uint8_t Orientation)
+{
+	unsigned int Columns = 0;
+	uint8_t Row, Width = 0;
+
+	for (Row = 0; Row < TETROMINO_HEIGHT; Row++)
+		Columns |= BitmapRow(Type, Orientation, Row);
+
+	while (Columns >> Width)
+		Width++;
+
+	return Width;
+}
+
+/* Lowest square of a column of the tetromino, counted from its bottom row */
+static uint8_t BitmapBottom(uint8_t Type, uint8_t Orientation, uint8_t Column)
+{
+	uint8_t Row;
+
+	for (Row = 0; Row < TETROMINO_HEIGHT; Row++)
+		if (BitmapRow(Type, Orientation, Row) & (1 << Column))
+			return Row;
+
+	return NO_SQUARE;
+}
+
+/* Highest square of a column of the tetromino. The squares of a column
+ * are next to each other, from its lowest to its highest one */
+static uint8_t BitmapTop(uint8_t Type, uint8_t Orientation, uint8_t Column)
+{
+	uint8_t Row;
+
+	for (Row = TETROMINO_HEIGHT; Row-- > 0; )
+		if (BitmapRow(Type, Orientation, Row) & (1 << Column))
+			return Row;
+
+	return NO_SQUARE;
+}
+
+int main(void)
+{
+	uint8_t Type, Orientation, Pos_x, Row;
+
+	printf("/* Generated by mktables. Do not edit */\n\n");
+
+	/* The tables only fit the board they were generated for. A build for
+	 * other dimensions must not go on with them */
+	printf("#if (BOARD_COLUMNS != %u) || (BOARD_ROWS != %u)\n", BOARD_COLUMNS, BOARD_ROWS);
+	printf("#error \"tables.h is stale, run make clean\"\n");
+	printf("#endif\n\n");
+
+	/* The tetromino bitmaps shifted to every x position. Depending on the
+	 * tetromino type and orientation the max. x position varies to avoid a
+	 * tetromino sticking out of the board area or performing "rotations"
+	 * where not sufficient space is available. Beyond it the tetromino is
+	 * marked as blocked */
+	printf("static const ShiftedTetromino ShiftedTetrominoes[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][POSITIONS_X] PROGMEM = {\n");
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		printf("\t%c{\n", Type ? ',' : ' ');
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			uint8_t Max_Pos_x = BOARD_COLUMNS - BitmapWidth(Type, Orientation);
+
+			printf("\t\t%c{", Orientation ? ',' : ' ');
+			for (Pos_x = 0; Pos_x < POSITIONS_X; Pos_x++) {
+				printf("%s{{", Pos_x ? ", " : "");
+				for (Row = 0; Row < TETROMINO_HEIGHT; Row++) {
+					unsigned long Mask = 0;
+
+					if (Pos_x <= Max_Pos_x)
+						Mask = (unsigned long)BitmapRow(Type, Orientation, Row) << Pos_x;
+
+					printf("%s0x%0*lX", Row ? "," : "", ROW_DIGITS, Mask);
+				}
+				printf("}, 0x%0*lX}", ROW_DIGITS, (unsigned long)((Pos_x <= Max_Pos_x) ? ROW_EMPTY : ROW_COMPLETED));
+			}
+			printf("}\n");
+		}
+		printf("\t}\n");
+	}
+
+	printf("};\n\n");
+
+	/* The bottom profile of each tetromino. Together with the heights of the
+	 * board's columns it tells where a tetromino lands without letting it
+	 * fall row by row */
+	printf("static const uint8_t TetrominoBottoms[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][TEROMINO_WIDTH] PROGMEM = {\n");
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		printf("\t%c{", Type ? ',' : ' ');
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			printf("%s{", Orientation ? ", " : "");
+			for (Row = 0; Row < TEROMINO_WIDTH; Row++)
+				printf("%s0x%02X", Row ? "," : "", BitmapBottom(Type, Orientation, Row));
+			printf("}");
+		}
+		printf("}\n");
+	}
+
+	printf("};\n\n");
+
+	/* And the top profile. With both the heights and holes of the board's
+	 * columns are kept up to date when a tetromino locks */
+	printf("static const uint8_t TetrominoTops[TETROMINO_TYPES][TETROMINO_ORIENTATIONS][TEROMINO_WIDTH] PROGMEM = {\n");
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++) {
+		printf("\t%c{", Type ? ',' : ' ');
+		for (Orientation = 0; Orientation < TETROMINO_ORIENTATIONS; Orientation++) {
+			printf("%s{", Orientation ? ", " : "");
+			for (Row = 0; Row < TEROMINO_WIDTH; Row++)
+				printf("%s0x%02X", Row ? "," : "", BitmapTop(Type, Orientation, Row));
+			printf("}");
+		}
+		printf("}\n");
+	}
+
+	printf("};\n");
+
+	return 0;
+}
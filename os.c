@@ -53,6 +53,15 @@ static volatile uint8_t ResourcesOccupied = 0;
 
 /* Timers configured by the application */
 static TimerDescriptor *Timers = NULL;
+static uint8_t NrTimers = 0;
+
+#ifdef OS_TIMER_SERVICE
+/* Ticks counted by the ISR that the timer service task has not processed yet */
+static volatile uint8_t PendingTicks = 0;
+
+/* The application's identifier of the timer service task */
+static uint8_t TimerTaskID = 0;
+#endif
 
 /* Tasks configured by the application */
 static TaskDescriptor *Tasks = NULL;
@@ -130,6 +139,58 @@ void Os_TickTimer(uint8_t TimerID)
 	Os_ExitCritical();
 }
 
+/*
+ * Tick all application timers. Called from the tick ISR.
+ * By default the timers are processed right here, in the ISR. The time this
+ * takes grows with the number of timers and so does the interrupt latency.
+ * With OS_TIMER_SERVICE the ISR only counts the tick and wakes up the timer
+ * service task which processes the timers. ISR time is then constant.
+ */
+void Os_TickTimers(void)
+{
+#ifdef OS_TIMER_SERVICE
+	/* Should the service task ever fall 255 ticks behind, ticks get lost */
+	if (PendingTicks < 0xFF)
+		PendingTicks++;
+
+	Os_SetEvent(TimerTaskID, EVENT_TICK);
+#else
+	uint8_t TimerID;
+
+	for (TimerID = 0; TimerID < NrTimers; TimerID++)
+		Os_TickTimer(TimerID);
+#endif
+}
+
+#ifdef OS_TIMER_SERVICE
+/*
+ * The timer service task. Processes timer expirations outside of the ISR.
+ * Being the task with the highest priority it runs right after the ISR
+ * unless resources or other interrupts delay it.
+ */
+void Os_TaskTimerService(void)
+{
+	uint8_t Ticks;
+	uint8_t TimerID;
+
+	for (;;) {
+		Os_WaitEvents(EVENT_TICK);
+		Os_ClearEvents(EVENT_TICK);
+
+		/* Take over the ticks counted so far */
+		Os_EnterCritical();
+		Ticks = PendingTicks;
+		PendingTicks = 0;
+		Os_ExitCritical();
+
+		for (; Ticks > 0; Ticks--) {
+			for (TimerID = 0; TimerID < NrTimers; TimerID++)
+				Os_TickTimer(TimerID);
+		}
+	}
+}
+#endif /* OS_TIMER_SERVICE */
+
 /*
  * This call serves to enter a critical section in the code that is assigned to
  * the resource referenced by ResID.
@@ -292,7 +353,7 @@ inline void Os_SetTimer(uint8_t TimerID, uint8_t Value)
  * Set up the relevant OS tables and start the operating system.
  * This call does not return.
 */
-void Os_StartOS(TaskDescriptor *ApTasks, uint8_t NrApTasks, TimerDescriptor *ApTimers)
+void Os_StartOS(TaskDescriptor *ApTasks, uint8_t NrApTasks, TimerDescriptor *ApTimers, uint8_t NrApTimers, uint8_t ApTimerTaskID)
 {
 	/* Scheduling table stuff */
 	Tasks = ApTasks;
@@ -300,6 +361,12 @@ void Os_StartOS(TaskDescriptor *ApTasks, uint8_t NrApTasks, TimerDescriptor *ApT
 
 	/* Timers */
 	Timers = ApTimers;
+	NrTimers = NrApTimers;
+#ifdef OS_TIMER_SERVICE
+	TimerTaskID = ApTimerTaskID;
+#else
+	(void)ApTimerTaskID;
+#endif
 
 	/* Enable the interrupts */
 	Os_EnableAllInterrupts();
@@ -83,6 +83,9 @@ extern TaskDescriptor volatile *CurrentTask;
 #define Os_UARTSend		Uc_UARTSend
 #define Os_ADCGet		Uc_ADCGet
 
+/* Free running time base */
+#define Os_GetTime		Uc_GetTime
+
 /* Blinky stuff */
 #define Os_LEDGreenOn		Uc_LEDGreenOn
 #define Os_LEDGreenOff		Uc_LEDGreenOff
@@ -135,6 +138,21 @@ extern void Os_SetTimer(uint8_t TimerID, uint8_t Value);
  * event to the task it is assigned to */
 extern void Os_TickTimer(uint8_t TimerID);
 
+/* Called from the ISR of the timer driving the application timers */
+extern void Os_TickTimers(void);
+
+#ifdef OS_TIMER_SERVICE
+
+/* Event sent by the tick ISR to the timer service task */
+#define EVENT_TICK			0x01
+
+/* Entry function of the timer service task. The application has to configure
+ * it in its scheduling table as the task with the highest priority and pass
+ * its identifier to Os_StartOS */
+extern void Os_TaskTimerService(void);
+
+#endif /* OS_TIMER_SERVICE */
+
 typedef struct {
 	/* Nr of ticks to timer expiration */
 	volatile uint8_t Value;
@@ -154,8 +172,9 @@ typedef struct {
 
 /* Operating system startup/shutdown control */
 
-/* Initialize and start the OS */
-extern void Os_StartOS(TaskDescriptor *ApTasks, uint8_t NrApTasks, TimerDescriptor *ApTimers);
+/* Initialize and start the OS. ApTimerTaskID identifies the timer service
+ * task, it is ignored without OS_TIMER_SERVICE */
+extern void Os_StartOS(TaskDescriptor *ApTasks, uint8_t NrApTasks, TimerDescriptor *ApTimers, uint8_t NrApTimers, uint8_t ApTimerTaskID);
 
 /* Halt the OS */
 extern void Os_ShutdownOS(void);
@@ -0,0 +1,230 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * rb.c: Rollback: Linked games kept in step by predicting the opponent
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "te.h"
+#include "vs.h"
+#include "rb.h"
+
+/* The seed of the games started after the given frame */
+#define RB_SEED(Session, Frame)		((uint16_t)((Session)->Seed + (Frame) * 40503u))
+
+/* Signed distance of two frame numbers that may have wrapped around */
+#define RB_AHEAD(Frame, Of)		((int16_t)(uint16_t)((Frame) - (Of)))
+
+static void NewGames(RbSession *Session, uint16_t Seed)
+{
+	uint8_t Player;
+
+	for (Player = 0; Player < RB_PLAYERS; Player++) {
+		Te_NewGame(&Session->Games[Player], Seed);
+		Session->Players[Player].Fraction = 0;
+		Session->Players[Player].Garbage = 0;
+	}
+}
+
+void Rb_Start(RbSession *Session, uint8_t Side, uint16_t Seed, TeGravity Gravity)
+{
+	memset(Session, 0, sizeof(*Session));
+	Session->Side = Side;
+	Session->Seed = Seed;
+	Session->Gravity = Gravity;
+	NewGames(Session, Seed);
+}
+
+/* A frame of a player as the model plays it: Moves first, then the fall at
+ * the gravity of the session, or the drop. Garbage waiting comes in after a
+ * lock */
+static uint8_t Play(TetrisGame *Game, RbPlayer *Player, TeGravity Gravity, uint8_t Inputs)
+{
+	uint8_t Result = 0, Rows;
+
+	if (Inputs & RB_LEFT)
+		Te_MoveLeft(Game);
+	if (Inputs & RB_RIGHT)
+		Te_MoveRight(Game);
+	if (Inputs & RB_ROTATE)
+		Te_Rotate(Game);
+
+	if (Inputs & RB_DROP) {
+		Te_HardDrop(Game);
+		Result = Te_Step(Game);
+	} else {
+		Rows = Te_RowsDue(&Player->Fraction, Gravity, RB_FRAME_TICKS);
+		if (Rows)
+			Result = Te_Fall(Game, Rows);
+	}
+
+	if (Result & TE_LOCKED) {
+		Player->Fraction = 0;
+		if (Player->Garbage && !(Result & TE_GAME_OVER)) {
+			Result |= Te_AddGarbage(Game, Player->Garbage, Player->Hole);
+			Player->Garbage = 0;
+		}
+	}
+
+	return Result;
+}
+
+/* Take the snapshot before the next frame and play it. The opponent does
+ * nothing in frames their inputs are not known for yet */
+static void Step(RbSession *Session)
+{
+	RbSnapshot *Snapshot = &Session->Snapshots[Session->Frame % RB_WINDOW];
+	uint8_t Inputs[RB_PLAYERS], Results[RB_PLAYERS];
+	uint8_t Player, Other, Rows;
+
+	for (Player = 0; Player < RB_PLAYERS; Player++)
+		Te_Pack(&Session->Games[Player], &Snapshot->Games[Player]);
+	memcpy(Snapshot->Players, Session->Players, sizeof(Snapshot->Players));
+
+	Inputs[Session->Side] = Session->Local[Session->Frame % (2 * RB_WINDOW)];
+	Inputs[!Session->Side] = (RB_AHEAD(Session->Received, Session->Frame) > 0) ? Session->Remote[Session->Frame % (2 * RB_WINDOW)] : 0;
+
+	for (Player = 0; Player < RB_PLAYERS; Player++)
+		Results[Player] = Play(&Session->Games[Player], &Session->Players[Player], Session->Gravity, Inputs[Player]);
+
+	/* Rows cleared send garbage to the other player, with the gap where
+	 * the bag says. Both ends agree on it */
+	for (Player = 0; Player < RB_PLAYERS; Player++) {
+		Rows = Vs_Garbage(Results[Player] & TE_CLEARED);
+		if (!Rows)
+			continue;
+
+		Other = !Player;
+		if (!Session->Players[Other].Garbage)
+			Session->Players[Other].Hole = Session->Games[Player].Bag.State % BOARD_COLUMNS;
+		Session->Players[Other].Garbage += Rows;
+		if (Session->Players[Other].Garbage > BOARD_ROWS)
+			Session->Players[Other].Garbage = BOARD_ROWS;
+	}
+
+	Session->Frame++;
+
+	/* The player whose game lasts longer wins and both start over. If
+	 * both end in the same frame, nobody does */
+	if ((Results[0] | Results[1]) & TE_GAME_OVER) {
+		for (Player = 0; Player < RB_PLAYERS; Player++)
+			if ((Results[!Player] & TE_GAME_OVER) && !(Results[Player] & TE_GAME_OVER))
+				Session->Players[Player].Wins++;
+		NewGames(Session, RB_SEED(Session, Session->Frame));
+	}
+}
+
+void Rb_Rollback(RbSession *Session, uint16_t From)
+{
+	RbSnapshot *Snapshot = &Session->Snapshots[From % RB_WINDOW];
+	uint16_t To = Session->Frame;
+	uint8_t Player;
+
+	for (Player = 0; Player < RB_PLAYERS; Player++)
+		Te_Unpack(&Session->Games[Player], &Snapshot->Games[Player]);
+	memcpy(Session->Players, Snapshot->Players, sizeof(Session->Players));
+
+	Session->Rollbacks++;
+	Session->Resimulated += (uint16_t)(To - From);
+
+	for (Session->Frame = From; Session->Frame != To; )
+		Step(Session);
+}
+
+uint8_t Rb_Advance(RbSession *Session, uint8_t Inputs)
+{
+	if (Session->Rolling) {
+		Session->Rolling = 0;
+		Rb_Rollback(Session, Session->Rollback);
+	}
+
+	if (RB_AHEAD(Session->Frame, Session->Received) >= RB_WINDOW) {
+		Session->Stalls++;
+		return 0;
+	}
+
+	Session->Local[Session->Frame % (2 * RB_WINDOW)] = Inputs & RB_INPUTS;
+	Step(Session);
+
+	return 1;
+}
+
+void Rb_Remote(RbSession *Session, const VsMessage *Message)
+{
+	uint16_t Frame = Message->Frame - Message->Count + 1;
+	uint8_t Index, Remote;
+
+	/* Frames not played yet can not be acknowledged */
+	if ((RB_AHEAD(Message->Ack, Session->Acked) > 0) && (RB_AHEAD(Message->Ack, Session->Frame) <= 0))
+		Session->Acked = Message->Ack;
+
+	/* From the oldest input to the newest. A gap means messages got lost,
+	 * the next one fills it */
+	for (Index = Message->Count; Index > 0; Index--, Frame++) {
+		if (RB_AHEAD(Frame, Session->Received) < 0)
+			continue;
+		if (Frame != Session->Received)
+			return;
+
+		/* An opponent this far ahead does not keep to the protocol */
+		if (RB_AHEAD(Frame, Session->Frame) >= RB_WINDOW)
+			return;
+
+		Remote = (Message->Inputs[(Index - 1) / 2] >> (((Index - 1) & 1) * 4)) & RB_INPUTS;
+		Session->Remote[Frame % (2 * RB_WINDOW)] = Remote;
+
+		/* Frames played already were played without inputs */
+		if (Remote && (RB_AHEAD(Frame, Session->Frame) < 0)) {
+			if (!Session->Rolling || (RB_AHEAD(Frame, Session->Rollback) < 0))
+				Session->Rollback = Frame;
+			Session->Rolling = 1;
+		}
+
+		Session->Received++;
+	}
+}
+
+void Rb_Inputs(const RbSession *Session, VsMessage *Message)
+{
+	uint16_t Frame = Session->Frame - 1;
+	uint8_t Index;
+
+	Message->Kind = VS_INPUTS;
+	Message->Frame = Frame;
+	Message->Ack = Session->Received;
+
+	/* As many as the opponent is missing, rounded up to an even number */
+	Message->Count = ((uint16_t)(Session->Frame - Session->Acked) + 1) & ~1;
+	if (Message->Count > 2 * RB_WINDOW)
+		Message->Count = 2 * RB_WINDOW;
+
+	memset(Message->Inputs, 0, sizeof(Message->Inputs));
+	for (Index = 0; Index < Message->Count; Index++, Frame--)
+		Message->Inputs[Index / 2] |= Session->Local[Frame % (2 * RB_WINDOW)] << ((Index & 1) * 4);
+}
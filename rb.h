@@ -0,0 +1,141 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * rb.h: Rollback: Linked games kept in step by predicting the opponent
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef RB_H
+#define RB_H
+
+#include <stdint.h>
+
+#include "te.h"
+#include "vs.h"
+
+/* Both games of a link are played on both ends, frame by frame, from the
+ * inputs of both players. The local inputs are known right away, those of
+ * the opponent arrive over the link a few frames late. Until they do, the
+ * opponent is predicted to do nothing, which is what a player does most of
+ * the time. If the prediction was wrong, the games are brought back to the
+ * snapshot before the first frame that was off and played again up to the
+ * present. The local game never waits for the link, unless the opponent
+ * falls behind by a whole window of frames.
+ *
+ * Both ends compute the same games from the same inputs: Garbage and the
+ * tetromino types depend on nothing but the games themselves and the seed
+ * agreed on. Frame numbers and the ring buffers wrap around, so the window
+ * is a power of two. The local inputs are sent until the opponent
+ * acknowledges them, which can take up to two windows */
+#ifndef RB_WINDOW
+#define RB_WINDOW			8
+#endif
+#if 2 * RB_WINDOW > VS_INPUTS_MAX
+#error "RB_WINDOW too large for the messages to the opponent"
+#endif
+#define RB_PLAYERS			2
+
+/* A frame lasts this many ticks of the OS timer */
+#define RB_FRAME_TICKS			4
+
+/* Inputs of a player in a frame, one bit each. RB_DROP drops the falling
+ * tetromino and locks it */
+#define RB_LEFT				0x01
+#define RB_RIGHT			0x02
+#define RB_ROTATE			0x04
+#define RB_DROP				0x08
+#define RB_INPUTS			0x0F
+
+/* What there is to a player besides the game */
+typedef struct {
+	/* Part of a row fallen so far, see Te_RowsDue */
+	uint16_t Fraction;
+	/* Garbage rows waiting for the next lock and the column of their gap */
+	uint8_t Garbage;
+	uint8_t Hole;
+	/* Games won */
+	uint16_t Wins;
+} RbPlayer;
+
+/* Both players before a frame */
+typedef struct {
+	TePacked Games[RB_PLAYERS];
+	RbPlayer Players[RB_PLAYERS];
+} RbSnapshot;
+
+typedef struct {
+	/* The games as of the frames played so far. Read only */
+	TetrisGame Games[RB_PLAYERS];
+	RbPlayer Players[RB_PLAYERS];
+	/* The local player's index into the games */
+	uint8_t Side;
+	/* Every game is started from a seed derived from this one */
+	uint16_t Seed;
+	/* The falling speed of both games */
+	TeGravity Gravity;
+	/* The next frame to play */
+	uint16_t Frame;
+	/* The opponent's inputs are known for the frames before this one, and
+	 * the opponent knows the local ones before Acked */
+	uint16_t Received;
+	uint16_t Acked;
+	/* The first frame played on a wrong prediction, if Rolling */
+	uint16_t Rollback;
+	uint8_t Rolling;
+	/* Inputs, indexed by frame */
+	uint8_t Local[2 * RB_WINDOW];
+	uint8_t Remote[2 * RB_WINDOW];
+	/* The players before each frame not yet confirmed */
+	RbSnapshot Snapshots[RB_WINDOW];
+	/* Statistics: Rollbacks, frames played again and frames the local game
+	 * waited for the opponent */
+	uint16_t Rollbacks;
+	uint32_t Resimulated;
+	uint32_t Stalls;
+} RbSession;
+
+/* Start a session. Side is 0 on one end and 1 on the other. Both ends have
+ * to play at the same gravity */
+extern void Rb_Start(RbSession *Session, uint8_t Side, uint16_t Seed, TeGravity Gravity);
+
+/* Play the next frame with the local player's inputs. Plays again first
+ * what was played on wrong predictions. Zero if the opponent is too far
+ * behind to go on, the inputs are to be passed again in the next frame */
+extern uint8_t Rb_Advance(RbSession *Session, uint8_t Inputs);
+
+/* Pass on a VS_INPUTS message of the opponent. Frames already known are
+ * skipped, and messages lost are made up for by the next ones */
+extern void Rb_Remote(RbSession *Session, const VsMessage *Message);
+
+/* Put together the VS_INPUTS message for the opponent. To be sent every
+ * frame, played or not */
+extern void Rb_Inputs(const RbSession *Session, VsMessage *Message);
+
+/* Bring the games back to the snapshot before the given frame, at most
+ * RB_WINDOW frames back, and play them again up to the present */
+extern void Rb_Rollback(RbSession *Session, uint16_t From);
+
+#endif /* RB_H */
@@ -0,0 +1,343 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * rp.c: Recording and replaying of the inputs to the Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "te.h"
+#include "rp.h"
+
+/* Tick counts from this one on take more bytes */
+#define TICKS_ESCAPE			31
+
+uint8_t Rp_EncodeHeader(uint8_t *Bytes)
+{
+	Bytes[0] = 'T';
+	Bytes[1] = 'R';
+	Bytes[2] = RP_VERSION;
+	Bytes[3] = BOARD_COLUMNS;
+	Bytes[4] = BOARD_ROWS;
+
+	return RP_HEADER_SIZE;
+}
+
+uint8_t Rp_CheckHeader(const uint8_t *Bytes)
+{
+	uint8_t Header[RP_HEADER_SIZE];
+	uint8_t Index;
+
+	Rp_EncodeHeader(Header);
+
+	for (Index = 0; Index < RP_HEADER_SIZE; Index++)
+		if ((Bytes[Index] != Header[Index]) && ((Index != 2) || !Bytes[Index] || (Bytes[Index] > RP_VERSION)))
+			return 0;
+
+	return 1;
+}
+
+uint8_t Rp_Encode(uint8_t *Bytes, const RpRecord *Record)
+{
+	uint16_t Ticks = Record->Ticks;
+	uint8_t Kind = (Record->Kind == RP_GARBAGE) ? RP_FALL : Record->Kind;
+	uint8_t Length = 1;
+
+	if (Ticks < TICKS_ESCAPE) {
+		Bytes[0] = (Kind << 5) | Ticks;
+	} else {
+		Bytes[0] = (Kind << 5) | TICKS_ESCAPE;
+		for (; Ticks >= 0x80; Ticks >>= 7)
+			Bytes[Length++] = 0x80 | (Ticks & 0x7F);
+		Bytes[Length++] = Ticks;
+	}
+
+	if (Record->Kind == RP_NEW_GAME) {
+		Bytes[Length++] = Record->Seed;
+		Bytes[Length++] = Record->Seed >> 8;
+		Bytes[Length++] = Record->Score;
+		Bytes[Length++] = Record->Score >> 8;
+	}
+
+	/* Falls further than the playfield all end at the same row */
+	if (Record->Kind == RP_FALL)
+		Bytes[Length++] = (Record->Rows < RP_FALL_GARBAGE) ? Record->Rows : RP_FALL_GARBAGE - 1;
+
+	if (Record->Kind == RP_GARBAGE) {
+		Bytes[Length++] = RP_FALL_GARBAGE | Record->Rows;
+		Bytes[Length++] = Record->Hole;
+	}
+
+	return Length;
+}
+
+uint8_t Rp_Decode(const uint8_t *Bytes, uint16_t Length, RpRecord *Record)
+{
+	uint8_t Used = 1, Shift;
+
+	if (!Length)
+		return 0;
+
+	Record->Kind = Bytes[0] >> 5;
+	Record->Ticks = Bytes[0] & TICKS_ESCAPE;
+
+	if (Record->Ticks == TICKS_ESCAPE) {
+		Record->Ticks = 0;
+		for (Shift = 0; ; Shift += 7) {
+			if ((Used >= Length) || (Shift > 14))
+				return 0;
+			Record->Ticks |= (uint16_t)(Bytes[Used] & 0x7F) << Shift;
+			if (!(Bytes[Used++] & 0x80))
+				break;
+		}
+	}
+
+	if (Record->Kind == RP_NEW_GAME) {
+		if (Used + 4 > Length)
+			return 0;
+		Record->Seed = Bytes[Used] | (uint16_t)Bytes[Used + 1] << 8;
+		Record->Score = Bytes[Used + 2] | (uint16_t)Bytes[Used + 3] << 8;
+		Used += 4;
+	}
+
+	if (Record->Kind == RP_FALL) {
+		if (Used >= Length)
+			return 0;
+		Record->Rows = Bytes[Used++];
+		if (Record->Rows & RP_FALL_GARBAGE) {
+			if (Used >= Length)
+				return 0;
+			Record->Kind = RP_GARBAGE;
+			Record->Rows &= ~RP_FALL_GARBAGE;
+			Record->Hole = Bytes[Used++];
+
+			/* A gap off the board is a record mangled on its way,
+			 * the game is not the one played from here on */
+			if (Record->Hole >= BOARD_COLUMNS)
+				Record->Kind = RP_GAP;
+		}
+	}
+
+	return Used;
+}
+
+uint8_t Rp_Apply(TetrisGame *Game, const RpRecord *Record)
+{
+	switch (Record->Kind) {
+	case RP_NEW_GAME:
+		Te_NewGame(Game, Record->Seed);
+		return 0;
+	case RP_LEFT:
+		return Te_MoveLeft(Game);
+	case RP_RIGHT:
+		return Te_MoveRight(Game);
+	case RP_ROTATE:
+		return Te_Rotate(Game);
+	case RP_DROP:
+		Te_HardDrop(Game);
+		return 1;
+	case RP_STEP:
+		return Te_Step(Game);
+	case RP_FALL:
+		return Te_Fall(Game, Record->Rows);
+	case RP_GARBAGE:
+		return Te_AddGarbage(Game, Record->Rows, Record->Hole);
+	default:
+		return 0;
+	}
+}
+
+#ifdef REPLAY_RECORD
+
+#ifdef __AVR__
+
+/* On the device the records are collected by the tasks and sent by the
+ * model task. The time base is the one of the application timers */
+#include "os.h"
+
+#define Rp_Now()		Os_GetTime()
+
+/* Records are added by the tasks holding the controls and taken out by
+ * the model after releasing them, so keep the others away meanwhile */
+#define Rp_Lock()		Os_EnterCritical()
+#define Rp_Unlock()		Os_ExitCritical()
+
+/* Room for the records of a few model rounds */
+#define RP_BUFFER_SIZE		32
+
+static uint8_t Buffer[RP_BUFFER_SIZE];
+static uint8_t Buffered = 0;
+
+/* The buffer ran full and records were dropped */
+static uint8_t Lost = 0;
+
+/* The header goes out before the first records */
+static uint8_t Started = 0;
+
+#else
+
+/* Emulator: Records are written to the file right away */
+#include <time.h>
+
+static FILE *File = NULL;
+
+/* Same time base as on the device */
+static uint16_t Rp_Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return (uint16_t)((Ts.tv_sec * 1000000UL + Ts.tv_nsec / 1000) / (RP_TICK_US >> 6));
+}
+
+int Rp_Open(const char *Path)
+{
+	uint8_t Header[RP_HEADER_SIZE];
+
+	File = fopen(Path, "wb");
+	if (!File)
+		return 0;
+
+	return fwrite(Header, Rp_EncodeHeader(Header), 1, File) == 1;
+}
+
+#endif /* __AVR__ */
+
+/* Time of the previous record. Advanced by whole ticks only, so the
+ * remainders do not get lost */
+static uint16_t Time;
+
+static void Rp_Add(RpRecord *Record)
+{
+	uint16_t Ticks = (uint16_t)(Rp_Now() - Time) >> 6;
+
+	Time += Ticks << 6;
+	Record->Ticks = Ticks;
+
+#ifdef __AVR__
+	Rp_Lock();
+	if (!Lost && (Buffered + RP_RECORD_SIZE_MAX <= RP_BUFFER_SIZE))
+		Buffered += Rp_Encode(&Buffer[Buffered], Record);
+	else
+		Lost = 1;
+	Rp_Unlock();
+#else
+	{
+		uint8_t Bytes[RP_RECORD_SIZE_MAX];
+
+		if (File)
+			fwrite(Bytes, Rp_Encode(Bytes, Record), 1, File);
+	}
+#endif
+}
+
+void Rp_Record(uint8_t Kind)
+{
+	RpRecord Record;
+
+	Record.Kind = Kind;
+	Rp_Add(&Record);
+}
+
+void Rp_NewGame(uint16_t Seed, uint16_t Score)
+{
+	RpRecord Record;
+
+	Record.Kind = RP_NEW_GAME;
+	Record.Seed = Seed;
+	Record.Score = Score;
+	Rp_Add(&Record);
+}
+
+void Rp_Fall(uint8_t Rows)
+{
+	RpRecord Record;
+
+	Record.Kind = RP_FALL;
+	Record.Rows = Rows;
+	Rp_Add(&Record);
+}
+
+void Rp_Garbage(uint8_t Rows, uint8_t Hole)
+{
+	RpRecord Record;
+
+	Record.Kind = RP_GARBAGE;
+	Record.Rows = Rows;
+	Record.Hole = Hole;
+	Rp_Add(&Record);
+}
+
+#ifdef __AVR__
+
+/* Take the records out of the buffer and print them as hex digits. A gap
+ * record marks where records were dropped */
+void Rp_Send(void)
+{
+	uint8_t Bytes[RP_HEADER_SIZE + RP_BUFFER_SIZE];
+	uint8_t Length = 0, Index;
+	RpRecord Gap;
+
+	if (!Started) {
+		Length = Rp_EncodeHeader(Bytes);
+		Started = 1;
+	}
+
+	Rp_Lock();
+	for (Index = 0; Index < Buffered; Index++)
+		Bytes[Length++] = Buffer[Index];
+	Buffered = 0;
+	if (Lost) {
+		Gap.Kind = RP_GAP;
+		Gap.Ticks = 0;
+		Buffered = Rp_Encode(Buffer, &Gap);
+		Lost = 0;
+	}
+	Rp_Unlock();
+
+	if (!Length)
+		return;
+
+	putchar('@');
+	for (Index = 0; Index < Length; Index++)
+		printf("%02x", Bytes[Index]);
+	putchar('\n');
+}
+
+#else
+
+void Rp_Send(void)
+{
+	if (File)
+		fflush(File);
+}
+
+#endif /* __AVR__ */
+
+#endif /* REPLAY_RECORD */
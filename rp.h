@@ -0,0 +1,142 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * rp.h: Recording and replaying of the inputs to the Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef RP_H
+#define RP_H
+
+#include <stdint.h>
+
+#include "te.h"
+
+/* A replay is everything the engine was asked to do, in order and with the
+ * time in between. Given the seed of each game, that is all it takes to
+ * run the engine through the very same states again.
+ *
+ * Format: A header of RP_HEADER_SIZE bytes, "TR", the format version and
+ * the board's columns and rows, followed by the records. A record is one
+ * byte: The kind in the upper 3 bits, the ticks since the previous record
+ * in the lower 5. Tick counts of 31 and up are written as 31 followed by
+ * the count in groups of 7 bits, least significant first, the top bit set
+ * in all groups but the last. RP_NEW_GAME records are followed by the seed
+ * of the new game and the score of the game that ended, 16 bits each, low
+ * byte first, RP_FALL records by the number of rows. RP_GARBAGE records
+ * are written as RP_FALL records with RP_FALL_GARBAGE set in the number of
+ * rows, followed by the column of the gap. Older versions lack the newer
+ * records and are played as well */
+#define RP_VERSION			3
+#define RP_HEADER_SIZE			5
+#define RP_RECORD_SIZE_MAX		8
+
+/* Length of a tick in microseconds: The device's time base shifted by 6 */
+#define RP_TICK_US			4096
+
+/* Kinds of records */
+#define RP_NEW_GAME			0
+#define RP_LEFT				1
+#define RP_RIGHT			2
+#define RP_ROTATE			3
+#define RP_DROP				4
+#define RP_STEP				5
+#define RP_FALL				6
+/* Records got lost. The game diverges until the next RP_NEW_GAME */
+#define RP_GAP				7
+/* Garbage rows from the opponent. Has no room of its own in the 3 bits */
+#define RP_GARBAGE			8
+
+/* Marks the rows of an RP_FALL record as garbage rows */
+#define RP_FALL_GARBAGE			0x80
+
+typedef struct {
+	uint8_t Kind;
+	uint16_t Ticks;
+	/* RP_NEW_GAME only */
+	uint16_t Seed;
+	uint16_t Score;
+	/* RP_FALL and RP_GARBAGE only */
+	uint8_t Rows;
+	/* RP_GARBAGE only */
+	uint8_t Hole;
+} RpRecord;
+
+/* Write the header. Returns its size */
+extern uint8_t Rp_EncodeHeader(uint8_t *Bytes);
+
+/* Non zero if the header is that of a replay this build can play */
+extern uint8_t Rp_CheckHeader(const uint8_t *Bytes);
+
+/* Write a record. Returns its size, at most RP_RECORD_SIZE_MAX */
+extern uint8_t Rp_Encode(uint8_t *Bytes, const RpRecord *Record);
+
+/* Read a record from the given number of bytes. Returns the bytes it
+ * took, zero if they end before the record does. Garbage with its gap off
+ * the board is read as RP_GAP */
+extern uint8_t Rp_Decode(const uint8_t *Bytes, uint16_t Length, RpRecord *Record);
+
+/* Do to the game what the record says. Returns what the engine returned */
+extern uint8_t Rp_Apply(TetrisGame *Game, const RpRecord *Record);
+
+#ifdef REPLAY_RECORD
+
+#ifndef __AVR__
+/* Record into the given file. Nothing is recorded unless it is opened.
+ * Non zero on success */
+extern int Rp_Open(const char *Path);
+#endif
+
+/* Record a call of the engine. The caller must keep the other callers of
+ * the engine out, which it does anyway */
+extern void Rp_Record(uint8_t Kind);
+
+/* Record the start of a new game */
+extern void Rp_NewGame(uint16_t Seed, uint16_t Score);
+
+/* Record a fall by the given number of rows */
+extern void Rp_Fall(uint8_t Rows);
+
+/* Record garbage rows with a gap in the given column */
+extern void Rp_Garbage(uint8_t Rows, uint8_t Hole);
+
+/* Pass the records on: As a line of hex digits starting with '@' via the
+ * UART on the device, to the file in the emulator. Must not be called
+ * while holding off other callers of the engine */
+extern void Rp_Send(void);
+
+#else
+
+/* The recording compiles to nothing if it is not wanted */
+#define Rp_Record(Kind)			((void)(Kind))
+#define Rp_NewGame(Seed, Score)		((void)(Seed), (void)(Score))
+#define Rp_Fall(Rows)			((void)(Rows))
+#define Rp_Garbage(Rows, Hole)		((void)(Rows), (void)(Hole))
+#define Rp_Send()			((void)0)
+
+#endif /* REPLAY_RECORD */
+
+#endif /* RP_H */
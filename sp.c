@@ -0,0 +1,337 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * sp.c: Spectator stream: The changes of the game for watching it live
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "te.h"
+#include "vs.h"
+#include "sp.h"
+
+uint8_t Sp_Encode(uint8_t *Bytes, const SpMessage *Message)
+{
+	uint8_t Length = 2, Index;
+
+	if ((Message->Kind == SP_PIECE) || (Message->Kind == SP_LOCK)) {
+		Bytes[Length++] = Message->Piece.Type | (Message->Piece.Orientation << 4);
+		Bytes[Length++] = Message->Piece.Pos_x;
+		Bytes[Length++] = Message->Piece.Pos_y;
+	}
+
+	if ((Message->Kind == SP_LOCK) || (Message->Kind == SP_BOARD)) {
+		Bytes[Length++] = Message->Score;
+		Bytes[Length++] = Message->Score >> 8;
+	}
+
+	if (Message->Kind == SP_GARBAGE) {
+		Bytes[Length++] = Message->Rows;
+		Bytes[Length++] = Message->Hole;
+	}
+
+	if (Message->Kind == SP_BOARD) {
+		Bytes[Length++] = Message->First;
+		for (Index = 0; Index < Message->Rows * sizeof(BoardRow); Index++)
+			Bytes[Length++] = Message->Board[Index / sizeof(BoardRow)] >> (8 * (Index % sizeof(BoardRow)));
+	}
+
+	return Vs_Frame(Bytes, Message->Kind, Length - 2);
+}
+
+/* A tetromino the engine could have put there */
+static uint8_t DecodePiece(const uint8_t *Payload, Tetromino *Piece)
+{
+	Piece->Type = Payload[0] & 0x0F;
+	Piece->Orientation = Payload[0] >> 4;
+	Piece->Pos_x = Payload[1];
+	Piece->Pos_y = Payload[2];
+
+	return (Piece->Type < TETROMINO_TYPES)
+	    && (Piece->Orientation < TETROMINO_ORIENTATIONS)
+	    && (Piece->Pos_x < POSITIONS_X)
+	    && (Piece->Pos_y < POSITION_Y_BOTTOM);
+}
+
+uint8_t Sp_Decode(const VsReceiver *Receiver, uint8_t Kind, SpMessage *Message)
+{
+	const uint8_t *Payload = Receiver->Payload;
+	uint8_t Length = VS_LENGTH(Receiver);
+	uint8_t Index;
+
+	switch (Kind) {
+	case SP_PIECE:
+		if ((Length != 3) || !DecodePiece(Payload, &Message->Piece))
+			return VS_NONE;
+		break;
+	case SP_LOCK:
+		if ((Length != 5) || !DecodePiece(Payload, &Message->Piece))
+			return VS_NONE;
+		Message->Score = Payload[3] | (uint16_t)Payload[4] << 8;
+		break;
+	case SP_GARBAGE:
+		if ((Length != 2) || !Payload[0] || (Payload[0] > BOARD_ROWS) || (Payload[1] >= BOARD_COLUMNS))
+			return VS_NONE;
+		Message->Rows = Payload[0];
+		Message->Hole = Payload[1];
+		break;
+	case SP_BOARD:
+		if ((Length <= 3) || ((Length - 3) % sizeof(BoardRow)))
+			return VS_NONE;
+		Message->Score = Payload[0] | (uint16_t)Payload[1] << 8;
+		Message->First = Payload[2];
+		Message->Rows = (Length - 3) / sizeof(BoardRow);
+		if (Message->First + Message->Rows > BOARD_ROWS)
+			return VS_NONE;
+		memset(Message->Board, 0, sizeof(Message->Board));
+		for (Index = 0; Index < Length - 3; Index++)
+			Message->Board[Index / sizeof(BoardRow)] |= (BoardRow)Payload[3 + Index] << (8 * (Index % sizeof(BoardRow)));
+		break;
+	case SP_OVER:
+		if (Length)
+			return VS_NONE;
+		break;
+	default:
+		return VS_NONE;
+	}
+
+	Message->Kind = Kind;
+
+	return Kind;
+}
+
+void Sp_Start(SpView *View)
+{
+	Te_ClearPlayfield(View->Playfield);
+	View->Falling.Type = TETROMINO_TYPES;
+	View->Score = 0;
+	View->Known = 0;
+	View->Missed = 0;
+}
+
+/* The board turned out different from the one sent. It is not known
+ * again until it is sent whole */
+static void Miss(SpView *View)
+{
+	if (View->Known == BOARD_ROWS)
+		View->Missed++;
+	View->Known = 0;
+}
+
+void Sp_Apply(SpView *View, const SpMessage *Message)
+{
+	BoardRow *Board = PLAYFIELD_BOARD(View->Playfield);
+	const Tetromino *Piece = &Message->Piece;
+	uint8_t Cleared, Row;
+
+	switch (Message->Kind) {
+	case SP_PIECE:
+		View->Falling = *Piece;
+		break;
+
+	case SP_LOCK:
+		/* Locked as by the engine: The completed rows are removed and
+		 * squares above the board lost */
+		Te_AddTetromino(Board, Piece->Type, Piece->Orientation, Piece->Pos_x, Piece->Pos_y);
+		Cleared = Te_ClearCompletedRows(Board, Piece->Pos_y);
+		memset(View->Playfield, 0, PLAYFIELD_ROWS_HIDDEN * sizeof(BoardRow));
+		if ((uint16_t)(View->Score + Cleared) != Message->Score)
+			Miss(View);
+		View->Score = Message->Score;
+		View->Falling.Type = TETROMINO_TYPES;
+		break;
+
+	case SP_GARBAGE:
+		memmove(Board, &Board[Message->Rows], (BOARD_ROWS - Message->Rows) * sizeof(BoardRow));
+		for (Row = BOARD_ROWS - Message->Rows; Row < BOARD_ROWS; Row++)
+			Board[Row] = ROW_COMPLETED & ~((BoardRow)1 << Message->Hole);
+		break;
+
+	case SP_BOARD:
+		if (  memcmp(&Board[Message->First], Message->Board, Message->Rows * sizeof(BoardRow))
+		    || (View->Score != Message->Score))
+			Miss(View);
+		memcpy(&Board[Message->First], Message->Board, Message->Rows * sizeof(BoardRow));
+		View->Score = Message->Score;
+
+		/* The parts of the board come in from the top */
+		if (Message->First == View->Known)
+			View->Known += Message->Rows;
+		break;
+
+	case SP_OVER:
+		Te_ClearPlayfield(View->Playfield);
+		View->Falling.Type = TETROMINO_TYPES;
+		View->Score = 0;
+		break;
+
+	default:
+		break;
+	}
+}
+
+#ifdef SPECTATE
+
+#ifdef __AVR__
+
+/* On the device the viewer is on the other end of the UART. The model
+ * sends while holding it */
+#include "os.h"
+
+#define Sp_Put(Bytes, Length)						\
+	do {								\
+		uint8_t Index;						\
+									\
+		for (Index = 0; Index < (Length); Index++)		\
+			Os_UARTSend((Bytes)[Index]);			\
+	} while (0)
+#define Sp_Flush()		((void)0)
+
+#else
+
+/* Emulator: The viewer reads the file */
+#include <stdio.h>
+
+static FILE *File = NULL;
+
+int Sp_Open(const char *Path)
+{
+	File = fopen(Path, "wb");
+
+	return File != NULL;
+}
+
+#define Sp_Put(Bytes, Length)	((void)(File && fwrite((Bytes), (Length), 1, File)))
+#define Sp_Flush()		((void)(File && fflush(File)))
+
+#endif /* __AVR__ */
+
+/* Room for the frames of a round of the model. If they do not fit, the
+ * board goes out whole instead */
+#define SP_BUFFER_SIZE		32
+
+static uint8_t Buffer[SP_BUFFER_SIZE];
+static uint8_t Buffered;
+
+/* The falling tetromino last sent, the time the board was sent whole and
+ * whether it is due regardless of the time */
+static Tetromino Shown = { TETROMINO_TYPES, 0, 0, 0 };
+static uint16_t Sent;
+static uint8_t Due = 1;
+
+static void Sp_Add(const SpMessage *Message)
+{
+	if (Buffered + VS_FRAME_SIZE_MAX <= SP_BUFFER_SIZE)
+		Buffered += Sp_Encode(&Buffer[Buffered], Message);
+	else
+		Due = 1;
+}
+
+void Sp_Lock(const Tetromino *Locked, uint16_t Score)
+{
+	SpMessage Message;
+
+	Message.Kind = SP_LOCK;
+	Message.Piece = *Locked;
+	Message.Score = Score;
+	Sp_Add(&Message);
+
+	Shown.Type = TETROMINO_TYPES;
+}
+
+void Sp_Garbage(uint8_t Rows, uint8_t Hole)
+{
+	SpMessage Message;
+
+	Message.Kind = SP_GARBAGE;
+	Message.Rows = Rows;
+	Message.Hole = Hole;
+	Sp_Add(&Message);
+}
+
+void Sp_Over(void)
+{
+	SpMessage Message;
+
+	Message.Kind = SP_OVER;
+	Sp_Add(&Message);
+
+	Shown.Type = TETROMINO_TYPES;
+	Due = 1;
+}
+
+void Sp_Falling(const Tetromino *Falling)
+{
+	SpMessage Message;
+
+	if (!memcmp(&Shown, Falling, sizeof(Shown)))
+		return;
+
+	Message.Kind = SP_PIECE;
+	Message.Piece = *Falling;
+	Sp_Add(&Message);
+
+	Shown = *Falling;
+}
+
+void Sp_Send(const TetrisGame *Game, uint16_t Now)
+{
+	uint8_t Bytes[VS_FRAME_SIZE_MAX];
+	SpMessage Message;
+
+	Sp_Put(Buffer, Buffered);
+	Buffered = 0;
+
+	if (!Due && ((uint16_t)(Now - Sent) < SP_BOARD_TICKS)) {
+		Sp_Flush();
+		return;
+	}
+
+	/* The whole board and the falling tetromino last sent */
+	Message.Kind = SP_BOARD;
+	Message.Score = Game->Score;
+	for (Message.First = 0; Message.First < BOARD_ROWS; Message.First += Message.Rows) {
+		Message.Rows = BOARD_ROWS - Message.First;
+		if (Message.Rows > SP_ROWS_MAX)
+			Message.Rows = SP_ROWS_MAX;
+		memcpy(Message.Board, &TE_BOARD(Game)[Message.First], Message.Rows * sizeof(BoardRow));
+		Sp_Put(Bytes, Sp_Encode(Bytes, &Message));
+	}
+
+	if (Shown.Type < TETROMINO_TYPES) {
+		Message.Kind = SP_PIECE;
+		Message.Piece = Shown;
+		Sp_Put(Bytes, Sp_Encode(Bytes, &Message));
+	}
+
+	Sent = Now;
+	Due = 0;
+	Sp_Flush();
+}
+
+#endif /* SPECTATE */
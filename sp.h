@@ -0,0 +1,144 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * sp.h: Spectator stream: The changes of the game for watching it live
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef SP_H
+#define SP_H
+
+#include <stdint.h>
+
+#include "te.h"
+#include "vs.h"
+
+/* The game as it changes, for a viewer on the other end of the UART to
+ * draw the board as it is. The falling tetromino is sent when it moved,
+ * the board only as far as it changed: The tetromino locked, the garbage
+ * rows that came in. Now and then the whole board goes out, so a viewer
+ * that joins late or missed a frame catches up. The frames are those of
+ * vs.h, with kinds following on the ones there, so versus mode skips
+ * them. A round of the model takes a few bytes of the UART's 5760 per
+ * second, the whole board a few dozen.
+ *
+ * SP_PIECE, SP_LOCK: The type and orientation of the tetromino in the
+ * lower and upper 4 bits, its x and y position. SP_LOCK is followed by the
+ * score after the rows the tetromino completed were removed, low byte
+ * first. SP_GARBAGE: The number of rows and the column of the gap.
+ * SP_BOARD: The score, the first row and the rows from there on, low byte
+ * first. SP_OVER: Nothing, the board of the new game is empty */
+#define SP_PIECE			6
+#define SP_LOCK				7
+#define SP_GARBAGE			8
+#define SP_BOARD			9
+#define SP_OVER				10
+
+/* Rows of the board in a frame */
+#define SP_ROWS_MAX			((VS_PAYLOAD_SIZE_MAX - 3) / sizeof(BoardRow))
+
+/* Ticks of 4 ms between two frames with the whole board */
+#define SP_BOARD_TICKS			250
+
+typedef struct {
+	uint8_t Kind;
+	/* SP_PIECE and SP_LOCK only */
+	Tetromino Piece;
+	/* SP_LOCK and SP_BOARD only */
+	uint16_t Score;
+	/* SP_GARBAGE: The number of rows and the gap. SP_BOARD: The first row
+	 * and the number of rows */
+	uint8_t Rows;
+	uint8_t Hole;
+	uint8_t First;
+	BoardRow Board[SP_ROWS_MAX];
+} SpMessage;
+
+/* The game as a viewer sees it */
+typedef struct {
+	/* The board embedded into the playfield, as for the engine */
+	BoardRow Playfield[PLAYFIELD_ROWS];
+	/* Type TETROMINO_TYPES until it is known */
+	Tetromino Falling;
+	uint16_t Score;
+	/* The rows of the whole board received so far. BOARD_ROWS once the
+	 * board is known, zero again when a frame was missed */
+	uint8_t Known;
+	/* The times the board turned out different from the one sent */
+	uint16_t Missed;
+} SpView;
+
+/* Write the frame of a message. Returns its size, at most
+ * VS_FRAME_SIZE_MAX */
+extern uint8_t Sp_Encode(uint8_t *Bytes, const SpMessage *Message);
+
+/* Read the message of a frame of the given kind Vs_Unframe returned.
+ * Returns the kind, VS_NONE if the frame is none of the stream */
+extern uint8_t Sp_Decode(const VsReceiver *Receiver, uint8_t Kind, SpMessage *Message);
+
+/* Start a view. Nothing is known yet */
+extern void Sp_Start(SpView *View);
+
+/* Change the view as the message says */
+extern void Sp_Apply(SpView *View, const SpMessage *Message);
+
+#ifdef SPECTATE
+
+#ifndef __AVR__
+/* Stream into the given file, usually a pipe or one end of a pty pair.
+ * Nothing is streamed unless it is opened. Non zero on success */
+extern int Sp_Open(const char *Path);
+#endif
+
+/* Stream the lock of a tetromino and the score after it */
+extern void Sp_Lock(const Tetromino *Locked, uint16_t Score);
+
+/* Stream garbage rows with a gap in the given column */
+extern void Sp_Garbage(uint8_t Rows, uint8_t Hole);
+
+/* Stream the end of the game. The new one goes out whole */
+extern void Sp_Over(void);
+
+/* Stream the falling tetromino at the end of a round, if it moved */
+extern void Sp_Falling(const Tetromino *Falling);
+
+/* Pass the stream on, with the whole board if it is due. Called by the
+ * model, which is the only one to change the board, with the time in
+ * ticks */
+extern void Sp_Send(const TetrisGame *Game, uint16_t Now);
+
+#else
+
+/* The stream compiles to nothing if it is not wanted */
+#define Sp_Lock(Locked, Score)		((void)(Locked), (void)(Score))
+#define Sp_Garbage(Rows, Hole)		((void)(Rows), (void)(Hole))
+#define Sp_Over()			((void)0)
+#define Sp_Falling(Falling)		((void)(Falling))
+#define Sp_Send(Game, Now)		((void)(Game), (void)(Now))
+
+#endif /* SPECTATE */
+
+#endif /* SP_H */
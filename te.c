@@ -0,0 +1,710 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * te.c: Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(Address)		(*(const uint8_t *)(Address))
+#endif
+
+#include "te.h"
+
+/* Fetch a row of the board's width from flash */
+#ifndef __AVR__
+#define pgm_read_row(Address)		(*(const BoardRow *)(Address))
+#elif BOARD_ROW_BITS == 8
+#define pgm_read_row(Address)		pgm_read_byte(Address)
+#elif BOARD_ROW_BITS == 16
+#define pgm_read_row(Address)		pgm_read_word(Address)
+#else
+#define pgm_read_row(Address)		pgm_read_dword(Address)
+#endif
+
+/* Shifted tetromino and bottom profile tables generated by mktables from the tetromino bitmaps */
+#include "tables.h"
+
+#ifdef ZOBRIST_HASH
+
+/* 64 bit constant without the long long suffix that C89 does not know */
+#define HASH_CONSTANT(High, Low)	(((TeHash)(High) << 32) | (Low))
+
+/* Key numbers of the falling tetrominoes start after those of the squares */
+#define KEYS_FALLING			(BOARD_ROWS * BOARD_COLUMNS)
+
+/* The finalizer of splitmix64. It spreads consecutive numbers all over the
+ * 64 bits, so there is no table of keys to initialize or keep */
+TeHash Te_HashKey(uint32_t Number)
+{
+	TeHash Key = Number + HASH_CONSTANT(0x9E3779B9, 0x7F4A7C15);
+
+	Key = (Key ^ (Key >> 30)) * HASH_CONSTANT(0xBF58476D, 0x1CE4E5B9);
+	Key = (Key ^ (Key >> 27)) * HASH_CONSTANT(0x94D049BB, 0x133111EB);
+
+	return Key ^ (Key >> 31);
+}
+
+/* Keys of the locked squares of a row. Rows above the board lose their
+ * squares and are not hashed */
+static TeHash HashRow(BoardRow Squares, int8_t Row)
+{
+	TeHash Hash = 0;
+	uint8_t Column;
+
+	if (Row < 0)
+		return 0;
+
+	for (Column = 0; Squares; Column++, Squares >>= 1)
+		if (Squares & 1)
+			Hash ^= Te_HashKey(Row * BOARD_COLUMNS + Column);
+
+	return Hash;
+}
+
+static TeHash HashFalling(const Tetromino *Falling)
+{
+	return Te_HashKey(KEYS_FALLING + ((((uint32_t)Falling->Type * TETROMINO_ORIENTATIONS + Falling->Orientation) * POSITIONS_X + Falling->Pos_x) << 8) + Falling->Pos_y);
+}
+
+static TeHash HashBoard(const BoardRow *Board)
+{
+	TeHash Hash = 0;
+	uint8_t Row;
+
+	for (Row = 0; Row < BOARD_ROWS; Row++)
+		Hash ^= HashRow(Board[Row], Row);
+
+	return Hash;
+}
+
+/* The squares a tetromino locked at its position */
+static TeHash HashTetromino(const Tetromino *Locked)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Locked->Type][Locked->Orientation][Locked->Pos_x];
+	TeHash Hash = 0;
+	uint8_t Row;
+
+	for (Row = 0; Row < TETROMINO_HEIGHT; Row++)
+		Hash ^= HashRow(pgm_read_row(&Shifted->Row[Row]), Locked->Pos_y - Row);
+
+	return Hash;
+}
+
+TeHash Te_Hash(const TetrisGame *Game)
+{
+	return HashBoard(TE_BOARD(Game)) ^ HashFalling(&Game->Falling);
+}
+
+/* Take the falling tetromino out of the hash before it changes and put
+ * it back in after */
+#define HASH_FALLING(Game)		((Game)->Hash ^= HashFalling(&(Game)->Falling))
+
+/* A tetromino locked. The rows that moved down are hashed anew */
+#define HASH_LOCKED(Game, Cleared)	((Game)->Hash = (Cleared) ? HashBoard(TE_BOARD(Game)) : (Game)->Hash ^ HashTetromino(&(Game)->Falling))
+
+#else
+#define HASH_FALLING(Game)
+#define HASH_LOCKED(Game, Cleared)
+#endif /* ZOBRIST_HASH */
+
+/* Empty the board, the rows above it and put the floor below it */
+void Te_ClearPlayfield(BoardRow *Playfield)
+{
+	memset(Playfield, 0, (PLAYFIELD_ROWS - 1) * sizeof(BoardRow));
+	Playfield[PLAYFIELD_ROWS - 1] = ROW_COMPLETED;
+}
+
+/* Seed zero would keep the generator at zero forever */
+void Te_SeedBag(TetrominoBag *Bag, uint16_t Seed)
+{
+	Bag->Seed = Seed;
+	Bag->State = Seed ? Seed : 1;
+	Bag->Remaining = 0;
+}
+
+/* A 16 bit xorshift generator (shifts 7, 9, 8) runs through all non zero
+ * states. The high byte of the state picks one of the types left in the bag
+ * by an 8 x 8 bit multiplication rather than a division, the AVR has no
+ * instruction for the latter */
+uint8_t Te_NextTetromino(TetrominoBag *Bag)
+{
+	uint16_t State = Bag->State;
+	uint8_t Count, Index, Type;
+
+	State ^= State << 7;
+	State ^= State >> 9;
+	State ^= State << 8;
+	Bag->State = State;
+
+	if (!Bag->Remaining)
+		Bag->Remaining = BAG_FULL;
+
+	for (Count = 0, Type = Bag->Remaining; Type; Type &= Type - 1)
+		Count++;
+
+	Index = ((uint16_t)(uint8_t)(State >> 8) * Count) >> 8;
+
+	for (Type = 0; ; Type++) {
+		if (Bag->Remaining & (1 << Type)) {
+			if (!Index)
+				break;
+			Index--;
+		}
+	}
+
+	Bag->Remaining &= ~(1 << Type);
+
+	return Type;
+}
+
+/* A tetromino is represented as a 4x4 bitmap. Its rows are looked up already
+ * shifted to the x position, so detecting a collision resumes to checking if
+ * there is any bit superposition between the rows of the tetromino and the
+ * rows of the board, plus the "blocked" mask that is set where the tetromino
+ * would stick out of the board. The rows around the board take care of the
+ * top and the bottom. No branches, no shifts */
+BoardRow Te_DetectCollision(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Type][Orientation][Pos_x];
+	const BoardRow *Rows = &Board[Pos_y];
+
+	return (Rows[0] & pgm_read_row(&Shifted->Row[0]))
+	     | (Rows[-1] & pgm_read_row(&Shifted->Row[1]))
+	     | (Rows[-2] & pgm_read_row(&Shifted->Row[2]))
+	     | (Rows[-3] & pgm_read_row(&Shifted->Row[3]))
+	     | pgm_read_row(&Shifted->Blocked);
+}
+
+/* Place a tetromino on the board. Rows that end up above the board go to the
+ * hidden rows of the playfield */
+void Te_AddTetromino(BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Type][Orientation][Pos_x];
+	BoardRow *Rows = &Board[Pos_y];
+
+	Rows[0] |= pgm_read_row(&Shifted->Row[0]);
+	Rows[-1] |= pgm_read_row(&Shifted->Row[1]);
+	Rows[-2] |= pgm_read_row(&Shifted->Row[2]);
+	Rows[-3] |= pgm_read_row(&Shifted->Row[3]);
+}
+
+/* Let the tetromino fall until it hits something. The masks are fetched once,
+ * then each row further down costs four "bitwise and" operations. The floor
+ * row below the board ends the descent at the latest. The tetromino must not
+ * collide at the given position */
+uint8_t Te_LandingRow(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Type][Orientation][Pos_x];
+	const BoardRow Row0 = pgm_read_row(&Shifted->Row[0]);
+	const BoardRow Row1 = pgm_read_row(&Shifted->Row[1]);
+	const BoardRow Row2 = pgm_read_row(&Shifted->Row[2]);
+	const BoardRow Row3 = pgm_read_row(&Shifted->Row[3]);
+	const BoardRow *Rows = &Board[Pos_y];
+
+	while (!( (Rows[1] & Row0)
+		| (Rows[0] & Row1)
+		| (Rows[-1] & Row2)
+		| (Rows[-2] & Row3))) {
+		Rows++;
+		Pos_y++;
+	}
+
+	return Pos_y;
+}
+
+/* Only the rows the tetromino just locked on can have been completed. They
+ * are compacted bottom up, the rows above them then move down by the number
+ * of removed rows in the same pass. Above the first empty row there is
+ * nothing left to move, only the rows vacated below it are emptied */
+uint8_t Te_ClearCompletedRows(BoardRow *Board, uint8_t Pos_y)
+{
+	const uint8_t Top = (Pos_y < TETROMINO_HEIGHT - 1) ? 0 : Pos_y - (TETROMINO_HEIGHT - 1);
+	uint8_t Src = Pos_y + 1, Dst = Pos_y + 1, Cleared;
+
+	while (Src > Top) {
+		Src--;
+		if (Board[Src] != ROW_COMPLETED)
+			Board[--Dst] = Board[Src];
+	}
+
+	Cleared = Dst - Src;
+	if (!Cleared)
+		return 0;
+
+	while (Src > 0) {
+		Src--;
+		Board[--Dst] = Board[Src];
+		if (Board[Src] == ROW_EMPTY)
+			break;
+	}
+
+	while (Dst > Src)
+		Board[--Dst] = ROW_EMPTY;
+
+	return Cleared;
+}
+
+/* Each row from the top down contributes the columns that were not seen
+ * occupied in the rows above it */
+void Te_ColumnHeights(const BoardRow *Board, uint8_t *Heights)
+{
+	BoardRow Seen = ROW_EMPTY, Topmost;
+	uint8_t Row, Column;
+
+	memset(Heights, 0, BOARD_COLUMNS);
+
+	for (Row = 0; (Row < BOARD_ROWS) && (Seen != ROW_COMPLETED); Row++) {
+		Topmost = Board[Row] & ~Seen;
+		for (Column = 0; Topmost; Column++, Topmost >>= 1)
+			if (Topmost & 1)
+				Heights[Column] = BOARD_ROWS - Row;
+		Seen |= Board[Row];
+	}
+}
+
+/* Nothing above the topmost square of a column is in the way, so each column
+ * of the tetromino can drop until its lowest square sits on top of it. The
+ * tetromino lands where the first of its columns does. If that is above the
+ * tetromino's current position it was slid below an overhang. Only then the
+ * tetromino is let fall row by row */
+uint8_t Te_GhostRow(const BoardRow *Board, const uint8_t *Heights, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const uint8_t *Bottoms = TetrominoBottoms[Type][Orientation];
+	uint8_t Column, Bottom;
+	int16_t Row, Landing = BOARD_ROWS;
+
+	/* Signed, a full column would have the tetromino land above the board */
+	for (Column = 0; Column < TEROMINO_WIDTH; Column++) {
+		Bottom = pgm_read_byte(&Bottoms[Column]);
+		if (Bottom != NO_SQUARE) {
+			Row = BOARD_ROWS - 1 - (int16_t)Heights[Pos_x + Column] + Bottom;
+			if (Row < Landing)
+				Landing = Row;
+		}
+	}
+
+	if (Landing < Pos_y)
+		return Te_LandingRow(Board, Type, Orientation, Pos_x, Pos_y);
+
+	return Landing;
+}
+
+/* Per column of the tetromino: If its squares end up above the column's
+ * topmost square the free squares in between become holes and the column
+ * grows. Otherwise the tetromino was slid below an overhang and fills
+ * holes. Squares above the board are lost and change nothing */
+uint8_t Te_AccountTetromino(uint8_t *Heights, uint16_t *Holes, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const uint8_t *Bottoms = TetrominoBottoms[Type][Orientation];
+	const uint8_t *Tops = TetrominoTops[Type][Orientation];
+	uint8_t Column, Bottom, Lowest, Highest, Lost = 0;
+
+	for (Column = 0; Column < TEROMINO_WIDTH; Column++) {
+		Bottom = pgm_read_byte(&Bottoms[Column]);
+		if (Bottom == NO_SQUARE)
+			continue;
+
+		/* The heights the column would have with its topmost square
+		 * being the lowest and highest square of the tetromino */
+		Lowest = BOARD_ROWS - Pos_y + Bottom;
+		Highest = BOARD_ROWS - Pos_y + pgm_read_byte(&Tops[Column]);
+
+		if (Highest > BOARD_ROWS)
+			Lost = 1;
+
+		if (Lowest > BOARD_ROWS)
+			continue;
+
+		if (Lowest > Heights[Pos_x + Column]) {
+			*Holes += Lowest - Heights[Pos_x + Column] - 1;
+			Heights[Pos_x + Column] = (Highest > BOARD_ROWS) ? BOARD_ROWS : Highest;
+		} else {
+			*Holes -= Highest - Lowest + 1;
+		}
+	}
+
+	return Lost;
+}
+
+/* Completed rows are those the tetromino fills up */
+uint8_t Te_CompletedRows(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Type][Orientation][Pos_x];
+	const BoardRow *Rows = &Board[Pos_y];
+	uint8_t Row, Completed = 0;
+
+	for (Row = 0; Row < TETROMINO_HEIGHT; Row++)
+		if ((Rows[-Row] | pgm_read_row(&Shifted->Row[Row])) == ROW_COMPLETED)
+			Completed++;
+
+	return Completed;
+}
+
+/* Remove a tetromino from the board */
+void Te_RemoveTetromino(BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y)
+{
+	const ShiftedTetromino *Shifted = &ShiftedTetrominoes[Type][Orientation][Pos_x];
+	BoardRow *Rows = &Board[Pos_y];
+
+	Rows[0] &= ~pgm_read_row(&Shifted->Row[0]);
+	Rows[-1] &= ~pgm_read_row(&Shifted->Row[1]);
+	Rows[-2] &= ~pgm_read_row(&Shifted->Row[2]);
+	Rows[-3] &= ~pgm_read_row(&Shifted->Row[3]);
+}
+
+/* Completed rows are about to be removed. Every column has a square in
+ * each of them, so a column whose topmost square is not in one of them
+ * just gets lower by their number. Otherwise its topmost square is looked
+ * for further down, and the free squares passed on the way are no longer
+ * holes */
+static void AccountCompletedRows(TetrisGame *Game, uint8_t Completed)
+{
+	const BoardRow *Board = TE_BOARD(Game);
+	uint8_t Column, Row, Passed;
+
+	for (Column = 0; Column < BOARD_COLUMNS; Column++) {
+		Row = BOARD_ROWS - Game->Heights[Column];
+		if (Board[Row] != ROW_COMPLETED) {
+			Game->Heights[Column] -= Completed;
+			continue;
+		}
+
+		for (Passed = 0; Row < BOARD_ROWS; Row++) {
+			if (Board[Row] == ROW_COMPLETED)
+				Passed++;
+			else if (Board[Row] & ((BoardRow)1 << Column))
+				break;
+			else
+				Game->Holes--;
+		}
+
+		Game->Heights[Column] = BOARD_ROWS - Row - (Completed - Passed);
+	}
+}
+
+/* The wells of the columns from First to Last, which may be beyond the
+ * board. Each depends on the heights of its neighbours */
+static void UpdateWells(TetrisGame *Game, int8_t First, int8_t Last)
+{
+	uint8_t Left, Right, Lower;
+
+	if (First < 0)
+		First = 0;
+	if (Last > BOARD_COLUMNS - 1)
+		Last = BOARD_COLUMNS - 1;
+
+	for (; First <= Last; First++) {
+		Left = (First < BOARD_COLUMNS - 1) ? Game->Heights[First + 1] : BOARD_ROWS;
+		Right = (First > 0) ? Game->Heights[First - 1] : BOARD_ROWS;
+		Lower = (Left < Right) ? Left : Right;
+		Game->Wells[First] = (Lower > Game->Heights[First]) ? Lower - Game->Heights[First] : 0;
+	}
+}
+
+/* Follow the falling tetromino with its ghost. Falling further down does not
+ * move the ghost, so only the other changes need to be looked for. A changed
+ * board is signalled by an invalid type */
+static void UpdateGhost(TetrisGame *Game)
+{
+	Tetromino *Falling = &Game->Falling;
+	Tetromino *Ghost = &Game->Ghost;
+
+	if (  (Ghost->Type != Falling->Type)
+	    || (Ghost->Orientation != Falling->Orientation)
+	    || (Ghost->Pos_x != Falling->Pos_x)) {
+		Ghost->Type = Falling->Type;
+		Ghost->Orientation = Falling->Orientation;
+		Ghost->Pos_x = Falling->Pos_x;
+		Ghost->Pos_y = Te_GhostRow(TE_BOARD(Game), Game->Heights, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y);
+	}
+}
+
+BoardRow Te_NewTetromino(TetrisGame *Game)
+{
+	Tetromino *Falling = &Game->Falling;
+
+	Falling->Type = Te_NextTetromino(&Game->Bag);
+	Falling->Orientation = UP;
+	Falling->Pos_x = POSITION_X_CENTER;
+	Falling->Pos_y = POSITION_Y_TOP;
+	HASH_FALLING(Game);
+
+	Game->Ghost.Type = TETROMINO_TYPES;
+	UpdateGhost(Game);
+
+	return Te_DetectCollision(TE_BOARD(Game), Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y);
+}
+
+void Te_NewGame(TetrisGame *Game, uint16_t Seed)
+{
+	Te_ClearPlayfield(Game->Playfield);
+	memset(Game->Heights, 0, sizeof(Game->Heights));
+	memset(Game->Wells, 0, sizeof(Game->Wells));
+	Game->Holes = 0;
+	Te_SeedBag(&Game->Bag, Seed);
+	Game->Score = 0;
+#ifdef ZOBRIST_HASH
+	Game->Hash = 0;
+#endif
+	Te_NewTetromino(Game);
+}
+
+/* Move to the given x position and orientation if there is no collision */
+static uint8_t Move(TetrisGame *Game, uint8_t Orientation, uint8_t Pos_x)
+{
+	Tetromino *Falling = &Game->Falling;
+
+	if (Te_DetectCollision(TE_BOARD(Game), Falling->Type, Orientation, Pos_x, Falling->Pos_y))
+		return 0;
+
+	HASH_FALLING(Game);
+	Falling->Orientation = Orientation;
+	Falling->Pos_x = Pos_x;
+	HASH_FALLING(Game);
+	UpdateGhost(Game);
+
+	return 1;
+}
+
+/* Column 0 is the rightmost one. Moving left of the board is caught as
+ * collision, the x positions beyond it are marked blocked */
+uint8_t Te_MoveLeft(TetrisGame *Game)
+{
+	return Move(Game, Game->Falling.Orientation, Game->Falling.Pos_x + 1);
+}
+
+uint8_t Te_MoveRight(TetrisGame *Game)
+{
+	if (Game->Falling.Pos_x == 0)
+		return 0;
+
+	return Move(Game, Game->Falling.Orientation, Game->Falling.Pos_x - 1);
+}
+
+/* Orientation is cycled between the 4 allowed values */
+uint8_t Te_Rotate(TetrisGame *Game)
+{
+	return Move(Game, (Game->Falling.Orientation + 1) % TETROMINO_ORIENTATIONS, Game->Falling.Pos_x);
+}
+
+/* The ghost already is where the tetromino lands */
+void Te_HardDrop(TetrisGame *Game)
+{
+	HASH_FALLING(Game);
+	Game->Falling.Pos_y = Game->Ghost.Pos_y;
+	HASH_FALLING(Game);
+}
+
+uint8_t Te_Step(TetrisGame *Game)
+{
+	Tetromino *Falling = &Game->Falling;
+	BoardRow *Board = TE_BOARD(Game);
+	uint8_t Result, Row;
+
+	if (!Te_DetectCollision(Board, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y + 1)) {
+		HASH_FALLING(Game);
+		Falling->Pos_y++;
+		HASH_FALLING(Game);
+		return 0;
+	}
+
+	/* The tetromino can not fall any further. Lock it on the board */
+	Te_AddTetromino(Board, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y);
+	Te_AccountTetromino(Game->Heights, &Game->Holes, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y);
+
+	/* Adding the tetromino once more does not change the board but tells
+	 * which rows it completed */
+	Result = Te_CompletedRows(Board, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y);
+	if (Result) {
+		AccountCompletedRows(Game, Result);
+		Te_ClearCompletedRows(Board, Falling->Pos_y);
+		UpdateWells(Game, 0, BOARD_COLUMNS - 1);
+	} else {
+		UpdateWells(Game, Falling->Pos_x - 1, Falling->Pos_x + TEROMINO_WIDTH);
+	}
+
+	Game->Score += Result;
+	HASH_FALLING(Game);
+	HASH_LOCKED(Game, Result);
+	Result |= TE_LOCKED;
+
+	/* Squares that locked above the board are lost */
+	for (Row = 0; Row < PLAYFIELD_ROWS_HIDDEN; Row++)
+		if (Game->Playfield[Row] != ROW_EMPTY)
+			Result |= TE_OVERFLOW;
+	memset(Game->Playfield, 0, PLAYFIELD_ROWS_HIDDEN * sizeof(BoardRow));
+
+	/* If the new tetromino collides right away the game has ended */
+	if (Te_NewTetromino(Game))
+		Result |= TE_GAME_OVER;
+
+	return Result;
+}
+
+/* The free squares below the topmost square of each column */
+static uint16_t CountHoles(const BoardRow *Board, const uint8_t *Heights)
+{
+	uint16_t Holes = 0;
+	uint8_t Column, Row;
+
+	for (Column = 0; Column < BOARD_COLUMNS; Column++)
+		for (Row = BOARD_ROWS - Heights[Column]; Row < BOARD_ROWS; Row++)
+			if (!(Board[Row] & ((BoardRow)1 << Column)))
+				Holes++;
+
+	return Holes;
+}
+
+/* The rows of the board move up in one go and the garbage fills the rows
+ * vacated at the bottom. Every column with a square gets higher by the
+ * number of rows, the one with the gap also gets a hole for each row.
+ * Only if squares are pushed off the top everything is counted anew */
+uint8_t Te_AddGarbage(TetrisGame *Game, uint8_t Rows, uint8_t Hole)
+{
+	Tetromino *Falling = &Game->Falling;
+	BoardRow *Board = TE_BOARD(Game);
+	BoardRow Garbage = ROW_COMPLETED & ~((BoardRow)1 << Hole);
+	uint8_t Result = 0, Column, Row;
+
+	if (Rows > BOARD_ROWS)
+		Rows = BOARD_ROWS;
+	if (!Rows)
+		return 0;
+
+	HASH_FALLING(Game);
+
+	for (Row = 0; Row < Rows; Row++)
+		if (Board[Row] != ROW_EMPTY)
+			Result = TE_OVERFLOW | TE_GAME_OVER;
+
+	memmove(Board, &Board[Rows], (BOARD_ROWS - Rows) * sizeof(BoardRow));
+	for (Row = BOARD_ROWS - Rows; Row < BOARD_ROWS; Row++)
+		Board[Row] = Garbage;
+
+	if (Result) {
+		Te_ColumnHeights(Board, Game->Heights);
+		Game->Holes = CountHoles(Board, Game->Heights);
+	} else {
+		for (Column = 0; Column < BOARD_COLUMNS; Column++) {
+			if (Game->Heights[Column]) {
+				Game->Heights[Column] += Rows;
+				if (Column == Hole)
+					Game->Holes += Rows;
+			} else if (Column != Hole) {
+				Game->Heights[Column] = Rows;
+			}
+		}
+	}
+	UpdateWells(Game, 0, BOARD_COLUMNS - 1);
+
+	/* The falling tetromino makes way by moving up as far as needed */
+	while (Falling->Pos_y && Te_DetectCollision(Board, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y))
+		Falling->Pos_y--;
+	if (Te_DetectCollision(Board, Falling->Type, Falling->Orientation, Falling->Pos_x, Falling->Pos_y))
+		Result |= TE_GAME_OVER;
+
+	HASH_LOCKED(Game, Rows);
+	HASH_FALLING(Game);
+
+	Game->Ghost.Type = TETROMINO_TYPES;
+	UpdateGhost(Game);
+
+	return Result;
+}
+
+void Te_Pack(const TetrisGame *Game, TePacked *Packed)
+{
+	memcpy(Packed->Board, TE_BOARD(Game), sizeof(Packed->Board));
+	Packed->Falling = Game->Falling;
+	Packed->Bag = Game->Bag;
+	Packed->Score = Game->Score;
+}
+
+void Te_Unpack(TetrisGame *Game, const TePacked *Packed)
+{
+	BoardRow *Board = TE_BOARD(Game);
+
+	Te_ClearPlayfield(Game->Playfield);
+	memcpy(Board, Packed->Board, sizeof(Packed->Board));
+	Game->Falling = Packed->Falling;
+	Game->Bag = Packed->Bag;
+	Game->Score = Packed->Score;
+
+	Te_ColumnHeights(Board, Game->Heights);
+	Game->Holes = CountHoles(Board, Game->Heights);
+	UpdateWells(Game, 0, BOARD_COLUMNS - 1);
+
+	Game->Ghost.Type = TETROMINO_TYPES;
+	UpdateGhost(Game);
+#ifdef ZOBRIST_HASH
+	Game->Hash = Te_Hash(Game);
+#endif
+}
+
+/* The ghost already knows where the tetromino lands, so any number of rows
+ * costs the same. The fall ends there even if more rows were due, the
+ * lock waits for the next row due, as with Te_Step */
+uint8_t Te_Fall(TetrisGame *Game, uint8_t Rows)
+{
+	Tetromino *Falling = &Game->Falling;
+
+	if (Falling->Pos_y == Game->Ghost.Pos_y)
+		return Te_Step(Game);
+
+	HASH_FALLING(Game);
+	Falling->Pos_y = (Game->Ghost.Pos_y - Falling->Pos_y > Rows) ? Falling->Pos_y + Rows : Game->Ghost.Pos_y;
+	HASH_FALLING(Game);
+
+	return 0;
+}
+
+uint8_t Te_RowsDue(uint16_t *Fraction, TeGravity Gravity, uint8_t Ticks)
+{
+	TeGravity Fallen = *Fraction + Gravity * Ticks;
+
+	*Fraction = (uint16_t)(Fallen & (TE_GRAVITY_ONE - 1));
+	Fallen >>= TE_GRAVITY_SHIFT;
+
+	return (Fallen > 255) ? 255 : (uint8_t)Fallen;
+}
+
+uint8_t Te_TicksToRow(uint16_t Fraction, TeGravity Gravity)
+{
+	TeGravity Ticks;
+
+	if (!Gravity)
+		return 255;
+
+	Ticks = (TE_GRAVITY_ONE - Fraction + Gravity - 1) / Gravity;
+
+	return (Ticks > 255) ? 255 : (Ticks ? (uint8_t)Ticks : 1);
+}
@@ -0,0 +1,325 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * te.h: Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef TE_H
+#define TE_H
+
+#include <stdint.h>
+
+/* Tetris game board. I selected 8 x 16 instead of the more common 10 x 20.
+ * Rationale: Be able to easily represent the board as a matrix of bits
+ * that nicely fits on byte boundaries. README.md has the details.
+ * Other dimensions can be selected at build time, e.g. 10 x 20 with
+ * FEATURES="-DBOARD_COLUMNS=10 -DBOARD_ROWS=20"
+ */
+#ifndef BOARD_COLUMNS
+#define BOARD_COLUMNS			8
+#endif
+#ifndef BOARD_ROWS
+#define BOARD_ROWS			16
+#endif
+
+/* A row of the board is held by the smallest unsigned integer type its
+ * columns fit into. One bit per column, the rightmost column in bit 0 */
+#if BOARD_COLUMNS <= 8
+typedef uint8_t BoardRow;
+#define BOARD_ROW_BITS			8
+#elif BOARD_COLUMNS <= 16
+typedef uint16_t BoardRow;
+#define BOARD_ROW_BITS			16
+#elif BOARD_COLUMNS <= 32
+typedef uint32_t BoardRow;
+#define BOARD_ROW_BITS			32
+#else
+#error "BOARD_COLUMNS must not exceed 32"
+#endif
+
+/* There are seven types of tetrominones. See README.md for details */
+#define TETROMINO_TYPES			7
+
+/* Orientations of a tetromino. The four cardinal directions */
+#define TETROMINO_ORIENTATIONS		4
+
+/* The width of the square in which a tetromino fits */
+#define TEROMINO_WIDTH			4
+
+/* And its height */
+#define TETROMINO_HEIGHT		4
+
+/* Board X center */
+#define POSITION_X_CENTER		((BOARD_COLUMNS - TEROMINO_WIDTH) / 2)
+
+/* Board Y positions min/max */
+#define POSITION_Y_TOP			0
+#define POSITION_Y_BOTTOM		BOARD_ROWS
+
+/* A completed row - all squares (bits) are occupied */
+#define ROW_COMPLETED			((BoardRow)((BoardRow)~(BoardRow)0 >> (BOARD_ROW_BITS - BOARD_COLUMNS)))
+/* And none are occupied in an empty row */
+#define ROW_EMPTY			((BoardRow)0)
+
+/* Possible tetromino orientations in space */
+enum {
+         UP
+        ,RIGHT
+        ,DOWN
+        ,LEFT
+};
+
+/* The board is embedded into a playfield that has always empty rows above the
+ * top row of the board and a completely occupied row below its bottom row.
+ * This way a tetromino can be checked against or placed on the board at any
+ * y position from POSITION_Y_TOP to POSITION_Y_BOTTOM without bounds checks.
+ * Rows above the board are not displayed and never hold locked squares */
+#define PLAYFIELD_ROWS_HIDDEN		(TETROMINO_HEIGHT - 1)
+#define PLAYFIELD_ROWS			(PLAYFIELD_ROWS_HIDDEN + BOARD_ROWS + 1)
+
+/* Get the board (its top row) from the playfield it is embedded in */
+#define PLAYFIELD_BOARD(Playfield)	(&(Playfield)[PLAYFIELD_ROWS_HIDDEN])
+
+/* Marks a column of a tetromino's bitmap that has no square */
+#define NO_SQUARE			0xFF
+
+/* Number of x positions a tetromino can be checked at. One beyond the
+ * rightmost column so that a move there can be detected as collision */
+#define POSITIONS_X			(BOARD_COLUMNS + 1)
+
+/* A tetromino of a given type and orientation, already shifted to a given
+ * x position. Rows are ordered bottom up, like the board is addressed from
+ * the y position of the tetromino */
+typedef struct {
+	/* The tetromino's squares for each row */
+	BoardRow Row[TETROMINO_HEIGHT];
+	/* ROW_COMPLETED if the tetromino sticks out of the board
+	 * at this x position, ROW_EMPTY otherwise */
+	BoardRow Blocked;
+} ShiftedTetromino;
+
+/* All tetromino types, one bit each */
+#define BAG_FULL			((1 << TETROMINO_TYPES) - 1)
+
+/* Hands out the tetromino types. Each "bag" holds every type once and is
+ * emptied in random order before the next one is opened, so no type is
+ * missing for long. The random numbers come from a 16 bit xorshift
+ * generator. Seed and State fully determine the sequence of types to come */
+typedef struct {
+	/* The seed the generator was started from */
+	uint16_t Seed;
+	/* The generator's current state. Never zero */
+	uint16_t State;
+	/* Types still in the bag, one bit each */
+	uint8_t Remaining;
+} TetrominoBag;
+
+/* A tetromino on the board */
+typedef struct {
+	/* Type of the tetromino (there are 7 types) */
+	uint8_t Type;
+	/* Its orientation */
+	uint8_t Orientation;
+	/* Location on the board. Pos_y is the bottom row of the 4x4 square
+	 * the tetromino fits in */
+	uint8_t Pos_x;
+	uint8_t Pos_y;
+} Tetromino;
+
+#ifdef ZOBRIST_HASH
+/* Zobrist hash: The XOR of a random key for each locked square on the board
+ * and one for the type, orientation and position of the falling tetromino.
+ * Every change of the game updates it with a few XORs, only removing rows
+ * rehashes the board. Built for the host tools with FEATURES=-DZOBRIST_HASH,
+ * the device has no use for it */
+typedef uint64_t TeHash;
+
+/* Key numbers from this one on are not used by the engine */
+#define TE_HASH_FREE			(BOARD_ROWS * BOARD_COLUMNS + ((uint32_t)TETROMINO_TYPES * TETROMINO_ORIENTATIONS * POSITIONS_X << 8))
+#endif
+
+/* Everything there is to know about a game. Contains no references to
+ * anything outside of it, so it can be copied, compared and stored */
+typedef struct {
+	/* The board embedded into the playfield */
+	BoardRow Playfield[PLAYFIELD_ROWS];
+	/* Heights of the board's columns, the free squares below the topmost
+	 * square of their column and how far each column lies below the
+	 * lower of its neighbours, the walls counting as full. Kept up to date
+	 * by the engine as tetrominoes lock and rows are removed. Read only */
+	uint8_t Heights[BOARD_COLUMNS];
+	uint16_t Holes;
+	uint8_t Wells[BOARD_COLUMNS];
+	/* The falling tetromino */
+	Tetromino Falling;
+	/* Where the falling tetromino would land */
+	Tetromino Ghost;
+	/* Where the tetromino types come from */
+	TetrominoBag Bag;
+	/* Completed rows so far */
+	uint16_t Score;
+#ifdef ZOBRIST_HASH
+	/* Hash of the board and the falling tetromino */
+	TeHash Hash;
+#endif
+} TetrisGame;
+
+/* Get the board of a game */
+#define TE_BOARD(Game)			PLAYFIELD_BOARD((Game)->Playfield)
+
+/* The part of a game the rest follows from: The board, the falling
+ * tetromino, the bag and the score. A fraction of the size of the game, for
+ * taking many snapshots. Rows above the board are empty between steps and
+ * not kept */
+typedef struct {
+	BoardRow Board[BOARD_ROWS];
+	Tetromino Falling;
+	TetrominoBag Bag;
+	uint16_t Score;
+} TePacked;
+
+/* Gravity: The rows per tick the falling tetromino falls, as fixed point
+ * number with TE_GRAVITY_SHIFT fraction bits. TE_GRAVITY(1, 250) is a row
+ * every 250 ticks, TE_GRAVITY(20, 1) is "20G": The tetromino is down as soon
+ * as it comes in. Rounded up, so a row is due after the given ticks. Up to
+ * 64 rows per tick */
+typedef uint32_t TeGravity;
+
+#define TE_GRAVITY_SHIFT		16
+#define TE_GRAVITY_ONE			((TeGravity)1 << TE_GRAVITY_SHIFT)
+#define TE_GRAVITY(Rows, Ticks)		((((TeGravity)(Rows) << TE_GRAVITY_SHIFT) + (Ticks) - 1) / (Ticks))
+
+/* Outcome of a step of the game. The number of completed rows in the
+ * lower bits, the flags in the upper ones. TE_OVERFLOW tells that squares
+ * were locked above the board and got lost */
+#define TE_CLEARED			0x07
+#define TE_LOCKED			0x10
+#define TE_GAME_OVER			0x20
+#define TE_OVERFLOW			0x40
+
+/* Start a new game. The seed selects the sequence of tetromino types */
+extern void Te_NewGame(TetrisGame *Game, uint16_t Seed);
+
+/* Bring in the next tetromino from the bag at the top of the board. Non
+ * zero if there is no room for it, i.e. the game is over. Te_Step does
+ * this after a lock */
+extern BoardRow Te_NewTetromino(TetrisGame *Game);
+
+/* Move the falling tetromino one column to the left or right or rotate it
+ * clockwise. Non zero if it was possible */
+extern uint8_t Te_MoveLeft(TetrisGame *Game);
+extern uint8_t Te_MoveRight(TetrisGame *Game);
+extern uint8_t Te_Rotate(TetrisGame *Game);
+
+/* Put the falling tetromino where it lands. The next step locks it */
+extern void Te_HardDrop(TetrisGame *Game);
+
+/* Let the falling tetromino fall by one row or lock it if it can not, then
+ * bring in the next one. Returns the TE_ flags and number of rows completed */
+extern uint8_t Te_Step(TetrisGame *Game);
+
+/* Let the falling tetromino fall by up to the given number of rows, at
+ * least one, in one go and no further than it lands. If it already rests
+ * on something it is locked as by Te_Step. Returns what Te_Step returns */
+extern uint8_t Te_Fall(TetrisGame *Game, uint8_t Rows);
+
+/* Push the board up by the given number of rows and fill them with garbage:
+ * Full rows but for the given column. Squares pushed off the top end the
+ * game, as does a falling tetromino that can not make way. Returns the TE_
+ * flags */
+extern uint8_t Te_AddGarbage(TetrisGame *Game, uint8_t Rows, uint8_t Hole);
+
+/* Let ticks pass at the given gravity. Fraction is the part of a row
+ * fallen so far, in units of 1 / TE_GRAVITY_ONE, and is kept up to date.
+ * Returns the whole rows due, at most 255 */
+extern uint8_t Te_RowsDue(uint16_t *Fraction, TeGravity Gravity, uint8_t Ticks);
+
+/* Get the ticks until the next row is due at the given gravity, from 1 up
+ * to 255. With no row due by then the next call of Te_RowsDue returns 0 */
+extern uint8_t Te_TicksToRow(uint16_t Fraction, TeGravity Gravity);
+
+/* Take a snapshot of a game */
+extern void Te_Pack(const TetrisGame *Game, TePacked *Packed);
+
+/* Bring a game back to a snapshot. The heights, holes, wells, ghost and
+ * hash are computed anew */
+extern void Te_Unpack(TetrisGame *Game, const TePacked *Packed);
+
+#ifdef ZOBRIST_HASH
+/* Hash of the game computed from scratch. Equals Game->Hash */
+extern TeHash Te_Hash(const TetrisGame *Game);
+
+/* The random key with the given number. Keys are computed, not looked up,
+ * and numbered squares first, then falling tetrominoes, then TE_HASH_FREE
+ * on for the use of others */
+extern TeHash Te_HashKey(uint32_t Number);
+#endif
+
+/* Empty the board and set up the rows around it */
+extern void Te_ClearPlayfield(BoardRow *Playfield);
+
+/* Start handing out tetromino types from a new bag */
+extern void Te_SeedBag(TetrominoBag *Bag, uint16_t Seed);
+
+/* Take the next tetromino type out of the bag */
+extern uint8_t Te_NextTetromino(TetrominoBag *Bag);
+
+/* Detect if the tetromino collides with any element of the board, i.e. other
+ * tetrominoes that previously fell or the board's limits. Non zero if it does */
+extern BoardRow Te_DetectCollision(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Place a tetromino on the board */
+extern void Te_AddTetromino(BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Get the y position at which a tetromino that falls from the given position
+ * comes to rest */
+extern uint8_t Te_LandingRow(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Remove the completed rows among those a tetromino locked at the given
+ * y position covers. Returns the number of rows removed */
+extern uint8_t Te_ClearCompletedRows(BoardRow *Board, uint8_t Pos_y);
+
+/* Get the height of each column of the board, i.e. the number of rows from
+ * the bottom up to and including its topmost locked square */
+extern void Te_ColumnHeights(const BoardRow *Board, uint8_t *Heights);
+
+/* Same as Te_LandingRow but based on the column heights of the board */
+extern uint8_t Te_GhostRow(const BoardRow *Board, const uint8_t *Heights, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Update the column heights and hole count of a board for a tetromino
+ * locked on it at the given position, before any rows are removed. Non zero
+ * if squares end up above the board */
+extern uint8_t Te_AccountTetromino(uint8_t *Heights, uint16_t *Holes, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Get the number of rows a tetromino would complete if it locked at the
+ * given position */
+extern uint8_t Te_CompletedRows(const BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+/* Remove a tetromino from the board */
+extern void Te_RemoveTetromino(BoardRow *Board, uint8_t Type, uint8_t Orientation, uint8_t Pos_x, uint8_t Pos_y);
+
+#endif /* TE_H */
@@ -0,0 +1,184 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ev.c: Batch evaluation of boards for the host tools
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+
+#include "te.h"
+#include "ai.h"
+#include "ev.h"
+
+#if (BOARD_ROWS == 16) && (BOARD_ROW_BITS == 8) && defined(__AVX2__)
+#define EV_AVX2
+#define EV_SSE2
+#include <immintrin.h>
+#elif (BOARD_ROWS == 16) && (BOARD_ROW_BITS == 8) && defined(__SSE2__)
+#define EV_SSE2
+#include <emmintrin.h>
+#endif
+
+void Ev_EvaluateBatchScalar(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings)
+{
+	unsigned Index;
+
+	for (Index = 0; Index < Count; Index++)
+		Ratings[Index] = Ai_Evaluate(&Boards[Index * BOARD_ROWS], Lines[Index], Weights);
+}
+
+#ifdef EV_SSE2
+
+/* Neighbouring column pairs, as in ai.c */
+#define COLUMN_PAIRS			(ROW_COMPLETED >> 1)
+
+static int32_t Rating(const AiWeights *Weights, uint8_t Lines, uint32_t Height, uint32_t Holes, uint32_t Bumpiness)
+{
+	return (int32_t)Weights->Height * (int32_t)Height
+	     + (int32_t)Weights->Lines * Lines
+	     + (int32_t)Weights->Holes * (int32_t)Holes
+	     + (int32_t)Weights->Bumpiness * (int32_t)Bumpiness;
+}
+
+/* Number of set bits in each byte */
+static __m128i CountSquares(__m128i Rows)
+{
+	Rows = _mm_sub_epi8(Rows, _mm_and_si128(_mm_srli_epi16(Rows, 1), _mm_set1_epi8(0x55)));
+	Rows = _mm_add_epi8(_mm_and_si128(Rows, _mm_set1_epi8(0x33)), _mm_and_si128(_mm_srli_epi16(Rows, 2), _mm_set1_epi8(0x33)));
+
+	return _mm_and_si128(_mm_add_epi8(Rows, _mm_srli_epi16(Rows, 4)), _mm_set1_epi8(0x0F));
+}
+
+/* Sum of all bytes */
+static uint32_t Sum(__m128i Bytes)
+{
+	Bytes = _mm_sad_epu8(Bytes, _mm_setzero_si128());
+
+	return _mm_cvtsi128_si32(Bytes) + _mm_extract_epi16(Bytes, 4);
+}
+
+/* The features of Ai_Evaluate without the loop over the rows. The bytes
+ * are the rows, the top one first. Shifting the vector by 1, 2, 4 and 8
+ * bytes ORs every row into all rows below it, which makes "Covered" of all
+ * rows at once */
+static int32_t Evaluate(const BoardRow *Board, uint8_t Lines, const AiWeights *Weights)
+{
+	__m128i Rows, Covered;
+
+	Rows = _mm_loadu_si128((const __m128i *)Board);
+	Covered = _mm_or_si128(Rows, _mm_slli_si128(Rows, 1));
+	Covered = _mm_or_si128(Covered, _mm_slli_si128(Covered, 2));
+	Covered = _mm_or_si128(Covered, _mm_slli_si128(Covered, 4));
+	Covered = _mm_or_si128(Covered, _mm_slli_si128(Covered, 8));
+
+	return Rating(Weights, Lines
+		, Sum(CountSquares(Covered))
+		, Sum(CountSquares(_mm_andnot_si128(Rows, Covered)))
+		, Sum(CountSquares(_mm_and_si128(_mm_xor_si128(Covered, _mm_srli_epi16(Covered, 1)), _mm_set1_epi8(COLUMN_PAIRS)))));
+}
+
+#endif /* EV_SSE2 */
+
+#ifdef EV_AVX2
+
+static __m256i CountSquares2(__m256i Rows)
+{
+	Rows = _mm256_sub_epi8(Rows, _mm256_and_si256(_mm256_srli_epi16(Rows, 1), _mm256_set1_epi8(0x55)));
+	Rows = _mm256_add_epi8(_mm256_and_si256(Rows, _mm256_set1_epi8(0x33)), _mm256_and_si256(_mm256_srli_epi16(Rows, 2), _mm256_set1_epi8(0x33)));
+
+	return _mm256_and_si256(_mm256_add_epi8(Rows, _mm256_srli_epi16(Rows, 4)), _mm256_set1_epi8(0x0F));
+}
+
+/* Sums of the bytes of each board */
+static void Sum2(__m256i Bytes, uint32_t *First, uint32_t *Second)
+{
+	Bytes = _mm256_sad_epu8(Bytes, _mm256_setzero_si256());
+
+	*First = _mm256_extract_epi16(Bytes, 0) + _mm256_extract_epi16(Bytes, 4);
+	*Second = _mm256_extract_epi16(Bytes, 8) + _mm256_extract_epi16(Bytes, 12);
+}
+
+/* Two boards, one in each 128 bit lane. The byte shifts of AVX2 stay
+ * within their lane, so this is Evaluate twice over */
+static void Evaluate2(const BoardRow *Boards, const uint8_t *Lines, const AiWeights *Weights, int32_t *Ratings)
+{
+	__m256i Rows, Covered;
+	uint32_t Height[2], Holes[2], Bumpiness[2];
+
+	Rows = _mm256_loadu_si256((const __m256i *)Boards);
+	Covered = _mm256_or_si256(Rows, _mm256_slli_si256(Rows, 1));
+	Covered = _mm256_or_si256(Covered, _mm256_slli_si256(Covered, 2));
+	Covered = _mm256_or_si256(Covered, _mm256_slli_si256(Covered, 4));
+	Covered = _mm256_or_si256(Covered, _mm256_slli_si256(Covered, 8));
+
+	Sum2(CountSquares2(Covered), &Height[0], &Height[1]);
+	Sum2(CountSquares2(_mm256_andnot_si256(Rows, Covered)), &Holes[0], &Holes[1]);
+	Sum2(CountSquares2(_mm256_and_si256(_mm256_xor_si256(Covered, _mm256_srli_epi16(Covered, 1)), _mm256_set1_epi8(COLUMN_PAIRS))), &Bumpiness[0], &Bumpiness[1]);
+
+	Ratings[0] = Rating(Weights, Lines[0], Height[0], Holes[0], Bumpiness[0]);
+	Ratings[1] = Rating(Weights, Lines[1], Height[1], Holes[1], Bumpiness[1]);
+}
+
+#endif /* EV_AVX2 */
+
+#if defined(EV_AVX2)
+
+const char Ev_Kernel[] = "avx2";
+
+void Ev_EvaluateBatch(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings)
+{
+	unsigned Index;
+
+	for (Index = 0; Index + 1 < Count; Index += 2)
+		Evaluate2(&Boards[Index * BOARD_ROWS], &Lines[Index], Weights, &Ratings[Index]);
+
+	if (Index < Count)
+		Ratings[Index] = Evaluate(&Boards[Index * BOARD_ROWS], Lines[Index], Weights);
+}
+
+#elif defined(EV_SSE2)
+
+const char Ev_Kernel[] = "sse2";
+
+void Ev_EvaluateBatch(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings)
+{
+	unsigned Index;
+
+	for (Index = 0; Index < Count; Index++)
+		Ratings[Index] = Evaluate(&Boards[Index * BOARD_ROWS], Lines[Index], Weights);
+}
+
+#else
+
+const char Ev_Kernel[] = "scalar";
+
+void Ev_EvaluateBatch(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings)
+{
+	Ev_EvaluateBatchScalar(Boards, Lines, Count, Weights, Ratings);
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ev.h: Batch evaluation of boards for the host tools
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef EV_H
+#define EV_H
+
+#include <stdint.h>
+
+#include "te.h"
+#include "ai.h"
+
+/* Rate many boards at once, the same way Ai_Evaluate rates one. The boards
+ * are stored back to back, BOARD_ROWS rows each, and completed the number
+ * of rows in Lines.
+ *
+ * A board of up to 8 columns and 16 rows is a 128 bit vector, a row per
+ * byte. Where the compiler targets SSE2 each board is rated in a vector
+ * register, with AVX2 two at a time. Other boards and targets fall back to
+ * Ai_Evaluate */
+extern void Ev_EvaluateBatch(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings);
+
+/* Same with Ai_Evaluate, for comparison */
+extern void Ev_EvaluateBatchScalar(const BoardRow *Boards, const uint8_t *Lines, unsigned Count, const AiWeights *Weights, int32_t *Ratings);
+
+/* Name of the kernel Ev_EvaluateBatch uses */
+extern const char Ev_Kernel[];
+
+#endif /* EV_H */
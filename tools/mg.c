@@ -0,0 +1,420 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * mg.c: Many games stepped in lockstep
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+
+#include "te.h"
+#include "mg.h"
+
+/* The same lookup tables as the engine */
+#include "tables.h"
+
+#if (MG_CLEARED != TE_CLEARED) || (MG_LOCKED != TE_LOCKED) || (MG_GAME_OVER != TE_GAME_OVER) || (MG_OVERFLOW != TE_OVERFLOW)
+#error "MG_ and TE_ outcomes differ"
+#endif
+
+/* Games stepped by one pass of the loops. The loops have this fixed trip
+ * count, so the compiler can vectorize them without remainder handling */
+#define MG_LANES			16
+
+/* All mask bits set for a true condition, none for a false one */
+#define MASK(Condition)			((BoardRow)0 - (BoardRow)(Condition))
+
+struct MgGames {
+	uint32_t Count;
+	/* Count rounded up to a multiple of MG_LANES. The games beyond Count
+	 * are over from the start and never change */
+	uint32_t Stride;
+	/* Row N of the playfields of all games at [N * Stride] */
+	BoardRow *Playfield;
+	/* The falling tetrominoes */
+	uint8_t *Type;
+	uint8_t *Orientation;
+	uint8_t *Pos_x;
+	uint8_t *Pos_y;
+	/* The bags */
+	uint16_t *State;
+	uint8_t *Remaining;
+	uint16_t *Score;
+	/* Non zero for games that are over */
+	uint8_t *Over;
+};
+
+/* Get row Row of the board of a game */
+#define ROW(Games, Game, Row)		((Games)->Playfield[(uint32_t)(PLAYFIELD_ROWS_HIDDEN + (Row)) * (Games)->Stride + (Game)])
+
+uint32_t Mg_AbiVersion(void)
+{
+	return MG_ABI_VERSION;
+}
+
+void Mg_Dimensions(uint32_t *Columns, uint32_t *Rows)
+{
+	*Columns = BOARD_COLUMNS;
+	*Rows = BOARD_ROWS;
+}
+
+uint32_t Mg_Count(const MgGames *Games)
+{
+	return Games->Count;
+}
+
+/* A lane's view of the board: Row N of it at Board[N * Stride] */
+#define AT(Board, Stride, Row)		((Board)[(long)(Row) * (long)(Stride)])
+
+/* Te_LandingRow with the board's rows Stride apart */
+static uint8_t LandingRow(const BoardRow *Board, uint32_t Stride, const ShiftedTetromino *Shifted, uint8_t Pos_y)
+{
+	while (!( (AT(Board, Stride, Pos_y + 1) & Shifted->Row[0])
+		| (AT(Board, Stride, Pos_y) & Shifted->Row[1])
+		| (AT(Board, Stride, Pos_y - 1) & Shifted->Row[2])
+		| (AT(Board, Stride, Pos_y - 2) & Shifted->Row[3])))
+		Pos_y++;
+
+	return Pos_y;
+}
+
+/* Lock a tetromino and remove the rows it completed, the same way as
+ * Te_AddTetromino and Te_ClearCompletedRows */
+static uint8_t Lock(BoardRow *Board, uint32_t Stride, const ShiftedTetromino *Shifted, uint8_t Pos_y)
+{
+	const uint8_t Top = (Pos_y < TETROMINO_HEIGHT - 1) ? 0 : Pos_y - (TETROMINO_HEIGHT - 1);
+	uint8_t Src = Pos_y + 1, Dst = Pos_y + 1, Row, Cleared;
+
+	for (Row = 0; Row < TETROMINO_HEIGHT; Row++)
+		AT(Board, Stride, Pos_y - Row) |= Shifted->Row[Row];
+
+	while (Src > Top) {
+		Src--;
+		if (AT(Board, Stride, Src) != ROW_COMPLETED)
+			AT(Board, Stride, --Dst) = AT(Board, Stride, Src);
+	}
+
+	Cleared = Dst - Src;
+	if (!Cleared)
+		return 0;
+
+	while (Src > 0) {
+		Src--;
+		AT(Board, Stride, --Dst) = AT(Board, Stride, Src);
+		if (AT(Board, Stride, Src) == ROW_EMPTY)
+			break;
+	}
+
+	while (Dst > Src)
+		AT(Board, Stride, --Dst) = ROW_EMPTY;
+
+	return Cleared;
+}
+
+/* Te_NextTetromino for the lanes that locked. The generators advance and
+ * the types are picked from the bags without a branch per lane */
+static void NextTetrominoes(uint16_t *States, uint8_t *Bags, uint8_t *Types, const uint8_t *Locked)
+{
+	uint8_t Full[MG_LANES], Index[MG_LANES], Rank[MG_LANES], Chosen[MG_LANES];
+	uint16_t State;
+	uint8_t Count, Bit, Type;
+	unsigned Lane;
+
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		State = States[Lane];
+		State ^= State << 7;
+		State ^= State >> 9;
+		State ^= State << 8;
+		States[Lane] = Locked[Lane] ? State : States[Lane];
+
+		Full[Lane] = Bags[Lane] ? Bags[Lane] : BAG_FULL;
+		Count = (Full[Lane] & 0x55) + ((Full[Lane] >> 1) & 0x55);
+		Count = (Count & 0x33) + ((Count >> 2) & 0x33);
+		Count = (Count & 0x0F) + (Count >> 4);
+		Index[Lane] = ((uint16_t)(uint8_t)(State >> 8) * Count) >> 8;
+		Rank[Lane] = 0;
+		Chosen[Lane] = 0;
+	}
+
+	/* The type is the one with as many types before it in the bag as the
+	 * index says */
+	for (Type = 0; Type < TETROMINO_TYPES; Type++)
+		for (Lane = 0; Lane < MG_LANES; Lane++) {
+			Bit = (Full[Lane] >> Type) & 1;
+			Chosen[Lane] = (Bit && (Rank[Lane] == Index[Lane])) ? Type : Chosen[Lane];
+			Rank[Lane] += Bit;
+		}
+
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Bags[Lane] = Locked[Lane] ? Full[Lane] & ~(1 << Chosen[Lane]) : Bags[Lane];
+		Types[Lane] = Locked[Lane] ? Chosen[Lane] : Types[Lane];
+	}
+}
+
+/* Step MG_LANES games. The state of the lanes is worked on in local
+ * arrays. The board rows around each tetromino and its shapes before and
+ * after the action are fetched once, one lane at a time. Testing the
+ * action and the fall, moving, locking and bringing in the next tetromino
+ * then are vector operations across the lanes, apart from the few lanes
+ * that drop or lock */
+static void StepLanes(MgGames *Games, uint32_t First, const uint8_t *Actions, uint8_t *Results)
+{
+	const uint32_t Stride = Games->Stride;
+	BoardRow *Board = &Games->Playfield[PLAYFIELD_ROWS_HIDDEN * Stride + First];
+	uint8_t Type[MG_LANES], Orientation[MG_LANES], Pos_x[MG_LANES], Pos_y[MG_LANES], Over[MG_LANES];
+	uint8_t Turned[MG_LANES], Shifted_x[MG_LANES];
+	uint8_t Moved[MG_LANES], Locked[MG_LANES], Result[MG_LANES];
+	/* The row below the tetromino and the rows it covers, bottom up */
+	BoardRow Window[TETROMINO_HEIGHT + 1][MG_LANES];
+	BoardRow Shape[TETROMINO_HEIGHT][MG_LANES], Moving[TETROMINO_HEIGHT][MG_LANES];
+	BoardRow Blocked[MG_LANES], Collision[MG_LANES], Hidden[MG_LANES];
+	const ShiftedTetromino *Current, *Candidate;
+	const BoardRow *Rows;
+	uint8_t Action;
+	unsigned Lane, Row;
+
+	memcpy(Type, &Games->Type[First], MG_LANES);
+	memcpy(Orientation, &Games->Orientation[First], MG_LANES);
+	memcpy(Pos_x, &Games->Pos_x[First], MG_LANES);
+	memcpy(Pos_y, &Games->Pos_y[First], MG_LANES);
+	memcpy(Over, &Games->Over[First], MG_LANES);
+
+	/* Where the actions would take the tetrominoes */
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Action = Actions[Lane];
+		Turned[Lane] = (Orientation[Lane] + (Action == MG_ROTATE)) % TETROMINO_ORIENTATIONS;
+		Shifted_x[Lane] = Pos_x[Lane] + (Action == MG_LEFT) - ((Action == MG_RIGHT) && Pos_x[Lane]);
+	}
+
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Current = &ShiftedTetrominoes[Type[Lane]][Orientation[Lane]][Pos_x[Lane]];
+		Candidate = &ShiftedTetrominoes[Type[Lane]][Turned[Lane]][Shifted_x[Lane]];
+		for (Row = 0; Row < TETROMINO_HEIGHT; Row++) {
+			Shape[Row][Lane] = Current->Row[Row];
+			Moving[Row][Lane] = Candidate->Row[Row];
+		}
+		Blocked[Lane] = Candidate->Blocked;
+		Rows = &AT(Board + Lane, Stride, Pos_y[Lane] + 1);
+		for (Row = 0; Row <= TETROMINO_HEIGHT; Row++, Rows -= Stride)
+			Window[Row][Lane] = *Rows;
+	}
+
+	/* Moving right of column 0 is blocked right away */
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Action = Actions[Lane];
+		Collision[Lane] = (Window[1][Lane] & Moving[0][Lane])
+				| (Window[2][Lane] & Moving[1][Lane])
+				| (Window[3][Lane] & Moving[2][Lane])
+				| (Window[4][Lane] & Moving[3][Lane])
+				| Blocked[Lane]
+				| MASK((Action == MG_RIGHT) && !Pos_x[Lane]);
+		Moved[Lane] = (Action >= MG_LEFT) && (Action <= MG_ROTATE) && !Over[Lane] && !Collision[Lane];
+		Orientation[Lane] = Moved[Lane] ? Turned[Lane] : Orientation[Lane];
+		Pos_x[Lane] = Moved[Lane] ? Shifted_x[Lane] : Pos_x[Lane];
+		Shape[0][Lane] = Moved[Lane] ? Moving[0][Lane] : Shape[0][Lane];
+		Shape[1][Lane] = Moved[Lane] ? Moving[1][Lane] : Shape[1][Lane];
+		Shape[2][Lane] = Moved[Lane] ? Moving[2][Lane] : Shape[2][Lane];
+		Shape[3][Lane] = Moved[Lane] ? Moving[3][Lane] : Shape[3][Lane];
+
+		/* Fall by a row where possible, lock where not */
+		Collision[Lane] = (Window[0][Lane] & Shape[0][Lane])
+				| (Window[1][Lane] & Shape[1][Lane])
+				| (Window[2][Lane] & Shape[2][Lane])
+				| (Window[3][Lane] & Shape[3][Lane]);
+	}
+
+	/* A dropped tetromino locks where it lands */
+	for (Lane = 0; Lane < MG_LANES; Lane++)
+		if ((Actions[Lane] == MG_DROP) && !Over[Lane]) {
+			Pos_y[Lane] = LandingRow(Board + Lane, Stride, &ShiftedTetrominoes[Type[Lane]][Orientation[Lane]][Pos_x[Lane]], Pos_y[Lane]);
+			Collision[Lane] = ROW_COMPLETED;
+			Moved[Lane] = 1;
+		}
+
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Locked[Lane] = Collision[Lane] && !Over[Lane];
+		Pos_y[Lane] += !Collision[Lane] && !Over[Lane];
+		Result[Lane] = (Locked[Lane] ? MG_LOCKED : 0) | (Moved[Lane] ? MG_MOVED : 0);
+	}
+
+	for (Lane = 0; Lane < MG_LANES; Lane++)
+		if (Locked[Lane]) {
+			Action = Lock(Board + Lane, Stride, &ShiftedTetrominoes[Type[Lane]][Orientation[Lane]][Pos_x[Lane]], Pos_y[Lane]);
+			Games->Score[First + Lane] += Action;
+			Result[Lane] |= Action;
+		}
+
+	/* Squares locked above the board are lost. The hidden rows of all the
+	 * games are next to each other */
+	for (Lane = 0; Lane < MG_LANES; Lane++)
+		Hidden[Lane] = ROW_EMPTY;
+	for (Row = 1; Row <= PLAYFIELD_ROWS_HIDDEN; Row++)
+		for (Lane = 0; Lane < MG_LANES; Lane++) {
+			Hidden[Lane] |= AT(Board + Lane, Stride, -(int)Row);
+			AT(Board + Lane, Stride, -(int)Row) = ROW_EMPTY;
+		}
+
+	/* Bring in the next tetrominoes. With the hidden rows empty only the
+	 * top row of the board can be in the way of one. If it is, its game
+	 * is over */
+	NextTetrominoes(&Games->State[First], &Games->Remaining[First], Type, Locked);
+
+	for (Lane = 0; Lane < MG_LANES; Lane++)
+		Collision[Lane] = ShiftedTetrominoes[Type[Lane]][UP][POSITION_X_CENTER].Row[0] & Board[Lane];
+
+	for (Lane = 0; Lane < MG_LANES; Lane++) {
+		Result[Lane] |= Hidden[Lane] ? MG_OVERFLOW : 0;
+		Orientation[Lane] = Locked[Lane] ? UP : Orientation[Lane];
+		Pos_x[Lane] = Locked[Lane] ? POSITION_X_CENTER : Pos_x[Lane];
+		Pos_y[Lane] = Locked[Lane] ? POSITION_Y_TOP : Pos_y[Lane];
+		Over[Lane] |= Locked[Lane] && Collision[Lane];
+		Result[Lane] |= Over[Lane] ? MG_GAME_OVER : 0;
+	}
+
+	memcpy(&Games->Type[First], Type, MG_LANES);
+	memcpy(&Games->Orientation[First], Orientation, MG_LANES);
+	memcpy(&Games->Pos_x[First], Pos_x, MG_LANES);
+	memcpy(&Games->Pos_y[First], Pos_y, MG_LANES);
+	memcpy(&Games->Over[First], Over, MG_LANES);
+
+	if (Results)
+		memcpy(Results, Result, MG_LANES);
+}
+
+void Mg_Step(MgGames *Games, const uint8_t *Actions, uint8_t *Results)
+{
+	uint8_t Padded[MG_LANES], Outcome[MG_LANES];
+	uint32_t First;
+
+	for (First = 0; First + MG_LANES <= Games->Count; First += MG_LANES)
+		StepLanes(Games, First, &Actions[First], Results ? &Results[First] : NULL);
+
+	/* The last games and the ones that pad them */
+	if (First < Games->Count) {
+		memset(Padded, MG_NONE, sizeof(Padded));
+		memcpy(Padded, &Actions[First], Games->Count - First);
+		StepLanes(Games, First, Padded, Outcome);
+		if (Results)
+			memcpy(&Results[First], Outcome, Games->Count - First);
+	}
+}
+
+void Mg_NewGame(MgGames *Games, uint32_t Game, uint16_t Seed)
+{
+	TetrominoBag Bag;
+	uint8_t Row;
+
+	for (Row = 0; Row < PLAYFIELD_ROWS - 1; Row++)
+		Games->Playfield[Row * Games->Stride + Game] = ROW_EMPTY;
+	Games->Playfield[(PLAYFIELD_ROWS - 1) * Games->Stride + Game] = ROW_COMPLETED;
+
+	Te_SeedBag(&Bag, Seed);
+	Games->Type[Game] = Te_NextTetromino(&Bag);
+	Games->State[Game] = Bag.State;
+	Games->Remaining[Game] = Bag.Remaining;
+
+	Games->Orientation[Game] = UP;
+	Games->Pos_x[Game] = POSITION_X_CENTER;
+	Games->Pos_y[Game] = POSITION_Y_TOP;
+	Games->Score[Game] = 0;
+	Games->Over[Game] = 0;
+}
+
+void Mg_Destroy(MgGames *Games)
+{
+	if (!Games)
+		return;
+
+	free(Games->Playfield);
+	free(Games->Type);
+	free(Games->Orientation);
+	free(Games->Pos_x);
+	free(Games->Pos_y);
+	free(Games->State);
+	free(Games->Remaining);
+	free(Games->Score);
+	free(Games->Over);
+	free(Games);
+}
+
+MgGames *Mg_Create(uint32_t Count, const uint16_t *Seeds)
+{
+	MgGames *Games;
+	uint32_t Game;
+
+	Games = calloc(1, sizeof(MgGames));
+	if (!Games)
+		return NULL;
+
+	Games->Count = Count;
+	Games->Stride = (Count + MG_LANES - 1) / MG_LANES * MG_LANES;
+	Games->Playfield = calloc((size_t)PLAYFIELD_ROWS * Games->Stride, sizeof(BoardRow));
+	Games->Type = calloc(Games->Stride, sizeof(uint8_t));
+	Games->Orientation = calloc(Games->Stride, sizeof(uint8_t));
+	Games->Pos_x = calloc(Games->Stride, sizeof(uint8_t));
+	Games->Pos_y = calloc(Games->Stride, sizeof(uint8_t));
+	Games->State = calloc(Games->Stride, sizeof(uint16_t));
+	Games->Remaining = calloc(Games->Stride, sizeof(uint8_t));
+	Games->Score = calloc(Games->Stride, sizeof(uint16_t));
+	Games->Over = calloc(Games->Stride, sizeof(uint8_t));
+
+	if (!Games->Playfield || !Games->Type || !Games->Orientation || !Games->Pos_x || !Games->Pos_y
+	    || !Games->State || !Games->Remaining || !Games->Score || !Games->Over) {
+		Mg_Destroy(Games);
+		return NULL;
+	}
+
+	for (Game = 0; Game < Games->Stride; Game++) {
+		Mg_NewGame(Games, Game, Seeds && (Game < Count) ? Seeds[Game] : (uint16_t)Game);
+		Games->Over[Game] = Game >= Count;
+	}
+
+	return Games;
+}
+
+void Mg_Observe(const MgGames *Games, uint32_t *Boards, uint8_t *Falling, uint16_t *Scores)
+{
+	uint32_t Game;
+	uint8_t Row;
+
+	for (Game = 0; Game < Games->Count; Game++) {
+		if (Boards)
+			for (Row = 0; Row < BOARD_ROWS; Row++)
+				Boards[Game * BOARD_ROWS + Row] = ROW(Games, Game, Row);
+		if (Falling) {
+			Falling[Game * 4 + 0] = Games->Type[Game];
+			Falling[Game * 4 + 1] = Games->Orientation[Game];
+			Falling[Game * 4 + 2] = Games->Pos_x[Game];
+			Falling[Game * 4 + 3] = Games->Pos_y[Game];
+		}
+		if (Scores)
+			Scores[Game] = Games->Score[Game];
+	}
+}
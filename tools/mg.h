@@ -0,0 +1,109 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * mg.h: Many games stepped in lockstep
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef MG_H
+#define MG_H
+
+#include <stdint.h>
+
+/* Many independent games advanced together, one step each per call, e.g.
+ * for training a bot. The games are stored as structure of arrays: Row N of
+ * all boards is one array, and so are the types, positions and generator
+ * states of the falling tetrominoes. A step then tests collisions, moves,
+ * locks and draws the next tetrominoes with loops across the games the
+ * compiler turns into vector instructions.
+ *
+ * The interface only uses fixed size integers and an opaque handle and does
+ * not depend on the board size the engine is built for, so it stays the
+ * same for programs that link against the library built from it (make
+ * libmg.so in tools). MG_ABI_VERSION changes whenever it does not */
+#define MG_ABI_VERSION			1
+
+#ifdef __GNUC__
+#define MG_API				__attribute__((visibility("default")))
+#else
+#define MG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What each game is asked to do before the tetromino falls by a row */
+#define MG_NONE				0
+#define MG_LEFT				1
+#define MG_RIGHT			2
+#define MG_ROTATE			3
+#define MG_DROP				4
+
+/* Outcome of a step of a game. The same as Te_Step returns, plus MG_MOVED
+ * if the move or rotation asked for was possible. A game that is over stays
+ * over and reports MG_GAME_OVER until it is started anew */
+#define MG_CLEARED			0x07
+#define MG_LOCKED			0x10
+#define MG_GAME_OVER			0x20
+#define MG_OVERFLOW			0x40
+#define MG_MOVED			0x80
+
+typedef struct MgGames MgGames;
+
+/* The MG_ABI_VERSION the library was built with */
+extern MG_API uint32_t Mg_AbiVersion(void);
+
+/* Size of the boards */
+extern MG_API void Mg_Dimensions(uint32_t *Columns, uint32_t *Rows);
+
+/* Set up Count games, each started with its seed. Seeds may be NULL, then
+ * game N is seeded with N. NULL if out of memory */
+extern MG_API MgGames *Mg_Create(uint32_t Count, const uint16_t *Seeds);
+
+extern MG_API void Mg_Destroy(MgGames *Games);
+
+extern MG_API uint32_t Mg_Count(const MgGames *Games);
+
+/* Start one of the games anew */
+extern MG_API void Mg_NewGame(MgGames *Games, uint32_t Game, uint16_t Seed);
+
+/* Carry out the MG_ action of each game, then let its tetromino fall by one
+ * row or lock it, like Te_MoveLeft ... Te_HardDrop followed by Te_Step do.
+ * Results gets the outcome of each game and may be NULL */
+extern MG_API void Mg_Step(MgGames *Games, const uint8_t *Actions, uint8_t *Results);
+
+/* Copy out the games, each argument may be NULL. Boards gets the rows of
+ * each board, the top one first, one bit per column with the rightmost
+ * column in bit 0. Falling gets type, orientation, x and y position of each
+ * falling tetromino, Scores the completed rows of each game */
+extern MG_API void Mg_Observe(const MgGames *Games, uint32_t *Boards, uint8_t *Falling, uint16_t *Scores);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MG_H */
@@ -0,0 +1,262 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ps.c: Parallel lookahead search for the autoplayer
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "te.h"
+#include "ai.h"
+#include "ws.h"
+#include "ev.h"
+#include "tt.h"
+#include "ps.h"
+
+#ifndef ZOBRIST_HASH
+#error "the search needs the engine built with ZOBRIST_HASH"
+#endif
+
+typedef struct PsSearch PsSearch;
+typedef struct PsBranch PsBranch;
+
+/* A placement of the next tetromino, below a branch */
+typedef struct {
+	PsBranch *Branch;
+	AiMove Move;
+	int32_t Rating;
+} PsLeaf;
+
+/* A placement of the falling tetromino */
+struct PsBranch {
+	PsSearch *Search;
+	AiMove Move;
+	/* The game after the placement, with the next tetromino falling */
+	TetrisGame Game;
+	uint8_t Lines;
+	int32_t Rating;
+	uint8_t Count;
+	PsLeaf Leaf[AI_PLACEMENTS];
+};
+
+struct PsSearch {
+	WsPool *Pool;
+	TtTable *Table;
+	const TetrisGame *Game;
+	const AiWeights *Weights;
+	uint8_t Depth;
+	uint8_t Count;
+	PsBranch Branch[AI_PLACEMENTS];
+};
+
+/* Put the falling tetromino in place and let it lock. Zero if that ended
+ * the game or lost squares above the board */
+static uint8_t Place(TetrisGame *Game, const AiMove *Move, uint8_t *Lines)
+{
+	uint8_t Result;
+
+	if (!Ai_Apply(Game, Move))
+		return 0;
+
+	Result = Te_Step(Game);
+	if (Result & (TE_GAME_OVER | TE_OVERFLOW))
+		return 0;
+
+	*Lines += Result & TE_CLEARED;
+
+	return 1;
+}
+
+/* Rating with the rows the way there completed added */
+static int32_t AddLines(int32_t Rating, uint8_t Lines, const AiWeights *Weights)
+{
+	return (Rating == AI_LOST) ? AI_LOST : Rating + (int32_t)Weights->Lines * Lines;
+}
+
+/* The same board and falling tetromino Depth tetrominoes from the end of
+ * the search, with the same tetrominoes coming out of the bag, rate the
+ * same. The rows completed on the way there come on top, so the table
+ * holds ratings without them */
+static uint64_t Key(const TetrisGame *Game, uint8_t Depth)
+{
+	return Game->Hash ^ Te_HashKey(TE_HASH_FREE + ((((uint32_t)Game->Bag.Remaining << 16) | Game->Bag.State) << 4) + Depth);
+}
+
+/* Best rating of the game Depth tetrominoes further down. The boards of
+ * the last tetromino are collected and rated in one batch */
+static int32_t Explore(const PsSearch *Search, const TetrisGame *Game, uint8_t Depth, uint8_t Lines)
+{
+	AiMove Moves[AI_PLACEMENTS];
+	BoardRow Boards[AI_PLACEMENTS][BOARD_ROWS];
+	uint8_t BoardLines[AI_PLACEMENTS];
+	int32_t Ratings[AI_PLACEMENTS];
+	TetrisGame Child;
+	uint8_t Count, Index, ChildLines, Leaves = 0;
+	int32_t Rating, Best = AI_LOST;
+
+	if (!Depth)
+		return Ai_Evaluate(TE_BOARD(Game), Lines, Search->Weights);
+
+	if (Search->Table && Tt_Probe(Search->Table, Key(Game, Depth), &Best))
+		return AddLines(Best, Lines, Search->Weights);
+
+	Count = Ai_Placements(Game, Moves);
+
+	for (Index = 0; Index < Count; Index++) {
+		Child = *Game;
+		ChildLines = 0;
+		if (!Place(&Child, &Moves[Index], &ChildLines))
+			continue;
+
+		if (Depth > 1) {
+			Rating = Explore(Search, &Child, Depth - 1, ChildLines);
+			if (Rating > Best)
+				Best = Rating;
+		} else {
+			memcpy(Boards[Leaves], TE_BOARD(&Child), sizeof(Boards[0]));
+			BoardLines[Leaves++] = ChildLines;
+		}
+	}
+
+	Ev_EvaluateBatch(Boards[0], BoardLines, Leaves, Search->Weights, Ratings);
+	for (Index = 0; Index < Leaves; Index++)
+		if (Ratings[Index] > Best)
+			Best = Ratings[Index];
+
+	if (Search->Table)
+		Tt_Store(Search->Table, Key(Game, Depth), Depth, Best);
+
+	return AddLines(Best, Lines, Search->Weights);
+}
+
+static void LeafTask(void *Arg)
+{
+	PsLeaf *Leaf = Arg;
+	PsBranch *Branch = Leaf->Branch;
+	TetrisGame Game = Branch->Game;
+	uint8_t Lines = Branch->Lines;
+
+	if (Place(&Game, &Leaf->Move, &Lines))
+		Leaf->Rating = Explore(Branch->Search, &Game, Branch->Search->Depth - 2, Lines);
+	else
+		Leaf->Rating = AI_LOST;
+}
+
+/* Place the falling tetromino and queue a task for each placement of the
+ * next one. The leaves go to the deque of this worker, the idle workers
+ * steal them from there */
+static void BranchTask(void *Arg)
+{
+	PsBranch *Branch = Arg;
+	PsSearch *Search = Branch->Search;
+	AiMove Moves[AI_PLACEMENTS];
+	uint8_t Index;
+
+	Branch->Game = *Search->Game;
+	Branch->Lines = 0;
+	Branch->Count = 0;
+	Branch->Rating = AI_LOST;
+
+	if (!Place(&Branch->Game, &Branch->Move, &Branch->Lines))
+		return;
+
+	/* Too little work below to be worth spreading */
+	if (Search->Depth < 3) {
+		Branch->Rating = Explore(Search, &Branch->Game, Search->Depth - 1, Branch->Lines);
+		return;
+	}
+
+	Branch->Count = Ai_Placements(&Branch->Game, Moves);
+
+	for (Index = 0; Index < Branch->Count; Index++) {
+		PsLeaf *Leaf = &Branch->Leaf[Index];
+
+		Leaf->Branch = Branch;
+		Leaf->Move = Moves[Index];
+		Leaf->Rating = AI_LOST;
+
+		/* No room in the deque. Do it right here then */
+		if (!Ws_Submit(Search->Pool, LeafTask, Leaf))
+			LeafTask(Leaf);
+	}
+}
+
+uint8_t Ps_FindMove(WsPool *Pool, TtTable *Table, const TetrisGame *Game, uint8_t Depth, const AiWeights *Weights, AiMove *Move)
+{
+	PsSearch *Search;
+	AiMove Moves[AI_PLACEMENTS];
+	uint8_t Index, Leaf, Found;
+	int32_t Rating, Best = AI_LOST;
+
+	/* Out of memory. The search without lookahead needs none */
+	Search = malloc(sizeof(PsSearch));
+	if (!Search)
+		return Ai_FindMove(Game, Weights, Move);
+
+	Search->Pool = Pool;
+	Search->Table = Table;
+	if (Table)
+		Tt_NewSearch(Table);
+	Search->Game = Game;
+	Search->Weights = Weights;
+	Search->Depth = Depth;
+	Search->Count = Ai_Placements(Game, Moves);
+
+	for (Index = 0; Index < Search->Count; Index++) {
+		PsBranch *Branch = &Search->Branch[Index];
+
+		Branch->Search = Search;
+		Branch->Move = Moves[Index];
+
+		if (!Ws_Submit(Pool, BranchTask, Branch))
+			BranchTask(Branch);
+	}
+
+	Ws_Wait(Pool);
+
+	/* The first of equally rated placements wins, as with Ai_FindMove */
+	for (Index = 0; Index < Search->Count; Index++) {
+		PsBranch *Branch = &Search->Branch[Index];
+
+		Rating = Branch->Rating;
+		for (Leaf = 0; Leaf < Branch->Count; Leaf++)
+			if (Branch->Leaf[Leaf].Rating > Rating)
+				Rating = Branch->Leaf[Leaf].Rating;
+
+		if (!Index || (Rating > Best)) {
+			Best = Rating;
+			*Move = Branch->Move;
+		}
+	}
+
+	Found = Search->Count != 0;
+	free(Search);
+
+	return Found;
+}
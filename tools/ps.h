@@ -0,0 +1,59 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ps.h: Parallel lookahead search for the autoplayer
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef PS_H
+#define PS_H
+
+#include <stdint.h>
+
+#include "te.h"
+#include "ai.h"
+#include "ws.h"
+#include "tt.h"
+
+/* Find the best placement of the falling tetromino looking Depth tetrominoes
+ * ahead, the falling one included. The upcoming tetrominoes are dealt from
+ * the game's own bag, so the search sees what is really coming.
+ *
+ * The placements of the falling tetromino are spread over the pool as
+ * tasks, from a depth of 3 on those of the next tetromino as well. Anything
+ * deeper is searched within these tasks. Every task has a slot
+ * of its own for the result and the results are reduced in the order of
+ * the placements, so the move found is the same for any number of workers.
+ *
+ * Positions reached by different orders of moves are rated once if a table
+ * is given. It is shared by all workers and may be kept from one search to
+ * the next as long as the weights stay the same. Hits return the rating
+ * the search would have come up with, so the table does not change the
+ * move found either.
+ * Zero if the tetromino can not be placed anywhere */
+extern uint8_t Ps_FindMove(WsPool *Pool, TtTable *Table, const TetrisGame *Game, uint8_t Depth, const AiWeights *Weights, AiMove *Move);
+
+#endif /* PS_H */
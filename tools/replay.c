@@ -0,0 +1,233 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * replay.c: Replays recorded inputs through the Tetris engine
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sysexits.h>
+
+#include "te.h"
+#include "rp.h"
+
+/* What happened in a game */
+typedef struct {
+	uint16_t Seed;
+	unsigned long Tetrominoes;
+	unsigned long Ticks;
+	/* Records got lost, the game is not the one played */
+	int Diverged;
+} Game;
+
+static const char *KindNames[] = {
+	 "new game"
+	,"left"
+	,"right"
+	,"rotate"
+	,"drop"
+	,"step"
+	,"fall"
+	,"gap"
+	,"garbage"
+};
+
+static double Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return Ts.tv_sec * 1e9 + Ts.tv_nsec;
+}
+
+/* Read the whole replay. Either the file the emulator wrote or a UART log
+ * of the device, whose replay is in the lines starting with '@' */
+static uint8_t *Load(FILE *File, size_t *Length)
+{
+	uint8_t *Bytes, *Grown;
+	size_t Size = 4096, Read = 0, Index;
+	int Char, Digits = -1;
+	unsigned Byte = 0;
+
+	Bytes = malloc(Size);
+	if (!Bytes)
+		return NULL;
+
+	while ((Char = fgetc(File)) != EOF) {
+		if (Read == Size) {
+			Size *= 2;
+			Grown = realloc(Bytes, Size);
+			if (!Grown) {
+				free(Bytes);
+				return NULL;
+			}
+			Bytes = Grown;
+		}
+		Bytes[Read++] = Char;
+	}
+
+	*Length = Read;
+	if ((Read >= 2) && (Bytes[0] == 'T') && (Bytes[1] == 'R'))
+		return Bytes;
+
+	/* Hex digits of the '@' lines, converted in place */
+	*Length = 0;
+	for (Index = 0; Index < Read; Index++) {
+		Char = Bytes[Index];
+		if ((Char == '@') && (!Index || (Bytes[Index - 1] == '\n'))) {
+			Digits = 0;
+		} else if (Char == '\n') {
+			Digits = -1;
+		} else if ((Digits >= 0) && isxdigit(Char)) {
+			Byte = (Byte << 4) | (isdigit(Char) ? Char - '0' : tolower(Char) - 'a' + 10);
+			if (++Digits == 2) {
+				Bytes[(*Length)++] = Byte;
+				Digits = 0;
+				Byte = 0;
+			}
+		}
+	}
+
+	return Bytes;
+}
+
+int main(int argc, char **argv)
+{
+	TetrisGame State;
+	Game Current;
+	RpRecord Record;
+	FILE *File;
+	uint8_t *Bytes;
+	size_t Length, Offset, Slowest = 0;
+	unsigned long Records = 0, Games = 0, Round, Rounds = 1;
+	uint8_t Used, SlowestKind = 0;
+	double Start, Took, Total = 0, Max = 0;
+	int Quiet = 0, Diverged = 0, Arg;
+
+	for (Arg = 1; (Arg < argc - 1) && (argv[Arg][0] == '-'); Arg++) {
+		if (!strcmp(argv[Arg], "-n") && (Arg < argc - 2)) {
+			Rounds = strtoul(argv[++Arg], NULL, 10);
+			Quiet = 1;
+		} else {
+			break;
+		}
+	}
+
+	if (Arg != argc - 1) {
+		fprintf(stderr, "usage: %s [-n rounds] file\n", argv[0]);
+		return EX_USAGE;
+	}
+
+	File = strcmp(argv[Arg], "-") ? fopen(argv[Arg], "rb") : stdin;
+	if (!File) {
+		perror(argv[Arg]);
+		return EX_NOINPUT;
+	}
+
+	Bytes = Load(File, &Length);
+	if (!Bytes) {
+		fprintf(stderr, "out of memory\n");
+		return EX_OSERR;
+	}
+
+	if ((Length < RP_HEADER_SIZE) || !Rp_CheckHeader(Bytes)) {
+		fprintf(stderr, "%s: not a replay of a %u x %u board\n", argv[Arg], BOARD_COLUMNS, BOARD_ROWS);
+		return EX_DATAERR;
+	}
+
+	/* Over and over again for profiling. Only the first round reports
+	 * the games */
+	for (Round = 0; Round < Rounds; Round++) {
+		memset(&Current, 0, sizeof(Current));
+		Te_NewGame(&State, 0);
+
+		for (Offset = RP_HEADER_SIZE; Offset < Length; Offset += Used) {
+			Used = Rp_Decode(&Bytes[Offset], (Length - Offset > 0xFFFF) ? 0xFFFF : Length - Offset, &Record);
+			if (!Used) {
+				fprintf(stderr, "replay ends within a record\n");
+				break;
+			}
+
+			Current.Ticks += Record.Ticks;
+
+			if ((Record.Kind == RP_NEW_GAME) && Games && !Round) {
+				if (!Current.Diverged && (Record.Score != State.Score)) {
+					printf("Game %lu diverged: score %u, recorded %u\n", Games, State.Score, Record.Score);
+					Diverged = 1;
+				} else if (!Quiet) {
+					printf("Game %lu: seed %5u, %5lu tetrominoes, score %5u, %7.1f s%s\n"
+						, Games, Current.Seed, Current.Tetrominoes, State.Score
+						, Current.Ticks * RP_TICK_US / 1e6
+						, Current.Diverged ? " (records lost)" : "");
+				}
+			}
+
+			if (Record.Kind == RP_NEW_GAME) {
+				memset(&Current, 0, sizeof(Current));
+				Current.Seed = Record.Seed;
+				if (!Round)
+					Games++;
+			} else if (Record.Kind == RP_GAP) {
+				Current.Diverged = 1;
+			}
+
+			Start = Now();
+			if ((Rp_Apply(&State, &Record) & TE_LOCKED) && ((Record.Kind == RP_STEP) || (Record.Kind == RP_FALL)))
+				Current.Tetrominoes++;
+			Took = Now() - Start;
+
+			Total += Took;
+			if (Took > Max) {
+				Max = Took;
+				Slowest = Offset;
+				SlowestKind = Record.Kind;
+			}
+
+			if (!Round)
+				Records++;
+		}
+	}
+
+	if (!Quiet)
+		printf("Game %lu: seed %5u, %5lu tetrominoes, score %5u, %7.1f s (not over)\n"
+			, Games, Current.Seed, Current.Tetrominoes, State.Score, Current.Ticks * RP_TICK_US / 1e6);
+
+	printf("%lu records, %lu games, %lu rounds: %.1f ns per record, slowest %.0f ns (%s at byte %lu)\n"
+		, Records, Games, Rounds, Records ? Total / (Records * Rounds) : 0.0
+		, Max, KindNames[SlowestKind], (unsigned long)Slowest);
+
+	free(Bytes);
+
+	return Diverged ? EX_DATAERR : EX_OK;
+}
@@ -0,0 +1,215 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * sim.c: Headless game simulator for Monte Carlo runs
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sysexits.h>
+
+#include "te.h"
+#include "ap.h"
+#include "ai.h"
+#include "ws.h"
+#include "sm.h"
+
+/* Games played by one task. Tasks are the unit the workers share */
+#define GAMES_PER_TASK			256
+
+/* A task: A range of games and their statistics */
+typedef struct {
+	const SmRules *Rules;
+	unsigned long First;
+	unsigned long Count;
+	SmStats Stats;
+} SimTask;
+
+static void PlayTask(void *Arg)
+{
+	SimTask *Task = Arg;
+	unsigned long Game;
+
+	for (Game = Task->First; Game < Task->First + Task->Count; Game++)
+		Sm_Play(Task->Rules, Game, &Task->Stats);
+}
+
+static void Report(const SmRules *Rules, const SmStats *Total, unsigned Workers, double Seconds)
+{
+	double Expected = (double)Total->Tetrominoes / TETROMINO_TYPES, ChiSquare = 0, Deviation;
+	unsigned long Locks = 0;
+	uint8_t Index;
+
+	printf("Board            %u x %u, %s bot, gravity %.4gG, fast %.4gG, input every %u ticks\n"
+		, BOARD_COLUMNS, BOARD_ROWS, Rules->Bot == SM_BOT_AI ? "ai" : "random"
+		, (double)Rules->Gravity / TE_GRAVITY_ONE, (double)Rules->Fast / TE_GRAVITY_ONE, Rules->InputPeriod);
+	printf("Games            %lu (%lu stopped at %lu tetrominoes)\n", Total->Games, Total->Stopped, Rules->Limit);
+	printf("Tetrominoes      %.1f per game\n", (double)Total->Tetrominoes / Total->Games);
+	printf("Lines            %.2f per game, min %lu, max %lu\n"
+		, (double)Total->Lines / Total->Games, Total->MinLines, Total->MaxLines);
+	printf("Game time        %.1f s per game\n", Total->Ticks * 0.004 / Total->Games);
+
+	for (Index = 0; Index <= TETROMINO_HEIGHT; Index++)
+		Locks += Total->Clears[Index];
+	printf("Rows per lock   ");
+	for (Index = 0; Index <= TETROMINO_HEIGHT; Index++)
+		printf(" %u: %.2f%%", Index, Locks ? 100.0 * Total->Clears[Index] / Locks : 0.0);
+	printf("\n");
+
+	printf("Types           ");
+	for (Index = 0; Index < TETROMINO_TYPES; Index++) {
+		printf(" %u: %.3f%%", Index, 100.0 * Total->Types[Index] / Total->Tetrominoes);
+		Deviation = Total->Types[Index] - Expected;
+		ChiSquare += Deviation * Deviation / Expected;
+	}
+	printf("\n");
+	printf("Chi square       %.2f (%u degrees of freedom)\n", ChiSquare, TETROMINO_TYPES - 1);
+	printf("Longest drought  %lu tetrominoes without a type\n", Total->Drought);
+
+	printf("Game lengths    ");
+	for (Index = 0; Index < SM_LENGTH_BUCKETS; Index++)
+		if (Total->Lengths[Index])
+			printf(" <%lu: %lu", 1UL << Index, Total->Lengths[Index]);
+	printf("\n");
+
+	printf("Throughput       %.0f games/min, %.0f tetrominoes/s on %u workers\n"
+		, Total->Games * 60 / Seconds, Total->Tetrominoes / Seconds, Workers);
+}
+
+static double Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return Ts.tv_sec + Ts.tv_nsec * 1e-9;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "usage: %s [-n games] [-j workers] [-b ai|random] [-s seed] [-l limit]\n"
+			"       [-g gravity] [-f fast] [-i input period]\n", Name);
+	exit(EX_USAGE);
+}
+
+int main(int argc, char **argv)
+{
+	SmRules Rules;
+	SmStats Total;
+	SimTask *Tasks;
+	WsPool *Pool;
+	unsigned long Games = 100000, Count, Index;
+	unsigned Workers = sysconf(_SC_NPROCESSORS_ONLN);
+	double Start;
+	int Option;
+
+	Rules.Gravity = GRAVITY_DEFAULT;
+	Rules.Fast = GRAVITY_FAST;
+	Rules.InputPeriod = 12;
+	Rules.Limit = 100000;
+	Rules.Bot = SM_BOT_AI;
+	Rules.Weights = &Ai_DefaultWeights;
+	Rules.Seed = TETROMINO_SEED;
+
+	while ((Option = getopt(argc, argv, "n:j:b:s:l:g:f:i:")) != -1) {
+		switch (Option) {
+		case 'n':
+			Games = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			Workers = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			if (!strcmp(optarg, "ai"))
+				Rules.Bot = SM_BOT_AI;
+			else if (!strcmp(optarg, "random"))
+				Rules.Bot = SM_BOT_RANDOM;
+			else
+				Usage(argv[0]);
+			break;
+		case 's':
+			Rules.Seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			Rules.Limit = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			Rules.Gravity = Sm_ParseGravity(optarg);
+			break;
+		case 'f':
+			Rules.Fast = Sm_ParseGravity(optarg);
+			break;
+		case 'i':
+			Rules.InputPeriod = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			Usage(argv[0]);
+		}
+	}
+
+	if ((optind != argc) || !Games || !Rules.Gravity || !Rules.Fast || !Rules.InputPeriod)
+		Usage(argv[0]);
+
+	Count = (Games + GAMES_PER_TASK - 1) / GAMES_PER_TASK;
+	Tasks = calloc(Count, sizeof(SimTask));
+	Pool = Ws_Create(Workers);
+	if (!Tasks || !Pool) {
+		fprintf(stderr, "could not set up %u workers\n", Workers);
+		return EX_OSERR;
+	}
+
+	Start = Now();
+
+	for (Index = 0; Index < Count; Index++) {
+		Tasks[Index].Rules = &Rules;
+		Tasks[Index].First = Index * GAMES_PER_TASK;
+		Tasks[Index].Count = (Index < Count - 1) ? GAMES_PER_TASK : Games - Index * GAMES_PER_TASK;
+		if (!Ws_Submit(Pool, PlayTask, &Tasks[Index]))
+			PlayTask(&Tasks[Index]);
+	}
+
+	Ws_Wait(Pool);
+
+	/* In the order of the games, so the same games give the same numbers
+	 * whatever the number of workers */
+	memset(&Total, 0, sizeof(Total));
+	for (Index = 0; Index < Count; Index++)
+		Sm_Merge(&Total, &Tasks[Index].Stats);
+
+	Report(&Rules, &Total, Ws_Workers(Pool), Now() - Start);
+
+	Ws_Destroy(Pool);
+	free(Tasks);
+
+	return EX_OK;
+}
@@ -0,0 +1,252 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * sm.c: Headless games by the rules of the application
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "te.h"
+#include "ai.h"
+#include "sm.h"
+
+/* Inputs, as the controller task gets them */
+#define INPUT_NONE			0
+#define INPUT_LEFT			1
+#define INPUT_RIGHT			2
+#define INPUT_ROTATE			3
+#define INPUT_DROP			4
+
+/* The bot's state */
+typedef struct {
+	uint32_t Random;
+	/* Where the AI wants the tetromino. Valid if Planned */
+	AiMove Move;
+	uint8_t Planned;
+} SmBot;
+
+/* xorshift32, for the random bot */
+static uint32_t Random(uint32_t *State)
+{
+	*State ^= *State << 13;
+	*State ^= *State >> 17;
+	*State ^= *State << 5;
+
+	return *State;
+}
+
+/* The autoplayer of the emulator: Rotate, move, then push "drop" until
+ * the tetromino is dropped. The placement is found once per tetromino
+ * and again if an input did not work out */
+static uint8_t Decide(SmBot *Bot, const TetrisGame *Game, uint8_t Kind, const AiWeights *Weights)
+{
+	const Tetromino *Falling = &Game->Falling;
+
+	if (Kind == SM_BOT_RANDOM)
+		return Random(&Bot->Random) % (INPUT_DROP + 1);
+
+	if (!Bot->Planned) {
+		if (!Ai_FindMove(Game, Weights, &Bot->Move))
+			return INPUT_DROP;
+		Bot->Planned = 1;
+	}
+
+	if (Falling->Orientation != Bot->Move.Orientation)
+		return INPUT_ROTATE;
+	if (Falling->Pos_x < Bot->Move.Pos_x)
+		return INPUT_LEFT;
+	if (Falling->Pos_x > Bot->Move.Pos_x)
+		return INPUT_RIGHT;
+
+	return INPUT_DROP;
+}
+
+/* Play a game by the rules of the model and controller tasks in ap.c.
+ * Instead of waiting, time jumps to whatever happens next: The expiry of
+ * the falling timer or the next input. Each model round re-arms the timer
+ * for the next row due at the current falling speed, a model round happens
+ * for the timer, a successful move or rotation and a hard drop, which locks
+ * right away */
+void Sm_Play(const SmRules *Rules, unsigned long Number, SmStats *Stats)
+{
+	TetrisGame Game;
+	SmBot Bot;
+	unsigned long Tetrominoes = 1, Lines = 0, Now = 0, Timer, Input;
+	unsigned long LastSeen[TETROMINO_TYPES];
+	TeGravity Gravity = Rules->Gravity, Armed = Rules->Gravity;
+	uint16_t Fraction = 0;
+	uint8_t Type, Result, Round, Bucket, Ticks, Rows;
+
+	Te_NewGame(&Game, (uint16_t)(Rules->Seed + Number * 40503UL));
+
+	Bot.Random = (Rules->Seed ^ (uint32_t)Number * 2654435761UL) | 1;
+	Bot.Planned = 0;
+
+	for (Type = 0; Type < TETROMINO_TYPES; Type++)
+		LastSeen[Type] = 0;
+	Stats->Types[Game.Falling.Type]++;
+	LastSeen[Game.Falling.Type] = Tetrominoes;
+
+	Ticks = Te_TicksToRow(Fraction, Armed);
+	Timer = Ticks;
+	Input = Rules->InputPeriod;
+
+	for (;;) {
+		Result = 0;
+		Round = 0;
+
+		if (Input < Timer) {
+			/* The controller task */
+			Now = Input;
+			Input += Rules->InputPeriod;
+
+			switch (Decide(&Bot, &Game, Rules->Bot, Rules->Weights)) {
+			case INPUT_LEFT:
+				Round = Te_MoveLeft(&Game);
+				break;
+			case INPUT_RIGHT:
+				Round = Te_MoveRight(&Game);
+				break;
+			case INPUT_ROTATE:
+				Round = Te_Rotate(&Game);
+				break;
+			case INPUT_DROP:
+				if (Gravity < Rules->Fast) {
+					Gravity = Rules->Fast;
+				} else {
+					Te_HardDrop(&Game);
+					Result = Te_Step(&Game);
+					Round = 1;
+				}
+				break;
+			default:
+				break;
+			}
+
+			/* Gravity moved it since the plan was made */
+			if (!Round)
+				Bot.Planned = 0;
+		} else {
+			/* The model task on the falling timer */
+			Now = Timer;
+			Rows = Te_RowsDue(&Fraction, Armed, Ticks);
+			if (Rows)
+				Result = Te_Fall(&Game, Rows);
+			Round = 1;
+		}
+
+		if (Result & TE_LOCKED) {
+			Gravity = Rules->Gravity;
+			Fraction = 0;
+			Bot.Planned = 0;
+			Stats->Clears[Result & TE_CLEARED]++;
+			Lines += Result & TE_CLEARED;
+
+			if (Result & TE_GAME_OVER)
+				break;
+
+			if (++Tetrominoes > Rules->Limit) {
+				Stats->Stopped++;
+				Tetrominoes--;
+				break;
+			}
+
+			Type = Game.Falling.Type;
+			Stats->Types[Type]++;
+			if (Tetrominoes - LastSeen[Type] - 1 > Stats->Drought)
+				Stats->Drought = Tetrominoes - LastSeen[Type] - 1;
+			LastSeen[Type] = Tetrominoes;
+		}
+
+		if (Round) {
+			Armed = Gravity;
+			Ticks = Te_TicksToRow(Fraction, Armed);
+			Timer = Now + Ticks;
+		}
+	}
+
+	Stats->Games++;
+	Stats->Tetrominoes += Tetrominoes;
+	Stats->Lines += Lines;
+	Stats->Ticks += Now;
+	if ((Stats->Games == 1) || (Lines < Stats->MinLines))
+		Stats->MinLines = Lines;
+	if (Lines > Stats->MaxLines)
+		Stats->MaxLines = Lines;
+
+	for (Bucket = 0; (Bucket < SM_LENGTH_BUCKETS - 1) && (Tetrominoes >> Bucket); Bucket++)
+		;
+	Stats->Lengths[Bucket]++;
+}
+
+void Sm_Merge(SmStats *Total, const SmStats *Stats)
+{
+	uint8_t Index;
+
+	if (!Stats->Games)
+		return;
+
+	if (!Total->Games || (Stats->MinLines < Total->MinLines))
+		Total->MinLines = Stats->MinLines;
+	if (Stats->MaxLines > Total->MaxLines)
+		Total->MaxLines = Stats->MaxLines;
+	if (Stats->Drought > Total->Drought)
+		Total->Drought = Stats->Drought;
+
+	Total->Games += Stats->Games;
+	Total->Stopped += Stats->Stopped;
+	Total->Tetrominoes += Stats->Tetrominoes;
+	Total->Lines += Stats->Lines;
+	Total->Ticks += Stats->Ticks;
+
+	for (Index = 0; Index <= TETROMINO_HEIGHT; Index++)
+		Total->Clears[Index] += Stats->Clears[Index];
+	for (Index = 0; Index < TETROMINO_TYPES; Index++)
+		Total->Types[Index] += Stats->Types[Index];
+	for (Index = 0; Index < SM_LENGTH_BUCKETS; Index++)
+		Total->Lengths[Index] += Stats->Lengths[Index];
+}
+
+TeGravity Sm_ParseGravity(const char *Text)
+{
+	unsigned long Value;
+	char *End;
+
+	Value = strtoul(Text, &End, 10);
+	if (!Value || (End == Text))
+		return 0;
+
+	if (!*End)
+		return (Value > 255) ? 0 : TE_GRAVITY(1, Value);
+
+	if (strcmp(End, "G") || (Value > 64))
+		return 0;
+
+	return TE_GRAVITY(Value, 1);
+}
@@ -0,0 +1,93 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * sm.h: Headless games by the rules of the application
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef SM_H
+#define SM_H
+
+#include <stdint.h>
+
+#include "te.h"
+#include "ai.h"
+
+/* Bots */
+#define SM_BOT_AI			0
+#define SM_BOT_RANDOM			1
+
+/* Buckets of the histogram of game lengths. Bucket N counts games of
+ * 2^(N-1) up to 2^N - 1 tetrominoes */
+#define SM_LENGTH_BUCKETS		24
+
+/* How the games are played. Times in ticks of 4 ms, like the firmware's
+ * application timer */
+typedef struct {
+	/* Falling speed and the one after the first push of "drop" */
+	TeGravity Gravity;
+	TeGravity Fast;
+	/* Time between two inputs of the bot */
+	uint16_t InputPeriod;
+	/* Games are stopped after this many tetrominoes */
+	unsigned long Limit;
+	uint8_t Bot;
+	/* What the AI bot rates placements by */
+	const AiWeights *Weights;
+	/* Seed of the first game. Game N is seeded from it and N */
+	uint32_t Seed;
+} SmRules;
+
+typedef struct {
+	unsigned long Games;
+	/* Games that reached the limit rather than ended */
+	unsigned long Stopped;
+	unsigned long Tetrominoes;
+	unsigned long Lines;
+	unsigned long Ticks;
+	unsigned long MinLines;
+	unsigned long MaxLines;
+	/* Locks that completed 0, 1, ... rows */
+	unsigned long Clears[TETROMINO_HEIGHT + 1];
+	/* Tetrominoes dealt of each type */
+	unsigned long Types[TETROMINO_TYPES];
+	/* Most tetrominoes dealt in a row without a certain type */
+	unsigned long Drought;
+	unsigned long Lengths[SM_LENGTH_BUCKETS];
+} SmStats;
+
+/* Play game Number by the rules and add it to the statistics. The same
+ * number always plays the same game */
+extern void Sm_Play(const SmRules *Rules, unsigned long Number, SmStats *Stats);
+
+/* Add statistics to others */
+extern void Sm_Merge(SmStats *Total, const SmStats *Stats);
+
+/* Get the gravity from the ticks per row, "250", or the rows per tick,
+ * "20G". Returns 0 if the text is neither */
+extern TeGravity Sm_ParseGravity(const char *Text);
+
+#endif /* SM_H */
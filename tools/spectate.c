@@ -0,0 +1,242 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * spectate.c: Draws the game a device or the emulator streams, live
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sysexits.h>
+#include <sys/stat.h>
+
+#include "te.h"
+#include "vs.h"
+#include "sp.h"
+
+/* Milliseconds between two frames drawn at most, about 60 per second */
+#define FRAME_MS			16
+
+/* Longest line of text of the device shown */
+#define STATUS_SIZE			64
+
+static volatile sig_atomic_t Quit;
+
+static void Stop(int Signal)
+{
+	(void)Signal;
+	Quit = 1;
+}
+
+static long Now(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return Ts.tv_sec * 1000L + Ts.tv_nsec / 1000000L;
+}
+
+/* The device streams at the speed of its UART, see uc.h */
+static int Open(const char *Path)
+{
+	struct termios Attributes;
+	int Fd;
+
+	Fd = strcmp(Path, "-") ? open(Path, O_RDONLY | O_NOCTTY) : STDIN_FILENO;
+	if (Fd < 0)
+		return -1;
+
+	if (isatty(Fd) && !tcgetattr(Fd, &Attributes)) {
+		cfmakeraw(&Attributes);
+		cfsetspeed(&Attributes, B57600);
+		tcsetattr(Fd, TCSANOW, &Attributes);
+	}
+
+	return Fd;
+}
+
+/* Locked squares, the falling tetromino and where it would land, with
+ * the board's column 0 on the right as on the device */
+static void Draw(const SpView *View, const char *Status, unsigned long Frames)
+{
+	BoardRow Falling[PLAYFIELD_ROWS], Ghost[PLAYFIELD_ROWS];
+	const BoardRow *Board = PLAYFIELD_BOARD(View->Playfield);
+	const Tetromino *Piece = &View->Falling;
+	uint8_t Row, Column;
+	BoardRow Square;
+
+	memset(Falling, 0, sizeof(Falling));
+	memset(Ghost, 0, sizeof(Ghost));
+	if (Piece->Type < TETROMINO_TYPES) {
+		Te_AddTetromino(PLAYFIELD_BOARD(Falling), Piece->Type, Piece->Orientation, Piece->Pos_x, Piece->Pos_y);
+		Te_AddTetromino(PLAYFIELD_BOARD(Ghost), Piece->Type, Piece->Orientation, Piece->Pos_x
+			,Te_LandingRow(Board, Piece->Type, Piece->Orientation, Piece->Pos_x, Piece->Pos_y));
+	}
+
+	printf("\033[H");
+	for (Row = 0; Row < BOARD_ROWS; Row++) {
+		putchar('|');
+		for (Column = BOARD_COLUMNS; Column-- > 0; ) {
+			Square = (BoardRow)1 << Column;
+			if (PLAYFIELD_BOARD(Falling)[Row] & Square)
+				fputs("##", stdout);
+			else if (Board[Row] & Square)
+				fputs("[]", stdout);
+			else if (PLAYFIELD_BOARD(Ghost)[Row] & Square)
+				fputs("::", stdout);
+			else
+				fputs("  ", stdout);
+		}
+		fputs("|\033[K\n", stdout);
+	}
+	putchar('+');
+	for (Column = 0; Column < BOARD_COLUMNS; Column++)
+		fputs("--", stdout);
+	fputs("+\033[K\n", stdout);
+
+	if (View->Known < BOARD_ROWS)
+		printf("Score: %u, waiting for the board\033[K\n", View->Score);
+	else
+		printf("Score: %u\033[K\n", View->Score);
+	printf("Frames: %lu, boards missed: %u\033[K\n", Frames, View->Missed);
+	printf("%s\033[K\n\033[J", Status);
+
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	VsReceiver Receiver;
+	SpMessage Message;
+	SpView View;
+	struct pollfd Poll;
+	struct stat Info;
+	uint8_t Bytes[256];
+	char Line[STATUS_SIZE], Status[STATUS_SIZE] = "";
+	unsigned long Frames = 0;
+	long Drawn = 0, Wait;
+	ssize_t Read, Index;
+	uint8_t Kind, Changed = 1, Follow;
+	size_t Length = 0;
+	int Fd;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s tty | file | -\n", argv[0]);
+		return EX_USAGE;
+	}
+
+	Fd = Open(argv[1]);
+	if (Fd < 0) {
+		perror(argv[1]);
+		return EX_NOINPUT;
+	}
+
+	/* A file the emulator still writes is followed like "tail -f" */
+	Follow = !fstat(Fd, &Info) && S_ISREG(Info.st_mode);
+
+	signal(SIGINT, Stop);
+	signal(SIGTERM, Stop);
+
+	memset(&Receiver, 0, sizeof(Receiver));
+	Sp_Start(&View);
+
+	/* Clear the screen, hide the cursor */
+	printf("\033[2J\033[?25l");
+
+	Poll.fd = Fd;
+	Poll.events = POLLIN;
+
+	while (!Quit) {
+		/* Changes are drawn at most every FRAME_MS, the bytes read
+		 * meanwhile are all applied */
+		Wait = Changed ? FRAME_MS - (Now() - Drawn) : -1;
+		if (Wait <= 0) {
+			if (Changed) {
+				Draw(&View, Status, Frames);
+				Drawn = Now();
+				Changed = 0;
+			}
+			Wait = Follow ? FRAME_MS : -1;
+		}
+
+		if (!Follow && (poll(&Poll, 1, Wait) <= 0))
+			continue;
+
+		Read = read(Fd, Bytes, sizeof(Bytes));
+		if ((Read < 0) && (errno == EINTR))
+			continue;
+		if (Read < 0) {
+			perror(argv[1]);
+			break;
+		}
+		if (!Read) {
+			if (!Follow)
+				break;
+			usleep(FRAME_MS * 1000);
+			continue;
+		}
+
+		for (Index = 0; Index < Read; Index++) {
+			/* The lines of text the device prints come between the
+			 * frames. The last one is shown */
+			if (!Receiver.Received && (Bytes[Index] != VS_FRAME_START) && (Bytes[Index] < 0x80)) {
+				if (Bytes[Index] == '\n') {
+					Line[Length] = '\0';
+					strcpy(Status, Line);
+					Length = 0;
+					Changed = 1;
+				} else if ((Bytes[Index] >= ' ') && (Length < sizeof(Line) - 1)) {
+					Line[Length++] = Bytes[Index];
+				}
+				continue;
+			}
+
+			Kind = Vs_Unframe(&Receiver, Bytes[Index]);
+			if (Sp_Decode(&Receiver, Kind, &Message) != VS_NONE) {
+				Sp_Apply(&View, &Message);
+				Frames++;
+				Changed = 1;
+			}
+		}
+	}
+
+	if (Changed)
+		Draw(&View, Status, Frames);
+
+	/* Show the cursor again */
+	printf("\033[?25h");
+
+	return EX_OK;
+}
@@ -0,0 +1,204 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * tt.c: Transposition table shared by the search threads
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tt.h"
+
+/* Size of a cache line in bytes */
+#define CACHE_LINE			64
+
+typedef struct {
+	uint64_t Check;
+	uint64_t Data;
+} TtEntry;
+
+#define BUCKET_ENTRIES			(CACHE_LINE / sizeof(TtEntry))
+
+typedef struct {
+	TtEntry Entry[BUCKET_ENTRIES];
+} TtBucket;
+
+/* The data word: The rating in the lower half, then the depth and the
+ * search the entry was stored in */
+#define DATA(Value, Depth, Age)		((uint32_t)(Value) | ((uint64_t)(Depth) << 32) | ((uint64_t)(Age) << 40))
+#define DATA_VALUE(Data)		((int32_t)(uint32_t)(Data))
+#define DATA_DEPTH(Data)		((uint8_t)((Data) >> 32))
+#define DATA_AGE(Data)			((uint8_t)((Data) >> 40))
+
+/* The statistics are counted per table. Each counter has a cache line of
+ * its own, so the threads do not fight over one line for all of them */
+typedef struct {
+	unsigned long Count;
+	char Padding[CACHE_LINE - sizeof(unsigned long)];
+} TtCounter;
+
+struct TtTable {
+	TtBucket *Buckets;
+	uint64_t Mask;
+	uint8_t Policy;
+	uint8_t Age;
+	TtCounter Probes;
+	TtCounter Hits;
+	TtCounter Stores;
+	TtCounter Evictions;
+};
+
+#define LOAD(Word)			__atomic_load_n(&(Word), __ATOMIC_RELAXED)
+#define STORE(Word, Value)		__atomic_store_n(&(Word), (Value), __ATOMIC_RELAXED)
+#define COUNT(Counter)			__atomic_fetch_add(&(Counter).Count, 1, __ATOMIC_RELAXED)
+
+TtTable *Tt_Create(unsigned long Bytes, uint8_t Policy)
+{
+	TtTable *Table;
+	unsigned long Buckets = 1;
+	void *Memory;
+
+	while (2 * Buckets * sizeof(TtBucket) <= Bytes)
+		Buckets *= 2;
+
+	Table = calloc(1, sizeof(TtTable));
+	if (!Table)
+		return NULL;
+
+	if (posix_memalign(&Memory, CACHE_LINE, Buckets * sizeof(TtBucket))) {
+		free(Table);
+		return NULL;
+	}
+
+	Table->Buckets = Memory;
+	Table->Mask = Buckets - 1;
+	Table->Policy = Policy;
+	Tt_Clear(Table);
+
+	return Table;
+}
+
+void Tt_NewSearch(TtTable *Table)
+{
+	Table->Age++;
+}
+
+/* The lower bits of the key select the bucket. Key zero is taken for an
+ * empty entry, a position that really hashes to it is never found */
+int Tt_Probe(TtTable *Table, uint64_t Key, int32_t *Value)
+{
+	TtBucket *Bucket = &Table->Buckets[Key & Table->Mask];
+	uint64_t Data;
+	unsigned Index;
+
+	COUNT(Table->Probes);
+
+	for (Index = 0; Index < BUCKET_ENTRIES; Index++) {
+		Data = LOAD(Bucket->Entry[Index].Data);
+		if ((LOAD(Bucket->Entry[Index].Check) ^ Data) == Key) {
+			*Value = DATA_VALUE(Data);
+			COUNT(Table->Hits);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void Tt_Store(TtTable *Table, uint64_t Key, uint8_t Depth, int32_t Value)
+{
+	TtBucket *Bucket = &Table->Buckets[Key & Table->Mask];
+	uint64_t Data, Victim = 0;
+	unsigned Index, Replace = 0;
+	int Found = 0;
+
+	/* Already there, e.g. stored by another thread in the meantime, or the
+	 * entry the policy picks */
+	for (Index = 0; Index < BUCKET_ENTRIES; Index++) {
+		Data = LOAD(Bucket->Entry[Index].Data);
+		if ((LOAD(Bucket->Entry[Index].Check) ^ Data) == Key) {
+			Replace = Index;
+			Found = 1;
+			break;
+		}
+
+		switch (Table->Policy) {
+		case TT_REPLACE_DEPTH:
+			if (!Index || (DATA_DEPTH(Data) < DATA_DEPTH(Victim))) {
+				Replace = Index;
+				Victim = Data;
+			}
+			break;
+		case TT_REPLACE_AGED:
+			if (  !Index
+			    || ((DATA_AGE(Data) != Table->Age) && (DATA_AGE(Victim) == Table->Age))
+			    || ((DATA_AGE(Data) == Table->Age) == (DATA_AGE(Victim) == Table->Age) && (DATA_DEPTH(Data) < DATA_DEPTH(Victim)))) {
+				Replace = Index;
+				Victim = Data;
+			}
+			break;
+		default:
+			Replace = (Key >> 32) % BUCKET_ENTRIES;
+			break;
+		}
+	}
+
+	if (!Found && (LOAD(Bucket->Entry[Replace].Check) != LOAD(Bucket->Entry[Replace].Data)))
+		COUNT(Table->Evictions);
+
+	Data = DATA(Value, Depth, Table->Age);
+	STORE(Bucket->Entry[Replace].Check, Key ^ Data);
+	STORE(Bucket->Entry[Replace].Data, Data);
+
+	COUNT(Table->Stores);
+}
+
+void Tt_Clear(TtTable *Table)
+{
+	memset(Table->Buckets, 0, (Table->Mask + 1) * sizeof(TtBucket));
+	Table->Probes.Count = 0;
+	Table->Hits.Count = 0;
+	Table->Stores.Count = 0;
+	Table->Evictions.Count = 0;
+}
+
+void Tt_Stats(const TtTable *Table, TtStats *Stats)
+{
+	Stats->Probes = Table->Probes.Count;
+	Stats->Hits = Table->Hits.Count;
+	Stats->Stores = Table->Stores.Count;
+	Stats->Evictions = Table->Evictions.Count;
+}
+
+void Tt_Destroy(TtTable *Table)
+{
+	free(Table->Buckets);
+	free(Table);
+}
@@ -0,0 +1,79 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * tt.h: Transposition table shared by the search threads
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef TT_H
+#define TT_H
+
+#include <stdint.h>
+
+/* Remembers the ratings of positions searched before. The table is an array
+ * of buckets of one cache line each, a position may be in any entry of the
+ * bucket its key selects. Threads read and write it without locks: An entry
+ * is two 64 bit words, the key XORed with the data and the data. An entry
+ * torn by a concurrent write does not check out and counts as a miss */
+typedef struct TtTable TtTable;
+
+/* What makes way for a new position when its bucket is full */
+#define TT_REPLACE_ALWAYS		0	/* The entry its key selects */
+#define TT_REPLACE_DEPTH		1	/* The shallowest entry */
+#define TT_REPLACE_AGED			2	/* The shallowest of the oldest search */
+
+typedef struct {
+	unsigned long Probes;
+	unsigned long Hits;
+	unsigned long Stores;
+	/* Stores that replaced a different position */
+	unsigned long Evictions;
+} TtStats;
+
+/* Create a table of at least the given size in bytes, rounded down to a
+ * power of two number of buckets. NULL on failure */
+extern TtTable *Tt_Create(unsigned long Bytes, uint8_t Policy);
+
+/* Mark the start of a new search. Entries of older searches get replaced
+ * first with TT_REPLACE_AGED */
+extern void Tt_NewSearch(TtTable *Table);
+
+/* Look up a position. Non zero if found, with its rating in Value */
+extern int Tt_Probe(TtTable *Table, uint64_t Key, int32_t *Value);
+
+/* Remember the rating of a position searched Depth tetrominoes deep. The
+ * depth only decides what gets replaced, it has to be part of the key if
+ * ratings of different depths must not be mixed */
+extern void Tt_Store(TtTable *Table, uint64_t Key, uint8_t Depth, int32_t Value);
+
+/* Forget all positions and reset the statistics */
+extern void Tt_Clear(TtTable *Table);
+
+extern void Tt_Stats(const TtTable *Table, TtStats *Stats);
+
+extern void Tt_Destroy(TtTable *Table);
+
+#endif /* TT_H */
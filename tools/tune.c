@@ -0,0 +1,453 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * tune.c: Tuning of the autoplayer's weights by self-play
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sysexits.h>
+
+#include "te.h"
+#include "ap.h"
+#include "ai.h"
+#include "ws.h"
+#include "sm.h"
+
+/* Games played by one task */
+#define GAMES_PER_TASK			16
+
+/* Number of weights */
+#define WEIGHTS				4
+
+/* Most candidates per generation */
+#define POPULATION_MAX			256
+
+/* The spread of the weights never gets below this, so the search does
+ * not come to a standstill. In hundredths, like the weights */
+#define SIGMA_MIN			2.0
+
+/* Version of the checkpoint file */
+#define CHECKPOINT_VERSION		2
+
+/* A separable evolution strategy: Each generation samples candidate weights
+ * from a normal distribution around Mean, independently for each weight.
+ * All candidates play the same games, the better half moves Mean towards
+ * them and sets the spread Sigma for the next generation. Everything needed
+ * to go on is in here and in the checkpoint file */
+typedef struct {
+	/* The games and their rules. Kept with the run, results of other
+	 * games can not be compared */
+	unsigned long Games;
+	unsigned long Limit;
+	uint32_t Seed;
+	TeGravity Gravity;
+	TeGravity Fast;
+	uint16_t InputPeriod;
+	unsigned Population;
+
+	unsigned long Generation;
+	/* State of the random number generator the candidates come from */
+	uint64_t Random;
+	double Mean[WEIGHTS];
+	double Sigma[WEIGHTS];
+	/* The best candidate so far and the lines per game it made */
+	AiWeights Best;
+	double Fitness;
+} TuneRun;
+
+/* A task: Some of the games of a candidate */
+typedef struct {
+	const SmRules *Rules;
+	unsigned long First;
+	unsigned long Count;
+	SmStats Stats;
+} TuneTask;
+
+/* 64 bit constant without the long long suffix that C89 does not know */
+#define RANDOM_CONSTANT(High, Low)	(((uint64_t)(High) << 32) | (Low))
+
+/* splitmix64 */
+static uint64_t Random(uint64_t *State)
+{
+	uint64_t Number;
+
+	*State += RANDOM_CONSTANT(0x9E3779B9, 0x7F4A7C15);
+	Number = *State;
+	Number = (Number ^ (Number >> 30)) * RANDOM_CONSTANT(0xBF58476D, 0x1CE4E5B9);
+	Number = (Number ^ (Number >> 27)) * RANDOM_CONSTANT(0x94D049BB, 0x133111EB);
+
+	return Number ^ (Number >> 31);
+}
+
+/* Standard normal by Box-Muller. The 53 upper bits make a uniform number
+ * in (0, 1] */
+static double Normal(uint64_t *State)
+{
+	double First = ((Random(State) >> 11) + 1.0) / 9007199254740992.0;
+	double Second = (Random(State) >> 11) / 9007199254740992.0;
+
+	return sqrt(-2.0 * log(First)) * cos(6.283185307179586 * Second);
+}
+
+static int16_t *Weight(AiWeights *Weights, uint8_t Index)
+{
+	switch (Index) {
+	case 0:
+		return &Weights->Height;
+	case 1:
+		return &Weights->Lines;
+	case 2:
+		return &Weights->Holes;
+	default:
+		return &Weights->Bumpiness;
+	}
+}
+
+static int16_t Round(double Value)
+{
+	if (Value > INT16_MAX)
+		return INT16_MAX;
+	if (Value < -INT16_MAX)
+		return -INT16_MAX;
+
+	return (int16_t)floor(Value + 0.5);
+}
+
+static void PlayTask(void *Arg)
+{
+	TuneTask *Task = Arg;
+	unsigned long Game;
+
+	for (Game = Task->First; Game < Task->First + Task->Count; Game++)
+		Sm_Play(Task->Rules, Game, &Task->Stats);
+}
+
+/* Checkpoints are text, "name values" a line. Written to a new file that
+ * then replaces the old one, so there always is a complete one */
+static int Save(const char *Name, const TuneRun *Run)
+{
+	char Temporary[4096];
+	FILE *File;
+	uint8_t Index;
+
+	if (snprintf(Temporary, sizeof(Temporary), "%s.tmp", Name) >= (int)sizeof(Temporary))
+		return 0;
+
+	File = fopen(Temporary, "w");
+	if (!File)
+		return 0;
+
+	fprintf(File, "version %u\n", CHECKPOINT_VERSION);
+	fprintf(File, "board %u %u\n", BOARD_COLUMNS, BOARD_ROWS);
+	fprintf(File, "games %lu %lu %lu\n", Run->Games, Run->Limit, (unsigned long)Run->Seed);
+	fprintf(File, "rules %lu %lu %u\n", (unsigned long)Run->Gravity, (unsigned long)Run->Fast, Run->InputPeriod);
+	fprintf(File, "population %u\n", Run->Population);
+	fprintf(File, "generation %lu\n", Run->Generation);
+	fprintf(File, "random %08lx%08lx\n", (unsigned long)(Run->Random >> 32), (unsigned long)(Run->Random & 0xFFFFFFFFUL));
+	fprintf(File, "mean");
+	for (Index = 0; Index < WEIGHTS; Index++)
+		fprintf(File, " %.17g", Run->Mean[Index]);
+	fprintf(File, "\nsigma");
+	for (Index = 0; Index < WEIGHTS; Index++)
+		fprintf(File, " %.17g", Run->Sigma[Index]);
+	fprintf(File, "\nbest %d %d %d %d %.17g\n", Run->Best.Height, Run->Best.Lines, Run->Best.Holes, Run->Best.Bumpiness, Run->Fitness);
+
+	if (fclose(File) || rename(Temporary, Name)) {
+		remove(Temporary);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Read a checkpoint for this board. The run is only changed if it is one.
+ * Returns 1 if it was read, 0 if there is none yet and -1 if there is one
+ * that can not be used */
+static int Load(const char *Name, TuneRun *Run)
+{
+	TuneRun Loaded;
+	unsigned long Version, Columns, Rows, Seed, High, Low, Gravity, Fast;
+	unsigned InputPeriod;
+	int Height, Lines, Holes, Bumpiness, Read;
+	FILE *File;
+
+	File = fopen(Name, "r");
+	if (!File)
+		return (errno == ENOENT) ? 0 : -1;
+
+	memset(&Loaded, 0, sizeof(Loaded));
+	Read = fscanf(File, "version %lu board %lu %lu games %lu %lu %lu rules %lu %lu %u population %u generation %lu random %8lx%8lx"
+			, &Version, &Columns, &Rows, &Loaded.Games, &Loaded.Limit, &Seed
+			, &Gravity, &Fast, &InputPeriod, &Loaded.Population, &Loaded.Generation, &High, &Low);
+	Read += fscanf(File, " mean %lf %lf %lf %lf sigma %lf %lf %lf %lf best %d %d %d %d %lf"
+			, &Loaded.Mean[0], &Loaded.Mean[1], &Loaded.Mean[2], &Loaded.Mean[3]
+			, &Loaded.Sigma[0], &Loaded.Sigma[1], &Loaded.Sigma[2], &Loaded.Sigma[3]
+			, &Height, &Lines, &Holes, &Bumpiness, &Loaded.Fitness);
+	fclose(File);
+
+	if ((Read != 26) || (Version != CHECKPOINT_VERSION) || (Columns != BOARD_COLUMNS) || (Rows != BOARD_ROWS)
+	    || !Loaded.Games || (Loaded.Population < 2) || (Loaded.Population > POPULATION_MAX)
+	    || !Gravity || !Fast || !InputPeriod || (InputPeriod > 0xFFFF))
+		return -1;
+
+	Loaded.Seed = Seed;
+	Loaded.Gravity = Gravity;
+	Loaded.Fast = Fast;
+	Loaded.InputPeriod = InputPeriod;
+	Loaded.Random = ((uint64_t)High << 32) | Low;
+	Loaded.Best.Height = Height;
+	Loaded.Best.Lines = Lines;
+	Loaded.Best.Holes = Holes;
+	Loaded.Best.Bumpiness = Bumpiness;
+	*Run = Loaded;
+
+	return 1;
+}
+
+/* Play a generation and move on to the next one */
+static int Generation(WsPool *Pool, TuneRun *Run)
+{
+	static AiWeights Candidates[POPULATION_MAX];
+	static SmRules Rules[POPULATION_MAX];
+	static double Fitness[POPULATION_MAX];
+	static unsigned Ranks[POPULATION_MAX];
+	const unsigned long Chunks = (Run->Games + GAMES_PER_TASK - 1) / GAMES_PER_TASK;
+	const unsigned Parents = (Run->Population + 1) / 2;
+	double Recombination[POPULATION_MAX], Sum = 0, Mean[WEIGHTS], Spread[WEIGHTS], Deviation;
+	TuneTask *Tasks;
+	SmStats Total;
+	unsigned Candidate, Rank, Swap;
+	unsigned long Chunk, Task;
+	uint8_t Index;
+
+	Tasks = calloc(Run->Population * Chunks, sizeof(TuneTask));
+	if (!Tasks)
+		return 0;
+
+	/* The first candidate is the mean itself */
+	for (Candidate = 0; Candidate < Run->Population; Candidate++) {
+		for (Index = 0; Index < WEIGHTS; Index++)
+			*Weight(&Candidates[Candidate], Index) = Round(Run->Mean[Index] + (Candidate ? Run->Sigma[Index] * Normal(&Run->Random) : 0));
+
+		Rules[Candidate].Gravity = Run->Gravity;
+		Rules[Candidate].Fast = Run->Fast;
+		Rules[Candidate].InputPeriod = Run->InputPeriod;
+		Rules[Candidate].Limit = Run->Limit;
+		Rules[Candidate].Bot = SM_BOT_AI;
+		Rules[Candidate].Weights = &Candidates[Candidate];
+		Rules[Candidate].Seed = Run->Seed;
+
+		for (Chunk = 0; Chunk < Chunks; Chunk++) {
+			Task = Candidate * Chunks + Chunk;
+			Tasks[Task].Rules = &Rules[Candidate];
+			Tasks[Task].First = Chunk * GAMES_PER_TASK;
+			Tasks[Task].Count = (Chunk < Chunks - 1) ? GAMES_PER_TASK : Run->Games - Chunk * GAMES_PER_TASK;
+			if (!Ws_Submit(Pool, PlayTask, &Tasks[Task]))
+				PlayTask(&Tasks[Task]);
+		}
+	}
+
+	Ws_Wait(Pool);
+
+	/* Lines per game. Ties go to the earlier candidate */
+	for (Candidate = 0; Candidate < Run->Population; Candidate++) {
+		memset(&Total, 0, sizeof(Total));
+		for (Chunk = 0; Chunk < Chunks; Chunk++)
+			Sm_Merge(&Total, &Tasks[Candidate * Chunks + Chunk].Stats);
+		Fitness[Candidate] = (double)Total.Lines / Total.Games;
+
+		for (Rank = Candidate; (Rank > 0) && (Fitness[Ranks[Rank - 1]] < Fitness[Candidate]); Rank--)
+			Ranks[Rank] = Ranks[Rank - 1];
+		Ranks[Rank] = Candidate;
+	}
+
+	free(Tasks);
+
+	if (Fitness[Ranks[0]] > Run->Fitness) {
+		Run->Fitness = Fitness[Ranks[0]];
+		Run->Best = Candidates[Ranks[0]];
+	}
+
+	/* The better half, the best weighted most as in CMA-ES. The spread
+	 * is that of the better half around the old mean */
+	for (Rank = 0; Rank < Parents; Rank++) {
+		Recombination[Rank] = log(Parents + 0.5) - log(Rank + 1.0);
+		Sum += Recombination[Rank];
+	}
+
+	for (Index = 0; Index < WEIGHTS; Index++) {
+		Mean[Index] = 0;
+		Spread[Index] = 0;
+		for (Rank = 0; Rank < Parents; Rank++) {
+			Swap = Ranks[Rank];
+			Deviation = *Weight(&Candidates[Swap], Index) - Run->Mean[Index];
+			Mean[Index] += Recombination[Rank] / Sum * *Weight(&Candidates[Swap], Index);
+			Spread[Index] += Recombination[Rank] / Sum * Deviation * Deviation;
+		}
+		Run->Mean[Index] = Mean[Index];
+		Run->Sigma[Index] = (sqrt(Spread[Index]) > SIGMA_MIN) ? sqrt(Spread[Index]) : SIGMA_MIN;
+	}
+
+	printf("%5lu  best %8.2f  median %8.2f  mean weights %6.1f %6.1f %6.1f %6.1f  sigma %5.1f %5.1f %5.1f %5.1f\n"
+		, Run->Generation, Fitness[Ranks[0]], Fitness[Ranks[Run->Population / 2]]
+		, Run->Mean[0], Run->Mean[1], Run->Mean[2], Run->Mean[3]
+		, Run->Sigma[0], Run->Sigma[1], Run->Sigma[2], Run->Sigma[3]);
+	fflush(stdout);
+
+	Run->Generation++;
+
+	return 1;
+}
+
+static void Usage(const char *Name)
+{
+	fprintf(stderr, "usage: %s [-c checkpoint] [-G generations] [-p population] [-n games] [-l limit]\n"
+			"       [-s seed] [-S sigma] [-g gravity] [-f fast] [-i input period] [-j workers]\n", Name);
+	exit(EX_USAGE);
+}
+
+int main(int argc, char **argv)
+{
+	TuneRun Run;
+	WsPool *Pool;
+	const char *Checkpoint = NULL;
+	unsigned long Generations = 20;
+	unsigned Workers = sysconf(_SC_NPROCESSORS_ONLN);
+	double Sigma = 20;
+	uint8_t Index;
+	int Option, Loaded = 0;
+
+	memset(&Run, 0, sizeof(Run));
+	Run.Games = 256;
+	Run.Limit = 500;
+	Run.Seed = TETROMINO_SEED;
+	Run.Gravity = GRAVITY_DEFAULT;
+	Run.Fast = GRAVITY_FAST;
+	Run.InputPeriod = 12;
+	Run.Population = 16;
+
+	while ((Option = getopt(argc, argv, "c:G:p:n:l:s:S:g:f:i:j:")) != -1) {
+		switch (Option) {
+		case 'c':
+			Checkpoint = optarg;
+			break;
+		case 'G':
+			Generations = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			Run.Population = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			Run.Games = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			Run.Limit = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			Run.Seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			Sigma = strtod(optarg, NULL);
+			break;
+		case 'g':
+			Run.Gravity = Sm_ParseGravity(optarg);
+			break;
+		case 'f':
+			Run.Fast = Sm_ParseGravity(optarg);
+			break;
+		case 'i':
+			Run.InputPeriod = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			Workers = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			Usage(argv[0]);
+		}
+	}
+
+	if ((optind != argc) || !Run.Games || (Run.Population < 2) || (Run.Population > POPULATION_MAX)
+	    || !Run.Gravity || !Run.Fast || !Run.InputPeriod)
+		Usage(argv[0]);
+
+	/* A checkpoint brings its own games and rules along. One that is
+	 * there but can not be used is left alone */
+	if (Checkpoint)
+		Loaded = Load(Checkpoint, &Run);
+	if (Loaded < 0) {
+		fprintf(stderr, "%s is no checkpoint of a %u x %u board, not overwriting it\n", Checkpoint, BOARD_COLUMNS, BOARD_ROWS);
+		return EX_DATAERR;
+	}
+	if (Loaded) {
+		printf("resuming %s at generation %lu\n", Checkpoint, Run.Generation);
+	} else {
+		Run.Random = Run.Seed;
+		Run.Best = Ai_DefaultWeights;
+		Run.Fitness = -1;
+		for (Index = 0; Index < WEIGHTS; Index++) {
+			Run.Mean[Index] = *Weight(&Run.Best, Index);
+			Run.Sigma[Index] = Sigma;
+		}
+	}
+
+	printf("%lu games of up to %lu tetrominoes per candidate, %u candidates per generation\n"
+		, Run.Games, Run.Limit, Run.Population);
+
+	Pool = Ws_Create(Workers);
+	if (!Pool) {
+		fprintf(stderr, "could not set up %u workers\n", Workers);
+		return EX_OSERR;
+	}
+
+	while (Run.Generation < Generations) {
+		if (!Generation(Pool, &Run)) {
+			fprintf(stderr, "out of memory\n");
+			return EX_OSERR;
+		}
+		if (Checkpoint && !Save(Checkpoint, &Run)) {
+			fprintf(stderr, "could not write %s\n", Checkpoint);
+			return EX_CANTCREAT;
+		}
+	}
+
+	Ws_Destroy(Pool);
+
+	/* Ready to be pasted into ai.c */
+	printf("\n/* %.2f lines per game */\n", Run.Fitness);
+	printf("const AiWeights Ai_DefaultWeights = {\n\t %d\n\t,%d\n\t,%d\n\t,%d\n};\n"
+		, Run.Best.Height, Run.Best.Lines, Run.Best.Holes, Run.Best.Bumpiness);
+
+	return EX_OK;
+}
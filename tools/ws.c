@@ -0,0 +1,332 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ws.c: Work stealing thread pool for the host tools
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ws.h"
+
+/* Initial number of tasks a deque holds. It grows as needed */
+#define DEQUE_SIZE			64
+
+typedef struct {
+	WsFunction Function;
+	void *Arg;
+} WsTask;
+
+/* The owner pushes and pops at the bottom, thieves take from the top.
+ * Top and Bottom only ever grow, the tasks are at their value modulo the
+ * size of the array */
+typedef struct {
+	pthread_mutex_t Lock;
+	WsTask *Tasks;
+	size_t Size;
+	size_t Top;
+	size_t Bottom;
+} WsDeque;
+
+typedef struct {
+	WsPool *Pool;
+	unsigned Index;
+	pthread_t Thread;
+	WsDeque Deque;
+} WsWorker;
+
+struct WsPool {
+	unsigned Workers;
+	/* Workers whose deque is set up and, of those, whose thread is
+	 * running */
+	unsigned Ready;
+	unsigned Started;
+	WsWorker *Worker;
+	/* Guards the sleep and wake up of the workers and of Ws_Wait */
+	pthread_mutex_t Lock;
+	pthread_cond_t WorkQueued;
+	pthread_cond_t AllDone;
+	/* Tasks in the deques. Updated outside of the lock so it may briefly
+	 * be off by the tasks being pushed right now */
+	volatile long Queued;
+	/* Tasks queued but not finished yet */
+	volatile long Pending;
+	volatile unsigned long Steals;
+	unsigned Next;
+	int Stop;
+};
+
+/* The worker the calling thread is, if any */
+static pthread_key_t CurrentWorker;
+static pthread_once_t CurrentWorkerOnce = PTHREAD_ONCE_INIT;
+
+static void CreateCurrentWorker(void)
+{
+	pthread_key_create(&CurrentWorker, NULL);
+}
+
+static int Push(WsDeque *Deque, const WsTask *Task)
+{
+	WsTask *Tasks;
+	size_t Index, Count;
+
+	pthread_mutex_lock(&Deque->Lock);
+
+	Count = Deque->Bottom - Deque->Top;
+	if (Count == Deque->Size) {
+		Tasks = malloc(2 * Deque->Size * sizeof(WsTask));
+		if (!Tasks) {
+			pthread_mutex_unlock(&Deque->Lock);
+			return 0;
+		}
+		for (Index = 0; Index < Count; Index++)
+			Tasks[Index] = Deque->Tasks[(Deque->Top + Index) % Deque->Size];
+		free(Deque->Tasks);
+		Deque->Tasks = Tasks;
+		Deque->Size *= 2;
+		Deque->Top = 0;
+		Deque->Bottom = Count;
+	}
+
+	Deque->Tasks[Deque->Bottom++ % Deque->Size] = *Task;
+
+	pthread_mutex_unlock(&Deque->Lock);
+
+	return 1;
+}
+
+/* Newest task, for the owner */
+static int Pop(WsDeque *Deque, WsTask *Task)
+{
+	int Found = 0;
+
+	pthread_mutex_lock(&Deque->Lock);
+	if (Deque->Bottom != Deque->Top) {
+		*Task = Deque->Tasks[--Deque->Bottom % Deque->Size];
+		Found = 1;
+	}
+	pthread_mutex_unlock(&Deque->Lock);
+
+	return Found;
+}
+
+/* Oldest task, for the thieves. The oldest tasks tend to be the biggest
+ * ones as tasks queue their subtasks after themselves */
+static int Steal(WsDeque *Deque, WsTask *Task)
+{
+	int Found = 0;
+
+	pthread_mutex_lock(&Deque->Lock);
+	if (Deque->Bottom != Deque->Top) {
+		*Task = Deque->Tasks[Deque->Top++ % Deque->Size];
+		Found = 1;
+	}
+	pthread_mutex_unlock(&Deque->Lock);
+
+	return Found;
+}
+
+/* Own deque first, then the others starting with the next worker */
+static int FindTask(WsWorker *Worker, WsTask *Task)
+{
+	WsPool *Pool = Worker->Pool;
+	unsigned Victim;
+
+	if (Pop(&Worker->Deque, Task))
+		return 1;
+
+	for (Victim = 1; Victim < Pool->Workers; Victim++)
+		if (Steal(&Pool->Worker[(Worker->Index + Victim) % Pool->Workers].Deque, Task)) {
+			__sync_fetch_and_add(&Pool->Steals, 1);
+			return 1;
+		}
+
+	return 0;
+}
+
+static void *Work(void *Arg)
+{
+	WsWorker *Worker = Arg;
+	WsPool *Pool = Worker->Pool;
+	WsTask Task;
+
+	pthread_setspecific(CurrentWorker, Worker);
+
+	for (;;) {
+		if (FindTask(Worker, &Task)) {
+			__sync_fetch_and_sub(&Pool->Queued, 1);
+
+			Task.Function(Task.Arg);
+
+			if (__sync_sub_and_fetch(&Pool->Pending, 1) == 0) {
+				pthread_mutex_lock(&Pool->Lock);
+				pthread_cond_broadcast(&Pool->AllDone);
+				pthread_mutex_unlock(&Pool->Lock);
+			}
+			continue;
+		}
+
+		/* A task is on its way into a deque. It is there in a moment */
+		if (Pool->Queued > 0) {
+			sched_yield();
+			continue;
+		}
+
+		pthread_mutex_lock(&Pool->Lock);
+		while ((Pool->Queued <= 0) && !Pool->Stop)
+			pthread_cond_wait(&Pool->WorkQueued, &Pool->Lock);
+		pthread_mutex_unlock(&Pool->Lock);
+
+		if (Pool->Stop)
+			return NULL;
+	}
+}
+
+WsPool *Ws_Create(unsigned Workers)
+{
+	WsPool *Pool;
+	unsigned Index;
+
+	if (!Workers)
+		Workers = 1;
+
+	pthread_once(&CurrentWorkerOnce, CreateCurrentWorker);
+
+	Pool = calloc(1, sizeof(WsPool));
+	if (!Pool)
+		return NULL;
+
+	Pool->Worker = calloc(Workers, sizeof(WsWorker));
+	if (!Pool->Worker) {
+		free(Pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&Pool->Lock, NULL);
+	pthread_cond_init(&Pool->WorkQueued, NULL);
+	pthread_cond_init(&Pool->AllDone, NULL);
+
+	/* All deques have to be there before the first thief goes looking */
+	for (Index = 0; Index < Workers; Index++) {
+		WsWorker *Worker = &Pool->Worker[Index];
+
+		Worker->Pool = Pool;
+		Worker->Index = Index;
+		Worker->Deque.Size = DEQUE_SIZE;
+		Worker->Deque.Tasks = malloc(DEQUE_SIZE * sizeof(WsTask));
+		if (!Worker->Deque.Tasks)
+			break;
+		pthread_mutex_init(&Worker->Deque.Lock, NULL);
+		Pool->Ready++;
+	}
+
+	Pool->Workers = Workers;
+
+	/* No thread is started unless all of them can go to work */
+	if (Pool->Ready == Workers)
+		for (; Pool->Started < Workers; Pool->Started++)
+			if (pthread_create(&Pool->Worker[Pool->Started].Thread, NULL, Work, &Pool->Worker[Pool->Started]))
+				break;
+
+	if (Pool->Started != Workers) {
+		Ws_Destroy(Pool);
+		return NULL;
+	}
+
+	return Pool;
+}
+
+unsigned Ws_Workers(const WsPool *Pool)
+{
+	return Pool->Workers;
+}
+
+int Ws_Submit(WsPool *Pool, WsFunction Function, void *Arg)
+{
+	WsWorker *Worker = pthread_getspecific(CurrentWorker);
+	WsTask Task;
+
+	Task.Function = Function;
+	Task.Arg = Arg;
+
+	if (!Worker || (Worker->Pool != Pool))
+		Worker = &Pool->Worker[__sync_fetch_and_add(&Pool->Next, 1) % Pool->Workers];
+
+	/* Pending first, Ws_Wait must not see it drop to zero in between */
+	__sync_fetch_and_add(&Pool->Pending, 1);
+
+	if (!Push(&Worker->Deque, &Task)) {
+		__sync_fetch_and_sub(&Pool->Pending, 1);
+		return 0;
+	}
+
+	__sync_fetch_and_add(&Pool->Queued, 1);
+
+	pthread_mutex_lock(&Pool->Lock);
+	pthread_cond_signal(&Pool->WorkQueued);
+	pthread_mutex_unlock(&Pool->Lock);
+
+	return 1;
+}
+
+void Ws_Wait(WsPool *Pool)
+{
+	pthread_mutex_lock(&Pool->Lock);
+	while (Pool->Pending)
+		pthread_cond_wait(&Pool->AllDone, &Pool->Lock);
+	pthread_mutex_unlock(&Pool->Lock);
+}
+
+unsigned long Ws_Steals(const WsPool *Pool)
+{
+	return Pool->Steals;
+}
+
+void Ws_Destroy(WsPool *Pool)
+{
+	unsigned Index;
+
+	pthread_mutex_lock(&Pool->Lock);
+	Pool->Stop = 1;
+	pthread_cond_broadcast(&Pool->WorkQueued);
+	pthread_mutex_unlock(&Pool->Lock);
+
+	for (Index = 0; Index < Pool->Started; Index++)
+		pthread_join(Pool->Worker[Index].Thread, NULL);
+
+	for (Index = 0; Index < Pool->Ready; Index++) {
+		pthread_mutex_destroy(&Pool->Worker[Index].Deque.Lock);
+		free(Pool->Worker[Index].Deque.Tasks);
+	}
+
+	pthread_cond_destroy(&Pool->AllDone);
+	pthread_cond_destroy(&Pool->WorkQueued);
+	pthread_mutex_destroy(&Pool->Lock);
+	free(Pool->Worker);
+	free(Pool);
+}
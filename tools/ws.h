@@ -0,0 +1,61 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * ws.h: Work stealing thread pool for the host tools
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef WS_H
+#define WS_H
+
+/* A pool of worker threads, each with a deque of its own. A worker takes
+ * the newest task from its own deque and, once that runs dry, steals the
+ * oldest task from another worker's deque */
+typedef struct WsPool WsPool;
+
+typedef void (*WsFunction)(void *Arg);
+
+/* Start a pool with the given number of workers. NULL on failure */
+extern WsPool *Ws_Create(unsigned Workers);
+
+/* Number of workers of the pool */
+extern unsigned Ws_Workers(const WsPool *Pool);
+
+/* Queue a task. Tasks queued by a task go to the deque of the worker that
+ * runs it, others are dealt to the workers in turn. Non zero on success */
+extern int Ws_Submit(WsPool *Pool, WsFunction Function, void *Arg);
+
+/* Wait until all queued tasks, and the tasks they queued, have finished.
+ * Must not be called from within a task */
+extern void Ws_Wait(WsPool *Pool);
+
+/* Number of tasks taken from another worker's deque so far */
+extern unsigned long Ws_Steals(const WsPool *Pool);
+
+/* Stop the workers and free the pool. The pool must be idle */
+extern void Ws_Destroy(WsPool *Pool);
+
+#endif /* WS_H */
@@ -33,6 +33,8 @@
 #include "uc.h"
 #include "os.h"
 #include "ap.h"
+#include "lm.h"
+#include "vs.h"
 
 #define BUTTON_ROTATE PD2
 #define BUTTON_DROP   PD3
@@ -47,6 +49,9 @@ static volatile uint8_t CurentADCValue = 0;
 /* Key press detector */
 static volatile uint8_t KeyPress;
 
+/* Free running count of Timer2 overflows i.e. application timer ticks */
+static volatile uint16_t TickCount = 0;
+
 /* Check if one or more keys are pressed */
 static uint8_t KeyPressed(uint8_t Key)
 {
@@ -87,6 +92,9 @@ ISR(ADC_vect, ISR_NAKED)
 
 		LastValue = CurentADCValue;
 
+		/* Time stamp the input for the latency measurement */
+		Lm_Stamp();
+
 		/* Report the event to the control task */
 		Os_SetEvent(TASK_ID_CTRL, event);
 	}
@@ -98,6 +106,29 @@ ISR(ADC_vect, ISR_NAKED)
 	asm volatile("reti");
 }
 
+/* UART receive interrupt. In versus mode the bytes come from the opponent,
+ * otherwise they are dropped */
+ISR(USART_RX_vect, ISR_NAKED)
+{
+	uint8_t Data;
+
+	/* Save the context of the current task */
+	Uc_SaveContext();
+
+	/* Reading the data register clears the interrupt */
+	Data = UDR0;
+
+	/* Wake up the model when the opponent's game has ended */
+	if (Vs_Receive(Data) == VS_LOST)
+		Os_SetEvent(TASK_ID_MODEL, EVENT_LINK);
+
+	/* Restore the context */
+        Uc_RestoreContext();
+
+	/* Enable interrupts and return */
+	asm volatile("reti");
+}
+
 /* This is the Timer1 overflow ISR that is driving the OS scheduler.
  * It is abused to report key presses */
 ISR(TIMER1_OVF_vect, ISR_NAKED)
@@ -147,8 +178,10 @@ ISR(TIMER2_OVF_vect, ISR_NAKED)
 	/* Save the context of the current task */
 	Uc_SaveContext();
 
+	TickCount++;
+
 	/* Tick the application timer(s) */
-	Os_TickTimer(TIMER_ID_GAME);
+	Os_TickTimers();
 
 	/* This snippet was ripped from Peter Dannegger's debounce routines.
 	 * It counts the number of times the buttons are detected
@@ -163,6 +196,19 @@ ISR(TIMER2_OVF_vect, ISR_NAKED)
 	KeyState ^= In;                         /* then toggle debounced state */
 	KeyPress |= KeyState & In;              /* 0->1: key press detect */
 
+	/* Time stamp button edges for the latency measurement */
+	if (KeyState & In)
+		Lm_Stamp();
+
+#ifdef LATENCY_STIMULUS
+	/* No one pushes buttons in the simulator. Fake a press of the
+	 * 'rotate' button every 64 ticks (~262 ms) */
+	if ((TickCount % 64) == 0) {
+		KeyPress |= _BV(BUTTON_ROTATE);
+		Lm_Stamp();
+	}
+#endif
+
         Uc_RestoreContext();
 
 	/* Enable interrupts and return */
@@ -185,6 +231,27 @@ inline uint8_t Uc_ADCGet(void)
 	return CurentADCValue;
 }
 
+/* Return the time in units of 64 us. Wraps after ~4.2 seconds */
+uint16_t Uc_GetTime(void)
+{
+	uint8_t Count;
+	uint16_t Ticks;
+
+	Uc_EnterCritical();
+
+	Count = TCNT2;
+	Ticks = TickCount;
+
+	/* The overflow interrupt may be pending while interrupts are disabled */
+	if ((TIFR2 & _BV(TOV2)) && (Count < 0x80))
+		Ticks++;
+
+	Uc_ExitCritical();
+
+	/* One tick are 256 timer counts of 16 us each */
+	return (Ticks << 6) | (Count >> 2);
+}
+
 /* Set the timer driving the scheduler to expire within a tick
  * This will cause the scheduler to run */
 inline void Uc_ForceSchedule(void)
@@ -156,6 +156,9 @@ extern uint8_t Uc_HardwareInit(void);
 /* Get the value of the last analog to digital conversion */
 extern uint8_t Uc_ADCGet(void);
 
+/* Get the current time in units of 64 us */
+extern uint16_t Uc_GetTime(void);
+
 /* Send a byte over the UART */
 extern void Uc_UARTSend(uint8_t Data);
 
@@ -0,0 +1,337 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * vs.c: Versus mode: Garbage rows and scores exchanged with an opponent
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "te.h"
+#include "vs.h"
+
+/* Garbage rows for 0 to 4 rows cleared at once */
+static const uint8_t GarbageRows[TETROMINO_HEIGHT + 1] = { 0, 0, 1, 2, 4 };
+
+uint8_t Vs_Garbage(uint8_t Cleared)
+{
+	return (Cleared <= TETROMINO_HEIGHT) ? GarbageRows[Cleared] : GarbageRows[TETROMINO_HEIGHT];
+}
+
+uint8_t Vs_Frame(uint8_t *Bytes, uint8_t Kind, uint8_t Length)
+{
+	uint8_t Index, Sum = 0;
+
+	Bytes[0] = VS_FRAME_START;
+	Bytes[1] = (Kind << 4) | Length;
+
+	for (Index = 1; Index < Length + 2; Index++)
+		Sum += Bytes[Index];
+	Bytes[Index++] = ~Sum;
+
+	return Index;
+}
+
+uint8_t Vs_Encode(uint8_t *Bytes, const VsMessage *Message)
+{
+	uint8_t Length = 2, Index;
+
+	if (Message->Kind == VS_CLEARED) {
+		Bytes[Length++] = Message->Score;
+		Bytes[Length++] = Message->Score >> 8;
+	}
+
+	if (Message->Kind == VS_GARBAGE) {
+		Bytes[Length++] = Message->Rows;
+		Bytes[Length++] = Message->Hole;
+	}
+
+	if (Message->Kind == VS_INPUTS) {
+		Bytes[Length++] = Message->Frame;
+		Bytes[Length++] = Message->Frame >> 8;
+		Bytes[Length++] = Message->Ack;
+		Bytes[Length++] = Message->Ack >> 8;
+		for (Index = 0; Index < Message->Count / 2; Index++)
+			Bytes[Length++] = Message->Inputs[Index];
+	}
+
+	if (Message->Kind == VS_HELLO) {
+		Bytes[Length++] = Message->Nonce;
+		Bytes[Length++] = Message->Nonce >> 8;
+	}
+
+	return Vs_Frame(Bytes, Message->Kind, Length - 2);
+}
+
+uint8_t Vs_Unframe(VsReceiver *Receiver, uint8_t Byte)
+{
+	uint8_t Length = VS_LENGTH(Receiver);
+
+	if (!Receiver->Received) {
+		if (Byte == VS_FRAME_START)
+			Receiver->Received = 1;
+		return VS_NONE;
+	}
+
+	if (Receiver->Received == 1) {
+		Receiver->Header = Byte;
+		Receiver->Sum = Byte;
+		Receiver->Received++;
+		return VS_NONE;
+	}
+
+	if (Receiver->Received - 2 < Length) {
+		Receiver->Payload[Receiver->Received - 2] = Byte;
+		Receiver->Sum += Byte;
+		Receiver->Received++;
+		return VS_NONE;
+	}
+
+	/* The check byte ends the frame */
+	Receiver->Received = 0;
+	if ((uint8_t)(Receiver->Sum + Byte) != 0xFF)
+		return VS_NONE;
+
+	return Receiver->Header >> 4;
+}
+
+uint8_t Vs_Decode(VsReceiver *Receiver, uint8_t Byte, VsMessage *Message)
+{
+	uint8_t Length;
+
+	Message->Kind = Vs_Unframe(Receiver, Byte);
+	Length = VS_LENGTH(Receiver);
+
+	switch (Message->Kind) {
+	case VS_CLEARED:
+		if (Length != 2)
+			return VS_NONE;
+		Message->Score = Receiver->Payload[0] | (uint16_t)Receiver->Payload[1] << 8;
+		break;
+	case VS_GARBAGE:
+		if ((Length != 2) || !Receiver->Payload[0] || (Receiver->Payload[1] >= BOARD_COLUMNS))
+			return VS_NONE;
+		Message->Rows = Receiver->Payload[0];
+		Message->Hole = Receiver->Payload[1];
+		break;
+	case VS_LOST:
+		if (Length)
+			return VS_NONE;
+		break;
+	case VS_INPUTS:
+		if (Length < 4)
+			return VS_NONE;
+		Message->Frame = Receiver->Payload[0] | (uint16_t)Receiver->Payload[1] << 8;
+		Message->Ack = Receiver->Payload[2] | (uint16_t)Receiver->Payload[3] << 8;
+		Message->Count = 2 * (Length - 4);
+		memcpy(Message->Inputs, &Receiver->Payload[4], Length - 4);
+		break;
+	case VS_HELLO:
+		if (Length != 2)
+			return VS_NONE;
+		Message->Nonce = Receiver->Payload[0] | (uint16_t)Receiver->Payload[1] << 8;
+		break;
+	default:
+		return VS_NONE;
+	}
+
+	return Message->Kind;
+}
+
+#ifdef VERSUS
+
+#ifdef __AVR__
+
+/* On the device the opponent is on the other end of the UART. The model
+ * sends while holding it */
+#include "os.h"
+
+void Vs_Send(const VsMessage *Message)
+{
+	uint8_t Bytes[VS_FRAME_SIZE_MAX];
+	uint8_t Length, Index;
+
+	Length = Vs_Encode(Bytes, Message);
+	for (Index = 0; Index < Length; Index++)
+		Os_UARTSend(Bytes[Index]);
+}
+
+#else
+
+/* Emulator: The opponent is on the other end of a serial device */
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <unistd.h>
+
+static int Link = -1;
+
+int Vs_Open(const char *Path)
+{
+	struct termios Attributes;
+
+	Link = open(Path, O_RDWR | O_NOCTTY);
+	if (Link < 0)
+		return 0;
+
+	/* Bytes as they are, no line discipline */
+	if (!tcgetattr(Link, &Attributes)) {
+		cfmakeraw(&Attributes);
+		tcsetattr(Link, TCSANOW, &Attributes);
+	}
+
+	return 1;
+}
+
+int Vs_Wait(void)
+{
+	uint8_t Byte;
+	ssize_t Read;
+
+	do {
+		Read = read(Link, &Byte, 1);
+	} while ((Read < 0) && (errno == EINTR));
+
+	return (Read == 1) ? Byte : -1;
+}
+
+void Vs_Send(const VsMessage *Message)
+{
+	uint8_t Bytes[VS_FRAME_SIZE_MAX];
+
+	if ((Link >= 0) && (write(Link, Bytes, Vs_Encode(Bytes, Message)) < 0))
+		Link = -1;
+}
+
+#endif /* __AVR__ */
+
+/* Garbage waits until the falling tetromino is locked. If more keeps
+ * coming in meanwhile it is added to the last rows waiting */
+#define VS_QUEUE_SIZE		4
+
+static VsReceiver Receiver;
+
+static uint8_t QueueRows[VS_QUEUE_SIZE];
+static uint8_t QueueHoles[VS_QUEUE_SIZE];
+static uint8_t Queued;
+
+static uint8_t Won;
+static uint16_t OpponentScore;
+
+/* Kept off the stack of the task the interrupt comes in on */
+static VsMessage Incoming;
+
+uint8_t Vs_Receive(uint8_t Byte)
+{
+	uint8_t Kind;
+
+	Kind = Vs_Decode(&Receiver, Byte, &Incoming);
+
+	switch (Kind) {
+	case VS_CLEARED:
+		OpponentScore = Incoming.Score;
+		break;
+	case VS_GARBAGE:
+		if (Queued < VS_QUEUE_SIZE) {
+			QueueRows[Queued] = Incoming.Rows;
+			QueueHoles[Queued] = Incoming.Hole;
+			Queued++;
+		} else if (QueueRows[VS_QUEUE_SIZE - 1] < BOARD_ROWS) {
+			QueueRows[VS_QUEUE_SIZE - 1] += Incoming.Rows;
+		}
+		break;
+	case VS_LOST:
+		Won = 1;
+		break;
+	default:
+		break;
+	}
+
+	return Kind;
+}
+
+uint8_t Vs_TakeGarbage(uint8_t *Hole)
+{
+	uint8_t Rows, Index;
+
+	if (!Queued)
+		return 0;
+
+	Rows = QueueRows[0];
+	*Hole = QueueHoles[0];
+
+	Queued--;
+	for (Index = 0; Index < Queued; Index++) {
+		QueueRows[Index] = QueueRows[Index + 1];
+		QueueHoles[Index] = QueueHoles[Index + 1];
+	}
+
+	return Rows;
+}
+
+uint8_t Vs_TakeWon(void)
+{
+	if (!Won)
+		return 0;
+
+	Won = 0;
+	Queued = 0;
+
+	return 1;
+}
+
+uint16_t Vs_OpponentScore(void)
+{
+	return OpponentScore;
+}
+
+void Vs_Cleared(uint16_t Score, uint8_t Cleared, uint8_t Hole)
+{
+	VsMessage Message;
+
+	Message.Kind = VS_CLEARED;
+	Message.Score = Score;
+	Vs_Send(&Message);
+
+	Message.Rows = Vs_Garbage(Cleared);
+	if (!Message.Rows)
+		return;
+
+	Message.Kind = VS_GARBAGE;
+	Message.Hole = Hole;
+	Vs_Send(&Message);
+}
+
+void Vs_Lost(void)
+{
+	VsMessage Message;
+
+	Message.Kind = VS_LOST;
+	Vs_Send(&Message);
+}
+
+#endif /* VERSUS */
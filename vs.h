@@ -0,0 +1,170 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * vs.h: Versus mode: Garbage rows and scores exchanged with an opponent
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef VS_H
+#define VS_H
+
+#include <stdint.h>
+
+/* Two games, on two devices or emulators, linked by their UARTs. Clearing
+ * rows sends the score and garbage rows to the opponent, a game that ends
+ * lets the opponent win.
+ *
+ * Frame: VS_FRAME_START, a header byte with the kind of the message in the
+ * upper 4 bits and the length of its payload in the lower 4, the payload
+ * and a check byte: The complement of the 8 bit sum of header and payload.
+ * The UART carries text as well. Text is 7 bit ASCII and never holds the
+ * start of a frame, so the receiver skips it until one comes. A frame that
+ * does not check has the receiver look for the next one. Frames of kinds
+ * it does not know are skipped as well. The frames of the spectator stream
+ * (sp.h) go out the same way, with kinds of their own */
+#define VS_FRAME_START			0xA5
+#define VS_PAYLOAD_SIZE_MAX		15
+#define VS_FRAME_SIZE_MAX		(VS_PAYLOAD_SIZE_MAX + 3)
+
+/* Kinds of messages */
+#define VS_NONE				0
+/* The sender's score, low byte first */
+#define VS_CLEARED			1
+/* Garbage rows for the receiver: The number of rows and the column of
+ * the gap in them */
+#define VS_GARBAGE			2
+/* The sender's game has ended */
+#define VS_LOST				3
+/* Rollback: The sender's inputs for the frames the receiver has not
+ * acknowledged yet. The last of these frames and the first frame of the
+ * receiver's inputs the sender is missing, low bytes first, then the
+ * inputs from the last frame back, 4 bits each, lower half first */
+#define VS_INPUTS			4
+/* Rollback: Start of a session. A random number, low byte first. The
+ * greater one plays side 0 and both seed the games with the two XORed */
+#define VS_HELLO			5
+
+/* Inputs of up to this many frames fit a message */
+#define VS_INPUTS_MAX			(2 * (VS_PAYLOAD_SIZE_MAX - 4))
+
+typedef struct {
+	uint8_t Kind;
+	/* VS_CLEARED only */
+	uint16_t Score;
+	/* VS_GARBAGE only */
+	uint8_t Rows;
+	uint8_t Hole;
+	/* VS_INPUTS only. Count is even */
+	uint16_t Frame;
+	uint16_t Ack;
+	uint8_t Count;
+	uint8_t Inputs[VS_INPUTS_MAX / 2];
+	/* VS_HELLO only */
+	uint16_t Nonce;
+} VsMessage;
+
+/* Where the receiver is in a frame */
+typedef struct {
+	uint8_t Header;
+	/* Bytes of the frame received, 0 while looking for its start */
+	uint8_t Received;
+	uint8_t Sum;
+	uint8_t Payload[VS_PAYLOAD_SIZE_MAX];
+} VsReceiver;
+
+/* Length of the payload of the frame received */
+#define VS_LENGTH(Receiver)		((Receiver)->Header & 0x0F)
+
+/* Garbage rows sent for the given number of rows cleared at once */
+extern uint8_t Vs_Garbage(uint8_t Cleared);
+
+/* Frame a payload of the given kind and length, already in place after
+ * the first two bytes. Returns the size of the frame */
+extern uint8_t Vs_Frame(uint8_t *Bytes, uint8_t Kind, uint8_t Length);
+
+/* Take the next byte received. Returns the kind of the frame once it is
+ * complete and checks, VS_NONE until then. The payload is left in the
+ * receiver */
+extern uint8_t Vs_Unframe(VsReceiver *Receiver, uint8_t Byte);
+
+/* Write the frame of a message. Returns its size, at most
+ * VS_FRAME_SIZE_MAX */
+extern uint8_t Vs_Encode(uint8_t *Bytes, const VsMessage *Message);
+
+/* Take the next byte received. Returns the kind of the message once a
+ * frame is complete, VS_NONE until then. The receiver starts zeroed */
+extern uint8_t Vs_Decode(VsReceiver *Receiver, uint8_t Byte, VsMessage *Message);
+
+#ifdef VERSUS
+
+#ifndef __AVR__
+/* Link to the opponent via the given serial device, usually one end of a
+ * pty pair. Non zero on success */
+extern int Vs_Open(const char *Path);
+
+/* Wait for the next byte from the opponent. Negative once the link is
+ * gone */
+extern int Vs_Wait(void);
+#endif
+
+/* Send a message to the opponent */
+extern void Vs_Send(const VsMessage *Message);
+
+/* Pass on a byte received from the opponent. Called by the UART's receive
+ * interrupt on the device. Returns the kind of message completed */
+extern uint8_t Vs_Receive(uint8_t Byte);
+
+/* Take the oldest garbage rows received. Returns their number, zero if
+ * there are none, and the column of their gap. The caller keeps
+ * Vs_Receive out */
+extern uint8_t Vs_TakeGarbage(uint8_t *Hole);
+
+/* Non zero once after the opponent lost. The garbage still waiting is
+ * dropped. The caller keeps Vs_Receive out */
+extern uint8_t Vs_TakeWon(void);
+
+/* Score the opponent reported last */
+extern uint16_t Vs_OpponentScore(void);
+
+/* Tell the opponent about the rows just cleared and send the garbage
+ * rows they are worth, with a gap in the given column */
+extern void Vs_Cleared(uint16_t Score, uint8_t Cleared, uint8_t Hole);
+
+/* Tell the opponent the game has ended */
+extern void Vs_Lost(void);
+
+#else
+
+/* Versus mode compiles to nothing if it is not wanted */
+#define Vs_Receive(Byte)		((void)(Byte), VS_NONE)
+#define Vs_TakeGarbage(Hole)		((void)(Hole), 0)
+#define Vs_TakeWon()			0
+#define Vs_Cleared(Score, Cleared, Hole) ((void)(Score), (void)(Cleared), (void)(Hole))
+#define Vs_Lost()			((void)0)
+
+#endif /* VERSUS */
+
+#endif /* VS_H */
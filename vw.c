@@ -0,0 +1,80 @@
+/*
+ * ToRT - Tetris device with toy-grade OSEK/VDX-inspired RTOS
+ *
+ * vw.c: Rendering of the board to the display buffer
+ *
+ * Copyright (c) 2019, Helmut Sipos <helmut.sipos@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "vw.h"
+
+/* Translate a row of the board to the display buffer bytes of a column of
+ * pixels. The columns of the board are stacked along the pixel column, the
+ * squares of each may straddle two bytes */
+static void ExpandRow(BoardRow Squares, uint8_t *Pages)
+{
+	uint8_t Col, Pixel;
+	uint16_t Mask;
+
+	memset(Pages, 0, LCD_PAGES + 1);
+
+	for (Col = 0, Pixel = DISPLAY_OFFSET_Y; Squares; Col++, Pixel += SQUARE_SIDE_LENGTH, Squares >>= 1) {
+		if (Squares & 1) {
+			Mask = ((1 << SQUARE_SIDE_LENGTH) - 1) << (Pixel % 8);
+			Pages[Pixel / 8] |= (uint8_t)Mask;
+			Pages[Pixel / 8 + 1] |= (uint8_t)(Mask >> 8);
+		}
+	}
+}
+
+/* Both the board and the tetrominos are made up of "squares" that are
+ * drawn as N x N squares on the display. Each row of squares is expanded
+ * once and then ORed into the display buffer byte by byte */
+void Vw_Draw(const BoardRow *Board, const BoardRow *Ghost, uint8_t *Buffer)
+{
+	/* The display buffer bytes of a row of squares and of its ghost squares.
+	 * One more than needed for squares straddling the last byte */
+	uint8_t Solid[LCD_PAGES + 1];
+	uint8_t Shaded[LCD_PAGES + 1];
+	uint8_t Row, Width, Page, Pixel, Pattern;
+
+	for (Row = 0; Row < BOARD_ROWS; Row++) {
+		if ((Board[Row] | Ghost[Row]) == ROW_EMPTY)
+			continue;
+
+		ExpandRow(Board[Row], Solid);
+		ExpandRow(Ghost[Row] & ~Board[Row], Shaded);
+
+		Pixel = DISPLAY_OFFSET_X + (Row * SQUARE_SIDE_LENGTH);
+		for (Width = 0; Width < SQUARE_SIDE_LENGTH; Width++, Pixel++) {
+			Pattern = (Pixel & 1) ? 0xAA : 0x55;
+			for (Page = 0; Page < LCD_PAGES; Page++)
+				Buffer[Pixel + Page * LCD_WIDTH] |= Solid[Page] | (Shaded[Page] & Pattern);
+		}
+	}
+}